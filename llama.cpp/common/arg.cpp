@@ -2792,10 +2792,25 @@ common_params_context common_params_parser_init(common_params & params, llama_ex
             params.use_mmap = false;
         }
     ).set_env("LLAMA_ARG_NO_MMAP"));
+    add_opt(common_arg(
+        {"--hugepages"},
+        "back memory-mapped model weights with transparent huge pages to reduce TLB misses (Linux only)",
+        [](common_params & params) {
+            params.use_hugepages = true;
+        }
+    ).set_env("LLAMA_ARG_HUGEPAGES"));
+    add_opt(common_arg(
+        {"--tensor-dedup"}, "DIR",
+        "share the page cache of identical tensors between models memory-mapped on this host, using a\n"
+        "content-addressed index kept in DIR (POSIX only; the first load of a model hashes its tensors)",
+        [](common_params & params, const std::string & value) {
+            params.tensor_dedup_dir = value;
+        }
+    ).set_env("LLAMA_ARG_TENSOR_DEDUP"));
     add_opt(common_arg(
         {"--numa"}, "TYPE",
         "attempt optimizations that help on some NUMA systems\n"
-        "- distribute: spread execution evenly over all nodes\n"
+        "- distribute: spread execution and memory-mapped weights evenly over all nodes\n"
         "- isolate: only spawn threads on CPUs on the node that execution started on\n"
         "- numactl: use the CPU map provided by numactl\n"
         "if run without this previously, it is recommended to drop the system page cache before using this\n"
@@ -1134,6 +1134,8 @@ struct llama_model_params common_model_params_to_llama(common_params & params) {
     mparams.check_tensors   = params.check_tensors;
     mparams.use_extra_bufts = !params.no_extra_bufts;
     mparams.no_host         = params.no_host;
+    mparams.use_hugepages   = params.use_hugepages;
+    mparams.tensor_dedup_dir = params.tensor_dedup_dir.empty() ? nullptr : params.tensor_dedup_dir.c_str();
 
     if (params.kv_overrides.empty()) {
         mparams.kv_overrides = NULL;
@@ -682,6 +682,10 @@ bool ggml_is_numa(void) {
     return g_state.numa.n_nodes > 1;
 }
 
+enum ggml_numa_strategy ggml_numa_get_strategy(void) {
+    return ggml_is_numa() ? g_state.numa.numa_strategy : GGML_NUMA_STRATEGY_DISABLED;
+}
+
 #if defined(__ARM_ARCH)
 
 #if defined(__linux__) && defined(__aarch64__)
@@ -0,0 +1,369 @@
+#include "llama-dedup.h"
+
+#include "llama-impl.h"
+#include "llama-mmap.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+#ifdef __COSMOPOLITAN__
+#include <cosmo.h>
+#include "llamafile/llamafile.h"
+#include "llamafile/zip.h"
+#endif
+
+#ifdef __has_include
+    #if __has_include(<unistd.h>)
+        #include <unistd.h>
+        #if defined(_POSIX_MAPPED_FILES)
+            #include <fcntl.h>
+            #include <sys/mman.h>
+            #include <sys/stat.h>
+        #endif
+    #endif
+#endif
+
+// xxh64, the same hash gguf-hash reports per tensor
+
+static const uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t xxh_rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_read64(const uint8_t * p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t xxh_read32(const uint8_t * p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc  = xxh_rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh64_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+uint64_t llama_xxh64(const void * data, size_t len, uint64_t seed) {
+    const uint8_t * p   = (const uint8_t *) data;
+    const uint8_t * end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = xxh64_round(v1, xxh_read64(p +  0));
+            v2 = xxh64_round(v2, xxh_read64(p +  8));
+            v3 = xxh64_round(v3, xxh_read64(p + 16));
+            v4 = xxh64_round(v4, xxh_read64(p + 24));
+        }
+        h = xxh_rotl64(v1, 1) + xxh_rotl64(v2, 7) + xxh_rotl64(v3, 12) + xxh_rotl64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+
+    h += (uint64_t) len;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh64_round(0, xxh_read64(p));
+        h  = xxh_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t) xxh_read32(p) * XXH_PRIME64_1;
+        h  = xxh_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= (uint64_t) *p * XXH_PRIME64_5;
+        h  = xxh_rotl64(h, 11) * XXH_PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+#if defined(_POSIX_MAPPED_FILES)
+
+// identifies a file by inode and modification, so an index entry goes stale when the file changes
+struct llama_file_id {
+    uint64_t dev   = 0;
+    uint64_t ino   = 0;
+    uint64_t size  = 0;
+    int64_t  mtime = 0;
+
+    bool operator==(const llama_file_id & other) const {
+        return dev == other.dev && ino == other.ino && size == other.size && mtime == other.mtime;
+    }
+
+    std::string str(char sep) const {
+        return format("%" PRIu64 "%c%" PRIu64 "%c%" PRIu64 "%c%" PRId64, dev, sep, ino, sep, size, sep, mtime);
+    }
+};
+
+static bool llama_file_id_of(int fd, llama_file_id & id) {
+    struct stat st;
+    if (fstat(fd, &st)) {
+        return false;
+    }
+    id.dev   = st.st_dev;
+    id.ino   = st.st_ino;
+    id.size  = st.st_size;
+    id.mtime = st.st_mtime;
+    return true;
+}
+
+static bool llama_dedup_read(const std::string & path, std::string & out) {
+    FILE * f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    char buf[4096];
+    size_t n;
+    out.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        out.append(buf, n);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// the file whose pages back a model, which for weights embedded in a llamafile is the executable
+// itself, since stored zip entries get mapped straight out of it. other processes have their own
+// /zip/ namespace, so the index has to refer to the executable and the entry's offset within it
+struct llama_dedup_source {
+    int         fd   = -1;
+    size_t      base = 0; // offset of the model within the file
+    std::string path;
+};
+
+static bool llama_dedup_source_of(const std::string & fname, const llama_file & file, llama_dedup_source & src) {
+    src.fd   = file.file_id();
+    src.base = 0;
+    src.path = fname;
+#ifdef __COSMOPOLITAN__
+    if (!fname.compare(0, 5, "/zip/")) {
+        const char * prog = GetProgramExecutableName();
+        struct llamafile_zip * zip = llamafile_zip_index(prog);
+        if (!zip) {
+            return false;
+        }
+        const struct llamafile_zip_entry * entry = llamafile_zip_find(zip, fname.c_str() + 5, fname.size() - 5);
+        if (!entry || entry->count != 1 || entry->method != kZipCompressionNone) {
+            return false;
+        }
+        int64_t off = llamafile_zip_offset(zip, entry);
+        if (off == -1) {
+            return false;
+        }
+        src.fd   = llamafile_zip_fd(zip);
+        src.base = off;
+        src.path = prog;
+    }
+#endif
+    if (char * real = realpath(src.path.c_str(), nullptr)) {
+        src.path = real;
+        free(real);
+    }
+    return true;
+}
+
+// writes a temporary file and moves it into place, either unconditionally, or only if no other
+// process has created the path first, in which case false is returned
+static bool llama_dedup_write(const std::string & path, const std::string & data, bool exclusive) {
+    static std::atomic<unsigned> counter;
+    std::string tmp = format("%s.%d.%u.tmp", path.c_str(), (int) getpid(), counter++);
+    FILE * f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = !fclose(f) && ok;
+    if (ok) {
+        ok = exclusive ? !link(tmp.c_str(), path.c_str()) : !rename(tmp.c_str(), path.c_str());
+    }
+    unlink(tmp.c_str());
+    return ok;
+}
+
+// checks that the canonical copy still holds the bytes we hashed, since the index is only a hint
+// and the file could have been rewritten in place without its size or mtime changing
+static bool llama_dedup_verify(int fd, size_t offs, size_t size, uint64_t hash, size_t page_size) {
+    const size_t skew = offs % page_size;
+    void * p = mmap(nullptr, skew + size, PROT_READ, MAP_SHARED, fd, offs - skew);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    bool ok = llama_xxh64((const uint8_t *) p + skew, size) == hash;
+    munmap(p, skew + size);
+    return ok;
+}
+
+size_t llama_tensor_dedup(
+        const std::string & dir,
+        const std::string & fname,
+        const llama_file & file,
+        llama_mmap & mapping,
+        const std::vector<std::pair<size_t, size_t>> & tensors) {
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    llama_dedup_source src;
+    llama_file_id self;
+    if (!llama_dedup_source_of(fname, file, src) || !llama_file_id_of(src.fd, self)) {
+        LLAMA_LOG_WARN("%s: can't locate the file backing %s, not sharing it\n", __func__, fname.c_str());
+        return 0;
+    }
+    if (src.base % page_size) {
+        LLAMA_LOG_WARN("%s: %s isn't page aligned within %s, use zipalign\n", __func__, fname.c_str(), src.path.c_str());
+        return 0;
+    }
+    for (const char * sub : {"", "/models", "/tensors"}) {
+        if (mkdir((dir + sub).c_str(), 0755) && errno != EEXIST) {
+            LLAMA_LOG_WARN("%s: failed to create %s%s: %s\n", __func__, dir.c_str(), sub, strerror(errno));
+            return 0;
+        }
+    }
+    // hashing a model reads all of it, so it's only done the first time it's seen
+    std::vector<uint64_t> hashes;
+    const std::string index = dir + "/models/" + self.str('-') + (src.base ? format("-%zu", src.base) : "");
+    bool hashed = false;
+    std::string text;
+    if (llama_dedup_read(index, text)) {
+        const char * s = text.c_str();
+        size_t offs, size;
+        uint64_t hash;
+        int n;
+        while (hashes.size() < tensors.size() &&
+               sscanf(s, "%zu %zu %" SCNx64 "%n", &offs, &size, &hash, &n) == 3 &&
+               offs == tensors[hashes.size()].first && size == tensors[hashes.size()].second) {
+            hashes.push_back(hash);
+            s += n;
+        }
+    }
+    if (hashes.size() != tensors.size()) {
+        LLAMA_LOG_INFO("%s: hashing %zu tensors of %s\n", __func__, tensors.size(), fname.c_str());
+        hashes.clear();
+        text.clear();
+        for (const auto & t : tensors) {
+            hashes.push_back(llama_xxh64((const uint8_t *) mapping.addr() + t.first, t.second));
+            text += format("%zu %zu %016" PRIx64 "\n", t.first, t.second, hashes.back());
+        }
+        llama_dedup_write(index, text, false);
+        hashed = true;
+    }
+
+    std::map<std::string, int> fds; // canonical files, open until their pages are mapped
+    size_t shared = 0;
+    for (size_t i = 0; i < tensors.size(); ++i) {
+        const size_t offs = tensors[i].first;
+        const size_t size = tensors[i].second;
+        if (size < 2*page_size) {
+            continue; // too small to span a whole page
+        }
+
+        const std::string entry  = dir + format("/tensors/%016" PRIx64 "-%zu", hashes[i], size);
+        const std::string record = format("%s %zu %s\n", self.str(' ').c_str(), src.base + offs, src.path.c_str());
+        if (llama_dedup_write(entry, record, true)) {
+            continue; // first seen here, so this file is the canonical copy
+        }
+
+        llama_file_id canon;
+        size_t canon_offs;
+        int n = 0;
+        if (!llama_dedup_read(entry, text) ||
+            sscanf(text.c_str(), "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNd64 " %zu %n",
+                   &canon.dev, &canon.ino, &canon.size, &canon.mtime, &canon_offs, &n) != 5 || !n) {
+            continue;
+        }
+        if (canon == self && canon_offs == src.base + offs) {
+            continue;
+        }
+        std::string canon_path = text.substr(n);
+        while (!canon_path.empty() && canon_path.back() == '\n') {
+            canon_path.pop_back();
+        }
+
+        auto it = fds.find(canon_path);
+        if (it == fds.end()) {
+            it = fds.emplace(canon_path, open(canon_path.c_str(), O_RDONLY | O_CLOEXEC)).first;
+        }
+        llama_file_id actual;
+        if (it->second == -1 || !llama_file_id_of(it->second, actual) || !(actual == canon)) {
+            // the canonical copy was deleted or modified, so take its place
+            llama_dedup_write(entry, record, false);
+            continue;
+        }
+        if (canon_offs % page_size != (src.base + offs) % page_size) {
+            continue; // different alignment, see general.alignment
+        }
+
+        if (!llama_dedup_verify(it->second, canon_offs, size, hashes[i], page_size)) {
+            LLAMA_LOG_WARN("%s: %s no longer holds tensor %016" PRIx64 ", taking its place\n", __func__, canon_path.c_str(), hashes[i]);
+            llama_dedup_write(entry, record, false);
+            continue;
+        }
+
+        size_t len = mapping.share_fragment(offs, offs + size, it->second, canon_offs);
+#ifdef POSIX_FADV_DONTNEED
+        if (len && hashed) {
+            // our own copy was only read for hashing, so don't let it linger in the page cache
+            posix_fadvise(src.fd, src.base + offs, size, POSIX_FADV_DONTNEED);
+        }
+#endif
+        shared += len;
+    }
+    for (const auto & it : fds) {
+        if (it.second != -1) {
+            close(it.second);
+        }
+    }
+
+    return shared;
+}
+
+#else
+
+size_t llama_tensor_dedup(
+        const std::string & dir,
+        const std::string & fname,
+        const llama_file & file,
+        llama_mmap & mapping,
+        const std::vector<std::pair<size_t, size_t>> & tensors) {
+    GGML_UNUSED(dir);
+    GGML_UNUSED(file);
+    GGML_UNUSED(mapping);
+    GGML_UNUSED(tensors);
+    LLAMA_LOG_WARN("%s: tensor deduplication is not supported on this platform, ignoring it for %s\n", __func__, fname.c_str());
+    return 0;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct llama_file;
+struct llama_mmap;
+
+// content-addressed index of tensor data, kept in a directory shared by all models on a host
+//
+// the first file seen with a given tensor becomes its canonical copy; when another mapped model
+// contains the same bytes, the pages of that tensor are remapped onto the canonical file, so the
+// page cache holds a single copy no matter how many model variants embed it
+//
+// layout of the directory:
+//   models/<dev>-<ino>-<size>-<mtime>[-<base>]   one "<offs> <size> <hash>" line per tensor of a model
+//   tensors/<hash>-<size>                        "<dev> <ino> <size> <mtime> <offs> <path>" of the canonical copy
+//
+// weights embedded in a llamafile are recorded as the executable's path and their offset within
+// it (base), rather than as a /zip/ path, which would only make sense to the process that wrote it
+
+uint64_t llama_xxh64(const void * data, size_t len, uint64_t seed = 0);
+
+// tensors are given as (file offset, size in bytes); returns the number of bytes now shared
+size_t llama_tensor_dedup(
+        const std::string & dir,
+        const std::string & fname,
+        const llama_file & file,
+        llama_mmap & mapping,
+        const std::vector<std::pair<size_t, size_t>> & tensors);
@@ -17,6 +17,10 @@
             #include <sys/mman.h>
             #include <fcntl.h>
         #endif
+        #if defined(__linux__)
+            #include <sys/stat.h>
+            #include <sys/syscall.h>
+        #endif
         #if defined(_POSIX_MEMLOCK_RANGE)
             #include <sys/resource.h>
         #endif
@@ -126,6 +130,28 @@ struct llama_file::impl {
         }
     }
 
+    void read_raw_at(void * ptr, size_t len, size_t offset) const {
+        size_t bytes_read = 0;
+        while (bytes_read < len) {
+            size_t chunk_size = std::min<size_t>(len - bytes_read, 64*1024*1024);
+            // the handle wasn't opened with FILE_FLAG_OVERLAPPED, so this still blocks, holds
+            // the handle's lock, and moves the file pointer; it only supplies the offset
+            OVERLAPPED ov = {};
+            ov.Offset     = (DWORD) ((offset + bytes_read) & 0xFFFFFFFF);
+            ov.OffsetHigh = (DWORD) ((uint64_t) (offset + bytes_read) >> 32);
+            DWORD chunk_read = 0;
+            BOOL result = ReadFile(fp_win32, reinterpret_cast<char*>(ptr) + bytes_read, chunk_size, &chunk_read, &ov);
+            if (!result) {
+                throw std::runtime_error(format("read error: %s", GetErrorMessageWin32(GetLastError()).c_str()));
+            }
+            if (chunk_read == 0) {
+                throw std::runtime_error("unexpectedly reached end of file");
+            }
+
+            bytes_read += chunk_read;
+        }
+    }
+
     uint32_t read_u32() const {
         uint32_t val;
         read_raw(&val, sizeof(val));
@@ -209,6 +235,25 @@ struct llama_file::impl {
         }
     }
 
+    // positional read which leaves the stream offset alone, so it may be called from many threads
+    void read_raw_at(void * ptr, size_t len, size_t offset) const {
+        int fd = fileno(fp);
+        size_t bytes_read = 0;
+        while (bytes_read < len) {
+            ssize_t ret = pread(fd, (char *) ptr + bytes_read, len - bytes_read, (off_t) (offset + bytes_read));
+            if (ret == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(format("read error: %s", strerror(errno)));
+            }
+            if (ret == 0) {
+                throw std::runtime_error("unexpectedly reached end of file");
+            }
+            bytes_read += ret;
+        }
+    }
+
     uint32_t read_u32() const {
         uint32_t ret;
         read_raw(&ret, sizeof(ret));
@@ -261,6 +306,7 @@ int llama_file::file_id() const {
 
 void llama_file::seek(size_t offset, int whence) const { pimpl->seek(offset, whence); }
 void llama_file::read_raw(void * ptr, size_t len) const { pimpl->read_raw(ptr, len); }
+void llama_file::read_raw_at(void * ptr, size_t len, size_t offset) const { pimpl->read_raw_at(ptr, len, offset); }
 
 uint32_t llama_file::read_u32() const { return pimpl->read_u32(); }
 
@@ -269,27 +315,91 @@ void llama_file::write_u32(uint32_t val) const { pimpl->write_u32(val); }
 
 // llama_mmap
 
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+// interleaves page allocations of the calling thread over all NUMA nodes for as long as it
+// is alive, so the page cache that backs a mapping populated meanwhile is spread evenly
+struct llama_numa_interleave {
+    static constexpr int MPOL_DEFAULT_    = 0;
+    static constexpr int MPOL_INTERLEAVE_ = 3;
+
+    bool active = false;
+
+    llama_numa_interleave(bool enable) {
+        if (!enable) {
+            return;
+        }
+        unsigned long mask = 0;
+        for (size_t node = 0; node < sizeof(mask) * CHAR_BIT; ++node) {
+            char path[64];
+            struct stat st;
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%zu", node);
+            if (stat(path, &st) == 0) {
+                mask |= 1ul << node;
+            }
+        }
+        if (__builtin_popcountl(mask) < 2) {
+            return;
+        }
+        if (syscall(SYS_set_mempolicy, MPOL_INTERLEAVE_, &mask, sizeof(mask) * CHAR_BIT + 1)) {
+            LLAMA_LOG_WARN("warning: set_mempolicy(MPOL_INTERLEAVE) failed: %s\n", strerror(errno));
+            return;
+        }
+        active = true;
+    }
+
+    ~llama_numa_interleave() {
+        if (active) {
+            syscall(SYS_set_mempolicy, MPOL_DEFAULT_, nullptr, 0);
+        }
+    }
+};
+#else
+struct llama_numa_interleave {
+    llama_numa_interleave(bool enable) { GGML_UNUSED(enable); }
+};
+#endif
+
 struct llama_mmap::impl {
 #ifdef _POSIX_MAPPED_FILES
     std::vector<std::pair<size_t, size_t>> mapped_fragments;
 
-    impl(struct llama_file * file, size_t prefetch, bool numa) {
+    impl(struct llama_file * file, size_t prefetch, bool numa, bool interleave, bool hugepages) {
         size = file->size();
         int fd = file->file_id();
         int flags = MAP_SHARED;
-        if (numa) { prefetch = 0; }
+        // without an interleave policy, leave page placement to first touch by the pinned threads
+        if (numa && !interleave) { prefetch = 0; }
+        llama_numa_interleave policy(numa && interleave && prefetch);
 #ifdef __linux__
         if (posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL)) {
             LLAMA_LOG_WARN("warning: posix_fadvise(.., POSIX_FADV_SEQUENTIAL) failed: %s\n",
                     strerror(errno));
         }
-        if (prefetch) { flags |= MAP_POPULATE; }
+        // huge pages have to be requested before the mapping gets populated
+        if (prefetch && !hugepages) { flags |= MAP_POPULATE; }
+#else
+        GGML_UNUSED(hugepages);
 #endif
         addr = mmap(NULL, file->size(), PROT_READ, flags, fd, 0);
         if (addr == MAP_FAILED) {
             throw std::runtime_error(format("mmap failed: %s", strerror(errno)));
         }
 
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (hugepages) {
+            // file-backed THP needs a filesystem with large folio support, e.g. xfs, ext4 or tmpfs
+            if (madvise(addr, file->size(), MADV_HUGEPAGE)) {
+                LLAMA_LOG_WARN("warning: madvise(.., MADV_HUGEPAGE) failed: %s\n",
+                        strerror(errno));
+            }
+#ifdef MADV_POPULATE_READ
+            if (prefetch > 0 && madvise(addr, std::min(file->size(), prefetch), MADV_POPULATE_READ)) {
+                LLAMA_LOG_DEBUG("madvise(.., MADV_POPULATE_READ) failed: %s\n", strerror(errno));
+            }
+#endif
+        }
+#endif
+
         if (prefetch > 0) {
             if (posix_madvise(addr, std::min(file->size(), prefetch), POSIX_MADV_WILLNEED)) {
                 LLAMA_LOG_WARN("warning: posix_madvise(.., POSIX_MADV_WILLNEED) failed: %s\n",
@@ -354,6 +464,26 @@ struct llama_mmap::impl {
         mapped_fragments = std::move(new_mapped_fragments);
     }
 
+    size_t share_fragment(size_t first, size_t last, int fd, size_t offset) {
+        int page_size = sysconf(_SC_PAGESIZE);
+        size_t aligned_first = first;
+        align_range(&aligned_first, &last, page_size);
+        offset += aligned_first - first;
+        size_t len = last - aligned_first;
+
+        if (len == 0 || offset % page_size != 0) {
+            return 0;
+        }
+
+        // a failed MAP_FIXED may leave a hole, so there's no falling back to the pages we had
+        void * next_page_start = (uint8_t *) addr + aligned_first;
+        if (mmap(next_page_start, len, PROT_READ, MAP_SHARED | MAP_FIXED, fd, offset) == MAP_FAILED) {
+            throw std::runtime_error(format("mmap failed: %s", strerror(errno)));
+        }
+
+        return len;
+    }
+
     ~impl() {
         for (const auto & frag : mapped_fragments) {
             if (munmap((char *) addr + frag.first, frag.second - frag.first)) {
@@ -362,8 +492,10 @@ struct llama_mmap::impl {
         }
     }
 #elif defined(_WIN32)
-    impl(struct llama_file * file, size_t prefetch, bool numa) {
+    impl(struct llama_file * file, size_t prefetch, bool numa, bool interleave, bool hugepages) {
         GGML_UNUSED(numa);
+        GGML_UNUSED(interleave);
+        GGML_UNUSED(hugepages);
 
         size = file->size();
 
@@ -411,6 +543,15 @@ struct llama_mmap::impl {
         GGML_UNUSED(last);
     }
 
+    size_t share_fragment(size_t first, size_t last, int fd, size_t offset) {
+        GGML_UNUSED(first);
+        GGML_UNUSED(last);
+        GGML_UNUSED(fd);
+        GGML_UNUSED(offset);
+
+        return 0;
+    }
+
     ~impl() {
         if (!UnmapViewOfFile(addr)) {
             LLAMA_LOG_WARN("warning: UnmapViewOfFile failed: %s\n",
@@ -418,10 +559,12 @@ struct llama_mmap::impl {
         }
     }
 #else
-    impl(struct llama_file * file, size_t prefetch, bool numa) {
+    impl(struct llama_file * file, size_t prefetch, bool numa, bool interleave, bool hugepages) {
         GGML_UNUSED(file);
         GGML_UNUSED(prefetch);
         GGML_UNUSED(numa);
+        GGML_UNUSED(interleave);
+        GGML_UNUSED(hugepages);
 
         throw std::runtime_error("mmap not supported");
     }
@@ -432,19 +575,30 @@ struct llama_mmap::impl {
 
         throw std::runtime_error("mmap not supported");
     }
+
+    size_t share_fragment(size_t first, size_t last, int fd, size_t offset) {
+        GGML_UNUSED(first);
+        GGML_UNUSED(last);
+        GGML_UNUSED(fd);
+        GGML_UNUSED(offset);
+
+        throw std::runtime_error("mmap not supported");
+    }
 #endif
 
     void * addr;
     size_t size;
 };
 
-llama_mmap::llama_mmap(struct llama_file * file, size_t prefetch, bool numa) : pimpl(std::make_unique<impl>(file, prefetch, numa)) {}
+llama_mmap::llama_mmap(struct llama_file * file, size_t prefetch, bool numa, bool interleave, bool hugepages)
+    : pimpl(std::make_unique<impl>(file, prefetch, numa, interleave, hugepages)) {}
 llama_mmap::~llama_mmap() = default;
 
 size_t llama_mmap::size() const { return pimpl->size; }
 void * llama_mmap::addr() const { return pimpl->addr; }
 
 void llama_mmap::unmap_fragment(size_t first, size_t last) { pimpl->unmap_fragment(first, last); }
+size_t llama_mmap::share_fragment(size_t first, size_t last, int fd, size_t offset) { return pimpl->share_fragment(first, last, fd, offset); }
 
 #if defined(_POSIX_MEMLOCK_RANGE) || defined(_WIN32)
 const bool llama_mmap::SUPPORTED  = true;
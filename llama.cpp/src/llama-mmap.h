@@ -24,6 +24,10 @@ struct llama_file {
     void seek(size_t offset, int whence) const;
 
     void read_raw(void * ptr, size_t len) const;
+    // thread-safe positional read. on posix this is pread() and leaves the file position alone.
+    // on windows the handle is synchronous, so concurrent calls serialize and the file position
+    // ends up after the bytes read; don't mix it with seek() + read_raw() on another thread
+    void read_raw_at(void * ptr, size_t len, size_t offset) const;
     uint32_t read_u32() const;
 
     void write_raw(const void * ptr, size_t len) const;
@@ -36,7 +40,7 @@ private:
 
 struct llama_mmap {
     llama_mmap(const llama_mmap &) = delete;
-    llama_mmap(struct llama_file * file, size_t prefetch = (size_t) -1, bool numa = false);
+    llama_mmap(struct llama_file * file, size_t prefetch = (size_t) -1, bool numa = false, bool interleave = false, bool hugepages = false);
     ~llama_mmap();
 
     size_t size() const;
@@ -44,6 +48,10 @@ struct llama_mmap {
 
     void unmap_fragment(size_t first, size_t last);
 
+    // maps the whole pages of [first, last) onto the file fd at offset instead, returns the bytes remapped
+    // the caller must have checked that the bytes are the same, since nothing is compared here
+    size_t share_fragment(size_t first, size_t last, int fd, size_t offset);
+
     static const bool SUPPORTED;
 
 private:
@@ -1,11 +1,18 @@
 #include "llama-model-loader.h"
 
+#include "llama-dedup.h"
+
 #include "ggml.h"
 
+#include <algorithm>
 #include <array>
 #include <cinttypes>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <future>
+#include <mutex>
+#include <thread>
 
 static const size_t kiB = 1024;
 static const size_t MiB = 1024*kiB;
@@ -504,6 +511,7 @@ llama_model_loader::llama_model_loader(
     llm_kv = LLM_KV(llm_arch_from_string(arch_name));
 
     files.emplace_back(new llama_file(fname.c_str(), "rb"));
+    fnames.emplace_back(fname);
     contexts.emplace_back(ctx);
 
     // Save tensors data offset of the main file.
@@ -572,6 +580,7 @@ llama_model_loader::llama_model_loader(
             }
 
             files.emplace_back(new llama_file(fname_split, "rb"));
+            fnames.emplace_back(fname_split);
             contexts.emplace_back(ctx);
 
             // Save tensors data offset info of the shard.
@@ -846,12 +855,14 @@ void llama_model_loader::done_getting_tensors() const {
     }
 }
 
-void llama_model_loader::init_mappings(bool prefetch, llama_mlocks * mlock_mmaps) {
+void llama_model_loader::init_mappings(bool prefetch, llama_mlocks * mlock_mmaps, bool hugepages, const char * dedup_dir) {
     if (use_mmap) {
         mappings.reserve(files.size());
         mmaps_used.reserve(files.size());
-        for (const auto & file : files) {
+        for (size_t idx = 0; idx < files.size(); ++idx) {
+            const auto & file = files[idx];
             bool is_numa = false;
+            bool interleave = false;
 
             auto * dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
             if (dev) {
@@ -860,9 +871,27 @@ void llama_model_loader::init_mappings(bool prefetch, llama_mlocks * mlock_mmaps
                 if (is_numa_fn) {
                     is_numa = is_numa_fn();
                 }
+                // threads are pinned round-robin over all nodes, so spread the weights the same way
+                auto * strategy_fn = (decltype(ggml_numa_get_strategy) *) ggml_backend_reg_get_proc_address(reg, "ggml_backend_cpu_numa_get_strategy");
+                if (strategy_fn) {
+                    interleave = strategy_fn() == GGML_NUMA_STRATEGY_DISTRIBUTE;
+                }
             }
 
-            std::unique_ptr<llama_mmap> mapping = std::make_unique<llama_mmap>(file.get(), prefetch ? -1 : 0, is_numa);
+            // populating the mapping would read in the very pages that deduplication replaces
+            std::unique_ptr<llama_mmap> mapping = std::make_unique<llama_mmap>(file.get(), prefetch && !dedup_dir ? -1 : 0, is_numa, interleave, hugepages);
+            if (dedup_dir) {
+                std::vector<std::pair<size_t, size_t>> tensors;
+                for (const auto & it : weights_map) {
+                    if (it.second.idx == idx) {
+                        tensors.emplace_back(it.second.offs, ggml_nbytes(it.second.tensor));
+                    }
+                }
+                std::sort(tensors.begin(), tensors.end());
+                size_t shared = llama_tensor_dedup(dedup_dir, fnames[idx], *file, *mapping, tensors);
+                LLAMA_LOG_INFO("%s: %.2f MiB of %s shared with other models through %s\n", __func__,
+                        shared / 1024.0 / 1024.0, fnames[idx].c_str(), dedup_dir);
+            }
             mmaps_used.emplace_back(mapping->size(), 0);
             if (mlock_mmaps) {
                 std::unique_ptr<llama_mlock> mlock_mmap(new llama_mlock());
@@ -919,6 +948,149 @@ void llama_model_loader::load_data_for(struct ggml_tensor * cur) const {
     }
 }
 
+// reads tensor data with several positional reads in flight, for when the weights aren't mmap'd
+// tensors in host buffers are read in place; the others are staged in memory bounded by a budget
+// and handed back to the loading thread, which uploads (and possibly repacks) them while the
+// workers keep reading. validation of the data runs on the worker that finished the tensor
+struct llama_tensor_reader {
+    static constexpr size_t chunk_size = 16u*1024*1024;
+
+    struct pending {
+        ggml_tensor * cur;
+        size_t n_size;
+        std::vector<no_init<uint8_t>> staging; // empty when reading straight into cur->data
+        size_t n_chunks;
+        bool valid = true;
+    };
+
+    llama_tensor_reader(int n_threads, size_t budget, bool check) : budget(budget), check(check) {
+        for (int i = 0; i < n_threads; ++i) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ~llama_tensor_reader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv_work.notify_all();
+        for (auto & worker : workers) {
+            worker.join();
+        }
+    }
+
+    // whether a tensor of this size may be staged now; one always may when nothing else is
+    bool can_stage(size_t n_size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return n_staged == 0 || n_staged + n_size <= budget;
+    }
+
+    void submit(ggml_tensor * cur, const llama_file * file, size_t offs, size_t n_size, bool in_place) {
+        auto * p = new pending{cur, n_size, {}, (n_size + chunk_size - 1) / chunk_size};
+        owned.emplace_back(p);
+        if (!in_place) {
+            p->staging.resize(n_size);
+        }
+        uint8_t * dst = in_place ? (uint8_t *) cur->data : (uint8_t *) p->staging.data();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (p->n_chunks == 0) {
+                done.push_back(p);
+            }
+            for (size_t i = 0; i < n_size; i += chunk_size) {
+                chunks.push_back({p, file, offs + i, dst + i, std::min(chunk_size, n_size - i)});
+            }
+            n_pending += 1;
+            n_staged  += p->staging.size();
+        }
+        cv_work.notify_all();
+        cv_done.notify_one();
+    }
+
+    // returns the next tensor that has been read in full, or nullptr if none are outstanding
+    pending * wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv_done.wait(lock, [this] { return error || !done.empty() || n_pending == 0; });
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        if (done.empty()) {
+            return nullptr;
+        }
+        pending * p = done.front();
+        done.pop_front();
+        n_pending -= 1;
+        return p;
+    }
+
+    // gives a tensor's staging memory back to the budget once it has been uploaded
+    void release(pending * p) {
+        std::lock_guard<std::mutex> lock(mutex);
+        n_staged -= p->staging.size();
+        std::vector<no_init<uint8_t>>().swap(p->staging);
+    }
+
+private:
+    struct chunk {
+        pending * p;
+        const llama_file * file;
+        size_t offs;
+        uint8_t * dst;
+        size_t size;
+    };
+
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            cv_work.wait(lock, [this] { return stop || !chunks.empty(); });
+            if (stop) {
+                return;
+            }
+            chunk c = chunks.front();
+            chunks.pop_front();
+            lock.unlock();
+            try {
+                c.file->read_raw_at(c.dst, c.size, c.offs);
+            } catch (...) {
+                lock.lock();
+                if (!error) {
+                    error = std::current_exception();
+                }
+                cv_done.notify_all();
+                continue;
+            }
+            lock.lock();
+            if (--c.p->n_chunks > 0) {
+                continue;
+            }
+            lock.unlock();
+            if (check) {
+                const void * data = c.p->staging.empty() ? c.p->cur->data : (const void *) c.p->staging.data();
+                c.p->valid = ggml_validate_row_data(c.p->cur->type, data, c.p->n_size);
+            }
+            lock.lock();
+            done.push_back(c.p);
+            cv_done.notify_one();
+        }
+    }
+
+    const size_t budget;
+    const bool check;
+
+    std::mutex mutex;
+    std::condition_variable cv_work;
+    std::condition_variable cv_done;
+    std::deque<chunk> chunks;
+    std::deque<pending *> done;
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<pending>> owned;
+    std::exception_ptr error;
+    size_t n_pending = 0;
+    size_t n_staged  = 0;
+    bool stop = false;
+};
+
 bool llama_model_loader::load_all_data(
         struct ggml_context * ctx,
         llama_buf_map & bufs,
@@ -1019,6 +1191,31 @@ bool llama_model_loader::load_all_data(
             ggml_backend_name(upload_backend));
     }
 
+    // without mmap, read tensors with several requests in flight, since a single thread issuing
+    // one read at a time leaves most of the throughput of network filesystems, encrypted disks
+    // and NVMe arrays unused
+    bool validation_failed = false;
+    std::unique_ptr<llama_tensor_reader> reader;
+    if (!use_mmap && !upload_backend) {
+        const int    n_threads = std::clamp<int>(std::thread::hardware_concurrency(), 2, 8);
+        const size_t budget    = 512u*1024*1024; // staging memory for tensors not in host buffers
+        reader = std::make_unique<llama_tensor_reader>(n_threads, budget, check_tensors);
+        LLAMA_LOG_DEBUG("%s: reading tensors with %d threads\n", __func__, n_threads);
+    }
+    const char * func = __func__;
+    auto finish = [&](llama_tensor_reader::pending * p) -> bool {
+        if (!p->staging.empty()) {
+            ggml_backend_tensor_set(p->cur, p->staging.data(), 0, p->n_size);
+        }
+        reader->release(p);
+        if (!p->valid) {
+            LLAMA_LOG_ERROR("%s: tensor '%s' has invalid data\n", func, ggml_get_name(p->cur));
+            validation_failed = true;
+        }
+        size_done += p->n_size;
+        return !progress_callback || progress_callback((float) size_done / size_data, progress_callback_user_data);
+    };
+
     for (struct ggml_tensor * cur = ggml_get_first_tensor(ctx); cur != NULL; cur = ggml_get_next_tensor(ctx, cur)) {
         const auto * weight = get_weight(ggml_get_name(cur));
         if (weight == nullptr) {
@@ -1062,6 +1259,15 @@ bool llama_model_loader::load_all_data(
             } else {
                 ggml_backend_tensor_set(cur, data, 0, n_size);
             }
+        } else if (reader) {
+            const bool in_place = ggml_backend_buffer_is_host(cur->buffer);
+            while (!in_place && !reader->can_stage(n_size)) {
+                if (!finish(reader->wait())) {
+                    return false;
+                }
+            }
+            reader->submit(cur, files.at(weight->idx).get(), weight->offs, n_size, in_place);
+            continue; // accounted for by finish()
         } else {
             const auto & file = files.at(weight->idx);
             if (ggml_backend_buffer_is_host(cur->buffer)) {
@@ -1106,6 +1312,15 @@ bool llama_model_loader::load_all_data(
         size_done += n_size;
     }
 
+    if (reader) {
+        while (auto * p = reader->wait()) {
+            if (!finish(p)) {
+                return false;
+            }
+        }
+        reader.reset();
+    }
+
     // free temporary resources used for async uploads
     for (auto * event : events) {
         ggml_backend_event_synchronize(event);
@@ -1117,7 +1332,6 @@ bool llama_model_loader::load_all_data(
     ggml_backend_free(upload_backend);
 
     // check validation results
-    bool validation_failed = false;
     for (auto & future : validation_result) {
         auto result = future.get();
         if (!result.second) {
@@ -73,6 +73,7 @@ struct llama_model_loader {
     bool check_tensors;
 
     llama_files files;
+    std::vector<std::string> fnames; // same order as files
     llama_ftype ftype;
     llama_fver  fver;
 
@@ -149,7 +150,7 @@ struct llama_model_loader {
 
     void done_getting_tensors() const;
 
-    void init_mappings(bool prefetch = true, llama_mlocks * mlock_mmaps = nullptr);
+    void init_mappings(bool prefetch = true, llama_mlocks * mlock_mmaps = nullptr, bool hugepages = false, const char * dedup_dir = nullptr);
 
     void get_mapping_range(size_t * first, size_t * last, void ** addr, int idx, ggml_context * ctx) const;
 
@@ -49,6 +49,16 @@ o/$(MODE)/llamafile/curl:					\
 		o/$(MODE)/llama.cpp/llama.cpp.a			\
 		o/$(MODE)/third_party/mbedtls/mbedtls.a		\
 
+o/$(MODE)/llamafile/kernelbench:				\
+		o/$(MODE)/llamafile/kernelbench.o		\
+		o/$(MODE)/llamafile/json.o			\
+		o/$(MODE)/llamafile/hextoint.o			\
+		o/$(MODE)/llama.cpp/llama.cpp.a			\
+		o/$(MODE)/double-conversion/double-conversion.a	\
+
+o/$(MODE)/llamafile/kernelbench: private LDFLAGS += -fopenmp
+o/$(MODE)/llamafile/kernelbench.o: private CCFLAGS += -O3 -fopenmp
+
 .PHONY: o/$(MODE)/llamafile
 o/$(MODE)/llamafile:						\
 		$(LLAMAFILE_OBJS)				\
@@ -59,6 +69,7 @@ o/$(MODE)/llamafile:						\
 		o/$(MODE)/llamafile/tokenize			\
 		o/$(MODE)/llamafile/addnl			\
 		o/$(MODE)/llamafile/high			\
+		o/$(MODE)/llamafile/kernelbench			\
 		o/$(MODE)/llamafile/datauri_test.runs		\
 		o/$(MODE)/llamafile/parse_cidr_test.runs	\
 		o/$(MODE)/llamafile/pool_cancel_test.runs	\
@@ -108,6 +119,11 @@ o/$(MODE)/llamafile:						\
 # - HWCAP_FPHP          +fp16     (e.g. m1, rpi5)  __ARM_FEATURE_FP16_SCALAR_ARITHMETIC
 # - HWCAP_ASIMDHP       +fp16     (e.g. m1, rpi5)  __ARM_FEATURE_FP16_VECTOR_ARITHMETIC
 # - HWCAP_ASIMDDP       +dotprod  (e.g. m1, rpi5)  __ARM_FEATURE_DOTPROD
+# - HWCAP2_I8MM         +i8mm     (e.g. m2, graviton3)  __ARM_FEATURE_MATMUL_INT8
+#
+# The arm86 kernels can be tested on an x86 host with something like
+# `qemu-aarch64 -cpu max o//llamafile/sgemm_q0_test` since qemu's
+# max cpu model advertises i8mm in its auxiliary vector.
 #
 
 o/$(MODE)/llamafile/iqk_mul_mat_amd_avx2.o: private TARGET_ARCH += -Xx86_64-mtune=skylake -Xx86_64-mavx -Xx86_64-mavx2 -Xx86_64-mfma -Xx86_64-mf16c
@@ -127,9 +143,13 @@ o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_zen4.o: private TARGET_ARCH += -Xx86_
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_zen4.o: private TARGET_ARCH += -Xx86_64-mtune=znver4 -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f -Xx86_64-mavx512vl -Xx86_64-mavx512vnni -Xx86_64-mavx512bf16
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm82.o: private TARGET_ARCH += -Xaarch64-march=armv8.2-a+dotprod+fp16
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm82.o: private TARGET_ARCH += -Xaarch64-march=armv8.2-a+dotprod+fp16
+o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm86.o: private TARGET_ARCH += -Xaarch64-march=armv8.6-a+dotprod+fp16+i8mm
+o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm86.o: private TARGET_ARCH += -Xaarch64-march=armv8.6-a+dotprod+fp16+i8mm
 
 o/$(MODE)/llamafile/sgemm.o: private CXXFLAGS += -Os
 
+o/$(MODE)/llamafile/sgemm_gemv_test.o			\
+o/$(MODE)/llamafile/sgemm_q0_test.o			\
 o/$(MODE)/llamafile/sgemm_matmul_test.o			\
 o/$(MODE)/llamafile/sgemm_sss_test.o			\
 o/$(MODE)/llamafile/sgemm_vecdot_test.o			\
@@ -144,6 +164,7 @@ o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_fma.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_zen4.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm80.o		\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm82.o		\
+o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm86.o		\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx2.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx512f.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx.o	\
@@ -151,7 +172,8 @@ o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avxvnni.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_fma.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_zen4.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm80.o		\
-o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm82.o:		\
+o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm82.o		\
+o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm86.o:		\
 		private CCFLAGS += -O3 -fopenmp -mgcc
 
 ################################################################################
@@ -201,6 +223,10 @@ o/$(MODE)/llamafile/thread_test:			\
 		o/$(MODE)/llamafile/crash.o		\
 		o/$(MODE)/llamafile/dll3.o		\
 
+o/$(MODE)/llamafile/sgemm_gemv_test: private LDFLAGS += -fopenmp
+o/$(MODE)/llamafile/sgemm_gemv_test.o: private CCFLAGS += -fopenmp
+o/$(MODE)/llamafile/sgemm_q0_test: private LDFLAGS += -fopenmp
+o/$(MODE)/llamafile/sgemm_q0_test.o: private CCFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_sss_test: private LDFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_sss_test.o: private CCFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_matmul_test: private LDFLAGS += -fopenmp
@@ -210,6 +236,14 @@ o/$(MODE)/llamafile/sgemm_sss_test:			\
 		o/$(MODE)/llamafile/sgemm_sss_test.o	\
 		o/$(MODE)/llama.cpp/llama.cpp.a
 
+o/$(MODE)/llamafile/sgemm_gemv_test:			\
+		o/$(MODE)/llamafile/sgemm_gemv_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a
+
+o/$(MODE)/llamafile/sgemm_q0_test:			\
+		o/$(MODE)/llamafile/sgemm_q0_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a
+
 o/$(MODE)/llamafile/sgemm_matmul_test:			\
 		o/$(MODE)/llamafile/sgemm_matmul_test.o	\
 		o/$(MODE)/llama.cpp/llama.cpp.a
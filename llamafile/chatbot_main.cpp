@@ -123,11 +123,13 @@ int main(int argc, char **argv) {
 
     // parse flags (sadly initializes gpu support as side-effect)
     print_ephemeral("loading backend...");
+    llamafile_startup_begin("backend init");
     llama_backend_init();
     if (!gpt_params_parse(argc, argv, g_params)) { // also loads gpu module
         fprintf(stderr, "error: failed to parse flags\n");
         exit(1);
     }
+    llamafile_startup_end("backend init");
     clear_ephemeral();
 
     // setup logging
@@ -137,7 +139,11 @@ int main(int argc, char **argv) {
 
     print_ephemeral("loading model...");
     llama_model_params model_params = llama_model_params_from_gpt_params(g_params);
+    if (FLAG_tensor_dedup)
+        model_params.tensor_dedup_dir = FLAG_tensor_dedup;
+    llamafile_startup_begin("load model");
     g_model = llama_load_model_from_file(g_params.model.c_str(), model_params);
+    llamafile_startup_end("load model");
     clear_ephemeral();
     if (g_model == NULL) {
         fprintf(stderr, "%s: failed to load model%s\n", g_params.model.c_str(), tip());
@@ -178,7 +184,9 @@ int main(int argc, char **argv) {
 
     print_ephemeral("initializing context...");
     llama_context_params ctx_params = llama_context_params_from_gpt_params(g_params);
+    llamafile_startup_begin("new context");
     g_ctx = llama_new_context_with_model(g_model, ctx_params);
+    llamafile_startup_end("new context");
     clear_ephemeral();
     if (!g_ctx) {
         fprintf(stderr, "error: failed to initialize context%s\n", tip());
@@ -190,7 +198,9 @@ int main(int argc, char **argv) {
 
     if (FLAG_mmproj) {
         print_ephemeral("initializing vision model...");
+        llamafile_startup_begin("load mmproj");
         g_clip = clip_model_load(FLAG_mmproj, g_params.verbosity);
+        llamafile_startup_end("load mmproj");
         clear_ephemeral();
         if (!g_clip) {
             fprintf(stderr, "%s: failed to initialize clip image model%s\n", FLAG_mmproj, tip());
@@ -17,6 +17,7 @@
 
 #include "chatbot.h"
 
+#include <algorithm>
 #include <cctype>
 #include <csignal>
 #include <cstdio>
@@ -28,6 +29,7 @@
 #include "llamafile/color.h"
 #include "llamafile/highlight/highlight.h"
 #include "llamafile/llama.h"
+#include "llamafile/llamafile.h"
 
 namespace lf {
 namespace chatbot {
@@ -95,23 +97,37 @@ bool out_of_context(int extra) {
     return false;
 }
 
-void repl() {
-
-    // setup conversation
-    if (llama_should_add_bos_token(g_model)) {
-        print_ephemeral("loading bos token...");
-        eval_token(llama_token_bos(g_model));
+// restores bos token and system prompt from kv cache snapshot
+static bool load_warm_state(const std::vector<llama_token> &bos,
+                            const std::vector<llama_token> &prompt) {
+    std::vector<llama_token> tokens;
+    print_ephemeral("loading warm state...");
+    bool ok = llamafile_warm_state_load(g_ctx, FLAG_warm_state, &tokens);
+    clear_ephemeral();
+    if (!ok)
+        return false;
+    if (tokens.size() != bos.size() + prompt.size() ||
+        !std::equal(bos.begin(), bos.end(), tokens.begin()) ||
+        !std::equal(prompt.begin(), prompt.end(), tokens.begin() + bos.size())) {
+        // system prompt or chat template changed since it was saved
+        llama_kv_cache_seq_rm(g_ctx, 0, -1, -1);
+        return false;
     }
+    g_history = bos;
     record_undo();
+    g_history.insert(g_history.end(), prompt.begin(), prompt.end());
+    return true;
+}
+
+void repl() {
 
     // make base models have no system prompt by default
     if (is_base_model() && g_params.prompt == DEFAULT_SYSTEM_PROMPT)
         g_params.prompt = "";
 
-    // setup system prompt
+    // render system prompt
+    std::string msg;
     if (!g_params.prompt.empty()) {
-        print_ephemeral("loading system prompt...");
-        std::string msg;
         if (is_base_model()) {
             msg = g_params.prompt;
         } else {
@@ -119,15 +135,50 @@ void repl() {
             msg = llama_chat_apply_template(g_model, g_params.chat_template, chat,
                                             DONT_ADD_ASSISTANT);
         }
-        if (!eval_string(msg, DONT_ADD_SPECIAL, PARSE_SPECIAL))
-            exit(6);
-        llama_synchronize(g_ctx);
+    }
+    std::vector<llama_token> bos;
+    if (llama_should_add_bos_token(g_model))
+        bos.push_back(llama_token_bos(g_model));
+    // tokens are only needed as a key for the warm state snapshot
+    std::vector<llama_token> prompt = llamafile_tokenize(g_model, msg, DONT_ADD_SPECIAL, PARSE_SPECIAL);
+
+    // setup conversation
+    llamafile_startup_begin("system prompt");
+    if (!load_warm_state(bos, prompt)) {
+        if (!bos.empty()) {
+            print_ephemeral("loading bos token...");
+            eval_tokens(bos);
+        }
+        record_undo();
+
+        // setup system prompt
+        if (!msg.empty()) {
+            print_ephemeral("loading system prompt...");
+            if (!eval_string(msg, DONT_ADD_SPECIAL, PARSE_SPECIAL))
+                exit(6);
+            llama_synchronize(g_ctx);
+            clear_ephemeral();
+        }
+    }
+    llamafile_startup_end("system prompt");
+    llamafile_startup_report();
+    if (!g_params.prompt.empty()) {
         g_system_prompt_tokens = tokens_used();
-        clear_ephemeral();
         if (g_params.display_prompt)
             printf("%s\n", g_params.special ? msg.c_str() : g_params.prompt.c_str());
     }
 
+    // snapshot kv cache so it can be zipaligned into the llamafile
+    if (FLAG_save_warm_state) {
+        if (!llamafile_warm_state_save(g_ctx, FLAG_save_warm_state, g_history)) {
+            err("%s: failed to save warm state", FLAG_save_warm_state);
+            exit(1);
+        }
+        fprintf(stderr, "%s: saved %d tokens of warm state\n", FLAG_save_warm_state,
+                tokens_used());
+        exit(0);
+    }
+
     // perform important setup
     HighlightTxt txt;
     HighlightMarkdown markdown;
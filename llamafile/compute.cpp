@@ -23,6 +23,13 @@
 
 #include "llama.cpp/string.h"
 
+#ifndef AT_HWCAP2
+#define AT_HWCAP2 26
+#endif
+#ifndef HWCAP2_I8MM
+#define HWCAP2_I8MM (1 << 13)
+#endif
+
 #ifdef __x86_64__
 static void cpuid(unsigned leaf, unsigned subleaf, unsigned *info) {
     asm("movq\t%%rbx,%%rsi\n\t"
@@ -95,6 +102,8 @@ std::string llamafile_describe_cpu() {
         march += "+fp16";
     if (hwcap & HWCAP_ASIMDDP)
         march += "+dotprod";
+    if (getauxval(AT_HWCAP2) & HWCAP2_I8MM)
+        march += "+i8mm";
 #endif
 
     if (!march.empty()) {
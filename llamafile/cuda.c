@@ -960,7 +960,10 @@ TryNvidia:
 static void import_cuda(void) {
     if (llamafile_has_metal())
         return;
-    if (import_cuda_impl()) {
+    llamafile_startup_begin("cuda probe");
+    bool ok = import_cuda_impl();
+    llamafile_startup_end("cuda probe");
+    if (ok) {
         ggml_cuda.supported = true;
     } else if (FLAG_gpu == LLAMAFILE_GPU_AMD || FLAG_gpu == LLAMAFILE_GPU_NVIDIA) {
         tinyprint(2, "fatal error: support for --gpu ", llamafile_describe_gpu(),
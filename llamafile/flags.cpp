@@ -38,8 +38,10 @@
 
 bool FLAGS_READY = false;
 bool FLAG_ascii = false;
+bool FLAG_autotune = false;
 bool FLAG_completion_mode = false;
 bool FLAG_fast = false;
+bool FLAG_hugepages = false;
 bool FLAG_iq = false;
 bool FLAG_log_disable = false;
 bool FLAG_mlock = false;
@@ -49,6 +51,7 @@ bool FLAG_nocompile = false;
 bool FLAG_nologo = false;
 bool FLAG_precise = false;
 bool FLAG_recompile = false;
+bool FLAG_startup_report = false;
 bool FLAG_tinyblas = false;
 bool FLAG_trace = false;
 bool FLAG_unsecure = false;
@@ -63,12 +66,16 @@ const char *FLAG_listen = "127.0.0.1:8080";
 const char *FLAG_mmproj = nullptr;
 const char *FLAG_model = nullptr;
 const char *FLAG_prompt = nullptr;
+const char *FLAG_save_warm_state = nullptr;
+const char *FLAG_tensor_dedup = nullptr;
 const char *FLAG_url_prefix = "";
+const char *FLAG_warm_state = "/zip/warm.state";
 const char *FLAG_www_root = "/zip/www";
 double FLAG_token_rate = 1;
 float FLAG_decay_growth = .01;
 float FLAG_frequency_penalty = 0;
 float FLAG_presence_penalty = 0;
+float FLAG_ready_fraction = 0;
 float FLAG_reserve_tokens = .15;
 float FLAG_temperature = .8;
 float FLAG_top_p = .95;
@@ -82,6 +89,7 @@ int FLAG_http_obuf_size = 1024 * 1024;
 int FLAG_keepalive = 5;
 int FLAG_main_gpu = 0;
 int FLAG_n_gpu_layers = -1;
+int FLAG_prefetch = 0;
 int FLAG_slots = 1;
 int FLAG_split_mode = LLAMA_SPLIT_MODE_LAYER;
 int FLAG_threads = MIN(cpu_get_num_math(), 20);
@@ -92,9 +100,11 @@ int FLAG_ubatch = 512;
 int FLAG_verbose = 0;
 int FLAG_warmup = true;
 int FLAG_workers;
+size_t FLAG_memory_budget = 0;
 unsigned FLAG_seed = LLAMA_DEFAULT_SEED;
 
 std::vector<std::string> FLAG_headers;
+std::vector<std::string> FLAG_lora_adapters;
 
 static wontreturn void usage(int rc, int fd) {
     tinyprint(fd, "usage: ", program_invocation_name, " -m MODEL -l [HOST:]PORT\n", NULL);
@@ -204,6 +214,20 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--warm-state")) {
+            if (i == argc)
+                missing("--warm-state");
+            FLAG_warm_state = argv[i++];
+            continue;
+        }
+
+        if (!strcmp(flag, "--save-warm-state")) {
+            if (i == argc)
+                missing("--save-warm-state");
+            FLAG_save_warm_state = argv[i++];
+            continue;
+        }
+
         if (!strcmp(flag, "--db")) {
             if (i == argc)
                 missing("--db");
@@ -245,6 +269,24 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--prefetch")) {
+            if (i == argc)
+                missing("--prefetch");
+            FLAG_prefetch = atoi(argv[i++]);
+            if (FLAG_prefetch < 0)
+                error("--prefetch threads can't be negative");
+            continue;
+        }
+
+        if (!strcmp(flag, "--ready-fraction")) {
+            if (i == argc)
+                missing("--ready-fraction");
+            FLAG_ready_fraction = atof(argv[i++]);
+            if (!(0 <= FLAG_ready_fraction && FLAG_ready_fraction <= 1))
+                error("--ready-fraction must be on the interval [0,1]");
+            continue;
+        }
+
         if (!strcmp(flag, "--ip-header")) {
             if (i == argc)
                 missing("--ip-header");
@@ -332,6 +374,17 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--lora-adapter")) {
+            if (i == argc)
+                missing("--lora-adapter");
+            const char *spec = argv[i++];
+            const char *eq = strchr(spec, '=');
+            if (!eq || eq == spec || !eq[1])
+                error("invalid --lora-adapter (expect like NAME=PATH[@SCALE])");
+            FLAG_lora_adapters.push_back(spec);
+            continue;
+        }
+
         if (!strcmp(flag, "--http-ibuf-size")) {
             if (i == argc)
                 missing("--http-ibuf-size");
@@ -492,7 +545,54 @@ void llamafile_get_flags(int argc, char **argv) {
         if (!strcmp(flag, "-s") || !strcmp(flag, "--slots")) {
             if (i == argc)
                 missing("--slots");
-            FLAG_slots = atoi(argv[i++]);
+            const char *s = argv[i++];
+            if (!strcmp(s, "auto")) {
+                FLAG_slots = 0;
+            } else {
+                FLAG_slots = atoi(s);
+                if (FLAG_slots < 1)
+                    error("--slots INT must be at least 1");
+            }
+            continue;
+        }
+
+        if (!strcmp(flag, "--memory-budget")) {
+            if (i == argc)
+                missing("--memory-budget");
+            char *ep;
+            const char *s = argv[i++];
+            double x = strtod(s, &ep);
+            if (*ep == '%') {
+                if (!(0 < x && x <= 100))
+                    error("--memory-budget PERCENT must be between 0 and 100");
+                x = x / 100 * sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+            } else {
+                switch (*ep) {
+                    case 't':
+                    case 'T':
+                        x *= 1024;
+                        // fallthrough
+                    case 'g':
+                    case 'G':
+                        x *= 1024;
+                        // fallthrough
+                    case 'm':
+                    case 'M':
+                        x *= 1024;
+                        // fallthrough
+                    case 'k':
+                    case 'K':
+                        x *= 1024;
+                        // fallthrough
+                    case 0:
+                        break;
+                    default:
+                        bad("--memory-budget");
+                }
+            }
+            if (!(x >= 1))
+                bad("--memory-budget");
+            FLAG_memory_budget = x;
             continue;
         }
 
@@ -535,11 +635,21 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--startup-report")) {
+            FLAG_startup_report = true;
+            continue;
+        }
+
         if (!strcmp(flag, "--precise")) {
             FLAG_precise = true;
             continue;
         }
 
+        if (!strcmp(flag, "--autotune")) {
+            FLAG_autotune = true;
+            continue;
+        }
+
         if (!strcmp(flag, "--trap")) {
             FLAG_trap = true;
             FLAG_unsecure = true;
@@ -557,6 +667,18 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--hugepages")) {
+            FLAG_hugepages = true;
+            continue;
+        }
+
+        if (!strcmp(flag, "--tensor-dedup")) {
+            if (i == argc)
+                missing("--tensor-dedup");
+            FLAG_tensor_dedup = argv[i++];
+            continue;
+        }
+
         //////////////////////////////////////////////////////////////////////
         // gpu flags
 
@@ -643,6 +765,9 @@ void llamafile_get_flags(int argc, char **argv) {
     if (!FLAG_model)
         required("--model");
 
+    if (!FLAG_slots && !FLAG_memory_budget)
+        error("--slots auto requires --memory-budget");
+
     FLAGS_READY = true;
     FLAG_n_gpu_layers = llamafile_gpu_layers(FLAG_n_gpu_layers);
 }
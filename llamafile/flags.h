@@ -20,3 +20,4 @@
 #include <__fwd/vector.h>
 
 extern std::vector<std::string> FLAG_headers;
+extern std::vector<std::string> FLAG_lora_adapters;
@@ -0,0 +1,452 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//
+// kernel microbenchmark with roofline reporting
+//
+// this program sweeps the matrix shapes that transformer inference
+// actually runs, for each weight type and thread count, and reports
+// how close tinyBLAS, iqk_mul_mat(), and the ggml vec_dot kernels get
+// to the memory bandwidth and arithmetic peaks measured on startup.
+// the kernels are called directly rather than via llamafile_sgemm(),
+// which would otherwise hand most quantized matmuls over to iqk.
+//
+//     make -j o//llamafile/kernelbench
+//     o//llamafile/kernelbench -t 1,8 -n 1,128 -o bench.json
+//
+
+#include "compute.h"
+#include "json.h"
+#include "llama.cpp/ggml-quants.h"
+#include "llama.cpp/ggml.h"
+#include "llamafile.h"
+#include "micros.h"
+#include "numba.h"
+#include "sgemm.h"
+#include "version.h"
+
+#include <cosmo.h>
+#include <libc/sysv/consts/hwcap.h>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/auxv.h>
+#include <unistd.h>
+#include <vector>
+
+#define MIN_MICROS 200000
+#define MAX_ITERATIONS 100
+#define PROBE_BYTES (512l * 1024 * 1024)
+
+struct Shape {
+    const char *name;
+    long m; // rows of weights
+    long k; // cols of weights
+};
+
+// llama 3 8b
+static const Shape kShapes[] = {
+    {"attn_q", 4096, 4096},
+    {"attn_kv", 1024, 4096},
+    {"ffn_up", 14336, 4096},
+    {"ffn_down", 4096, 14336},
+};
+
+static const ggml_type kTypes[] = {
+    GGML_TYPE_F32,  GGML_TYPE_F16,  GGML_TYPE_BF16, GGML_TYPE_Q8_0,
+    GGML_TYPE_Q4_0, GGML_TYPE_Q4_K, GGML_TYPE_Q6_K,
+};
+
+struct Peak {
+    double gbps;
+    double gflops; // f32
+    double gops; // int8
+};
+
+static std::map<long, Peak> g_peaks;
+
+static wontreturn void usage(int rc) {
+    fprintf(rc ? stderr : stdout,
+            "usage: %s [-t THREADS,...] [-n TOKENS,...] [-T TYPE,...] [-o JSON]\n"
+            "\n"
+            "  -t   comma separated thread counts (default: 1,half,all)\n"
+            "  -n   comma separated batch sizes (default: 1,4,32,128,512)\n"
+            "  -T   comma separated weight types (default: f32,f16,bf16,q8_0,q4_0,q4_K,q6_K)\n"
+            "  -o   path of json report for regression tracking\n",
+            program_invocation_name);
+    exit(rc);
+}
+
+static std::vector<long> parse_list(const char *s) {
+    std::vector<long> res;
+    for (char *e; *s; s = *e ? e + 1 : e) {
+        long x = strtol(s, &e, 10);
+        if (e == s || x <= 0)
+            usage(1);
+        res.push_back(x);
+    }
+    return res;
+}
+
+static ggml_type parse_type(const std::string &s) {
+    for (int t = 0; t < GGML_TYPE_COUNT; ++t)
+        if (ggml_type_name((ggml_type)t) && s == ggml_type_name((ggml_type)t))
+            return (ggml_type)t;
+    fprintf(stderr, "%s: unknown type\n", s.c_str());
+    exit(1);
+}
+
+// returns type that tinyBLAS and iqk want activations converted into
+static ggml_type vec_dot_type(ggml_type type) {
+    switch (type) {
+    case GGML_TYPE_F32:
+    case GGML_TYPE_F16:
+    case GGML_TYPE_BF16:
+        return type;
+    case GGML_TYPE_Q8_0:
+    case GGML_TYPE_Q4_0:
+        return GGML_TYPE_Q8_0;
+    default:
+        return GGML_TYPE_Q8_K;
+    }
+}
+
+// converts rows of floats into the given type
+static void *convert(ggml_type type, const float *src, long rows, long cols) {
+    void *dst = memalign(4096, ggml_row_size(type, cols) * rows);
+    switch (type) {
+    case GGML_TYPE_F32:
+        memcpy(dst, src, sizeof(float) * rows * cols);
+        break;
+    case GGML_TYPE_F16:
+        ggml_fp32_to_fp16_row(src, (ggml_fp16_t *)dst, rows * cols);
+        break;
+    case GGML_TYPE_BF16:
+        ggml_fp32_to_bf16_row(src, (ggml_bf16_t *)dst, rows * cols);
+        break;
+    case GGML_TYPE_Q8_K:
+        for (long i = 0; i < rows; ++i)
+            quantize_row_q8_K(src + i * cols, (char *)dst + i * ggml_row_size(type, cols), cols);
+        break;
+    default:
+        ggml_quantize_chunk(type, src, dst, 0, rows, cols, nullptr);
+        break;
+    }
+    return dst;
+}
+
+// measures average wall time of `f` in microseconds
+template <typename F>
+static double measure(F &&f) {
+    if (!f())
+        return -1;
+    int iterations = 0;
+    long long start = micros();
+    long long took;
+    do {
+        f();
+        took = micros() - start;
+    } while (++iterations < MAX_ITERATIONS && took < MIN_MICROS);
+    return (double)took / iterations;
+}
+
+static bool run_tinyblas(long m, long n, long k, const void *A, const void *B, float *C, int Atype,
+                         int Btype, int nth) {
+    long blk = ggml_blck_size((ggml_type)Atype);
+    bool ok = true;
+#pragma omp parallel for num_threads(nth) reduction(& : ok)
+    for (int ith = 0; ith < nth; ++ith)
+        ok &= llamafile_tinyblas(m, n, k / blk, A, k / blk, B, k / blk, C, m, ith, nth, Atype,
+                                 Btype, GGML_TYPE_F32);
+    return ok;
+}
+
+static bool run_iqk(long m, long n, long k, const void *A, const void *B, float *C, int Atype,
+                    int nth) {
+    typeof(iqk_mul_mat) *iqk = nullptr;
+#ifdef __x86_64__
+    if (X86_HAVE(AVX512F) && X86_HAVE(AVX512VL) && X86_HAVE(AVX512BW) && X86_HAVE(AVX512DQ) &&
+        X86_HAVE(AVX512_VNNI))
+        iqk = iqk_mul_mat_zen4;
+    else if (X86_HAVE(AVX2) && X86_HAVE(FMA) && X86_HAVE(F16C))
+        iqk = iqk_mul_mat;
+#elif defined(__aarch64__)
+    if (getauxval(AT_HWCAP) & HWCAP_ASIMDDP)
+        iqk = iqk_mul_mat_arm82;
+#endif
+    if (!iqk)
+        return false;
+    bool ok = true;
+#pragma omp parallel for num_threads(nth) reduction(& : ok)
+    for (int ith = 0; ith < nth; ++ith)
+        ok &= iqk(m, n, k, Atype, A, B, C, m, ith, nth);
+    return ok;
+}
+
+// runs the generic ggml operation, including activation conversion,
+// with llamafile_sgemm() turned off so it falls back to vec_dot
+struct GgmlMatmul {
+    ggml_context *ctx = nullptr;
+    ggml_cgraph *graph = nullptr;
+    int nth;
+
+    GgmlMatmul(ggml_type type, long m, long n, long k, const void *A, const float *B, int nth)
+        : nth(nth) {
+        ggml_init_params params = {
+            .mem_size = ggml_row_size(type, k) * m + sizeof(float) * (k + m) * n * 3 +
+                        ggml_graph_overhead() + ggml_tensor_overhead() * 8 + (64 << 20),
+            .mem_buffer = nullptr,
+            .no_alloc = false,
+        };
+        if (!(ctx = ggml_init(params)))
+            return;
+        ggml_tensor *a = ggml_new_tensor_2d(ctx, type, k, m);
+        ggml_tensor *b = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, k, n);
+        memcpy(a->data, A, ggml_nbytes(a));
+        memcpy(b->data, B, ggml_nbytes(b));
+        graph = ggml_new_graph(ctx);
+        ggml_build_forward_expand(graph, ggml_mul_mat(ctx, a, b));
+    }
+
+    GgmlMatmul(const GgmlMatmul &) = delete;
+    GgmlMatmul &operator=(const GgmlMatmul &) = delete;
+
+    ~GgmlMatmul() {
+        if (ctx)
+            ggml_free(ctx);
+    }
+
+    bool operator()() {
+        if (!graph)
+            return false;
+        llamafile_sgemm_disable(true);
+        bool ok = ggml_graph_compute_with_ctx(ctx, graph, nth) == GGML_STATUS_SUCCESS;
+        llamafile_sgemm_disable(false);
+        return ok;
+    }
+};
+
+// measures read bandwidth of main memory
+static double probe_bandwidth(int nth) {
+    long words = PROBE_BYTES / sizeof(long);
+    long *p = (long *)memalign(4096, PROBE_BYTES);
+    for (long i = 0; i < words; ++i)
+        p[i] = i;
+    double best = 0;
+    for (int rep = 0; rep < 5; ++rep) {
+        long sum = 0;
+        long long start = micros();
+#pragma omp parallel for num_threads(nth) reduction(+ : sum)
+        for (long i = 0; i < words; ++i)
+            sum += p[i];
+        long long took = micros() - start;
+        __asm__ volatile("" ::"r"(sum));
+        best = MAX(best, PROBE_BYTES / 1e3 / MAX(took, 1));
+    }
+    free(p);
+    return best;
+}
+
+// measures arithmetic throughput of tinyBLAS on operands that fit in cache
+static double probe_flops(int nth) {
+    long n = 512;
+    std::vector<float> A(n * n);
+    std::vector<float> B(n * n);
+    std::vector<float> C(n * n);
+    randomize(A.data(), n * n);
+    randomize(B.data(), n * n);
+    double us = measure([&] {
+        return run_tinyblas(n, n, n, A.data(), B.data(), C.data(), GGML_TYPE_F32, GGML_TYPE_F32,
+                            nth);
+    });
+    return us > 0 ? 2. * n * n * n / 1e3 / us : 0;
+}
+
+// measures int8 dot product throughput on operands that fit in cache
+//
+// quantized weights are multiplied with integer instructions, whose
+// peak differs a lot from the f32 fma peak, so they get their own roof.
+// it's the best q8_0 result of tinyBLAS and iqk, so neither exceeds it.
+static double probe_ops(int nth) {
+    long n = 512;
+    std::vector<float> F(n * n);
+    std::vector<float> C(n * n);
+    randomize(F.data(), n * n);
+    void *A = convert(GGML_TYPE_Q8_0, F.data(), n, n);
+    randomize(F.data(), n * n);
+    void *B = convert(GGML_TYPE_Q8_0, F.data(), n, n);
+    double us = measure([&] {
+        return run_tinyblas(n, n, n, A, B, C.data(), GGML_TYPE_Q8_0, GGML_TYPE_Q8_0, nth);
+    });
+    double us2 = measure([&] { return run_iqk(n, n, n, A, B, C.data(), GGML_TYPE_Q8_0, nth); });
+    if (us2 > 0 && (us < 0 || us2 < us))
+        us = us2;
+    free(B);
+    free(A);
+    return us > 0 ? 2. * n * n * n / 1e3 / us : 0;
+}
+
+static bool is_quantized(ggml_type type) {
+    return type != GGML_TYPE_F32 && type != GGML_TYPE_F16 && type != GGML_TYPE_BF16;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    const char *json_path = nullptr;
+    int cpus = cpu_get_num_math();
+    std::vector<long> threads = {1};
+    std::vector<long> tokens = {1, 4, 32, 128, 512};
+    std::vector<ggml_type> types(kTypes, kTypes + sizeof(kTypes) / sizeof(*kTypes));
+    if (cpus / 2 > 1)
+        threads.push_back(cpus / 2);
+    if (cpus > 1)
+        threads.push_back(cpus);
+
+    FLAG_log_disable = true;
+    while ((opt = getopt(argc, argv, "ht:n:T:o:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = parse_list(optarg);
+            break;
+        case 'n':
+            tokens = parse_list(optarg);
+            break;
+        case 'T': {
+            types.clear();
+            std::string s = optarg;
+            for (size_t i = 0, j; i <= s.size(); i = j + 1) {
+                if ((j = s.find(',', i)) == std::string::npos)
+                    j = s.size();
+                types.push_back(parse_type(s.substr(i, j - i)));
+            }
+            break;
+        }
+        case 'o':
+            json_path = optarg;
+            break;
+        case 'h':
+            usage(0);
+        default:
+            usage(1);
+        }
+    }
+
+    ggml_time_init();
+    jt::Json report;
+    report["version"] = LLAMAFILE_VERSION_STRING;
+    report["cpu"] = llamafile_describe_cpu();
+    report["results"].setArray();
+    jt::Json &machine = report["peaks"];
+    machine.setArray();
+    for (long nth : threads) {
+        Peak &p = g_peaks[nth];
+        p.gbps = probe_bandwidth(nth);
+        p.gflops = probe_flops(nth);
+        p.gops = probe_ops(nth);
+        printf("%3ld threads: %8.1f GB/s memory bandwidth, %8.1f GFLOP/s f32 in cache, "
+               "%8.1f GOP/s int8 in cache\n", nth, p.gbps, p.gflops, p.gops);
+        jt::Json peak;
+        peak["threads"] = nth;
+        peak["gbps"] = p.gbps;
+        peak["gflops"] = p.gflops;
+        peak["gops"] = p.gops;
+        machine.getArray().push_back(std::move(peak));
+    }
+    printf("\n%-10s %-8s %-9s %6s %6s %6s %4s %10s %9s %8s %9s\n", "kernel", "type", "shape", "m",
+           "n", "k", "thr", "us", "GFLOP/s", "GB/s", "roofline");
+
+    for (ggml_type type : types) {
+        ggml_type btype = vec_dot_type(type);
+        for (const Shape &shape : kShapes) {
+            long m = shape.m;
+            long k = shape.k;
+            if (k % ggml_blck_size(type) || k % ggml_blck_size(btype))
+                continue;
+            std::vector<float> F(m * k);
+            randomize(F.data(), m * k);
+            void *A = convert(type, F.data(), m, k);
+            for (long n : tokens) {
+                std::vector<float> G(k * n);
+                std::vector<float> C(m * n);
+                randomize(G.data(), k * n);
+                void *B = convert(btype, G.data(), n, k);
+                for (long nth : threads) {
+                    const Peak &peak = g_peaks[nth];
+                    double roof = is_quantized(type) ? peak.gops : peak.gflops;
+                    struct {
+                        const char *name;
+                        double us;
+                    } runs[] = {
+                        {"tinyblas", measure([&] {
+                             return run_tinyblas(m, n, k, A, B, C.data(), type, btype, nth);
+                         })},
+                        {"iqk", measure([&] {
+                             return run_iqk(m, n, k, A, B, C.data(), type, nth);
+                         })},
+                        {"vec_dot", measure(GgmlMatmul(type, m, n, k, A, G.data(), nth))},
+                    };
+                    for (auto &run : runs) {
+                        if (run.us < 0)
+                            continue;
+                        double flops = 2. * m * n * k;
+                        double bytes = ggml_row_size(type, k) * m + //
+                                       ggml_row_size(btype, k) * n + //
+                                       sizeof(float) * m * n;
+                        double gflops = flops / 1e3 / run.us;
+                        double gbps = bytes / 1e3 / run.us;
+                        double bound = MIN(roof, flops / bytes * peak.gbps);
+                        double roofline = bound > 0 ? gflops / bound : 0;
+                        printf("%-10s %-8s %-9s %6ld %6ld %6ld %4ld %10.1f %9.1f %8.1f %8.1f%%\n",
+                               run.name, ggml_type_name(type), shape.name, m, n, k, nth, run.us,
+                               gflops, gbps, roofline * 100);
+                        jt::Json res;
+                        res["kernel"] = run.name;
+                        res["type"] = ggml_type_name(type);
+                        res["shape"] = shape.name;
+                        res["m"] = m;
+                        res["n"] = n;
+                        res["k"] = k;
+                        res["threads"] = nth;
+                        res["us"] = run.us;
+                        res["gflops"] = gflops;
+                        res["gbps"] = gbps;
+                        res["peak_gflops"] = roof;
+                        res["peak_gbps"] = peak.gbps;
+                        res["roofline"] = roofline;
+                        report["results"].getArray().push_back(std::move(res));
+                    }
+                }
+                free(B);
+            }
+            free(A);
+        }
+    }
+
+    if (json_path) {
+        FILE *f;
+        if (!(f = fopen(json_path, "w"))) {
+            perror(json_path);
+            return 1;
+        }
+        fputs(report.toStringPretty().c_str(), f);
+        fputc('\n', f);
+        fclose(f);
+    }
+    return 0;
+}
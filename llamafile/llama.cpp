@@ -19,6 +19,7 @@
 #include "llama.cpp/llama.h"
 #include <cassert>
 #include <string>
+#include <unistd.h>
 #include <vector>
 
 int llamafile_token_eot(llama_model *model) {
@@ -61,3 +62,29 @@ std::vector<llama_token> llamafile_tokenize(const struct llama_model *model,
     }
     return result;
 }
+
+// loads prefilled system prompt into sequence zero of kv cache
+//
+// a "warm state" is a llama.cpp sequence state file holding the tokens
+// of the system prompt along with their kv cache. zipalign it into the
+// llamafile as warm.state and startup won't need to prefill the prompt.
+// it can be made by running the chatbot with --save-warm-state. loading
+// fails if the file was made for a different model or kv cache layout.
+bool llamafile_warm_state_load(llama_context *ctx, const char *path, std::vector<llama_token> *tokens) {
+    if (!path || !*path || access(path, R_OK))
+        return false;
+    size_t count = 0;
+    tokens->resize(llama_n_ctx(ctx));
+    if (!llama_state_seq_load_file(ctx, path, 0, tokens->data(), tokens->size(), &count)) {
+        llama_kv_cache_seq_rm(ctx, 0, -1, -1);
+        tokens->clear();
+        return false;
+    }
+    tokens->resize(count);
+    return true;
+}
+
+bool llamafile_warm_state_save(llama_context *ctx, const char *path,
+                               const std::vector<llama_token> &tokens) {
+    return llama_state_seq_save_file(ctx, path, 0, tokens.data(), tokens.size()) > 0;
+}
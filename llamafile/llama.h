@@ -44,3 +44,6 @@ int llamafile_token_eot(llama_model *);
 
 std::string llamafile_token_to_piece(const llama_context *, int, bool);
 std::vector<int> llamafile_tokenize(const llama_model *, const std::string_view &, bool, bool);
+
+bool llamafile_warm_state_load(llama_context *, const char *, std::vector<int> *);
+bool llamafile_warm_state_save(llama_context *, const char *, const std::vector<int> &);
@@ -58,133 +58,44 @@ struct llamafile {
     atomic_int refs;
 };
 
-static struct llamafile *llamafile_open_zip(const char *prog, const char *fname, const char *mode) {
-    int fd = -1;
-    uint8_t *bufdata = NULL;
-    size_t cdirsize = 0;
-    uint8_t *cdirdata = NULL;
-    struct llamafile *file = NULL;
-
-    if (!(file = calloc(1, sizeof(struct llamafile))))
-        return 0;
-    strlcpy(file->fname, prog, PATH_MAX);
+static struct llamafile *llamafile_open_zip_impl(const char *prog, const char *fname,
+                                                 const char *mode) {
+    struct llamafile *file;
+    struct llamafile_zip *zip;
+    const struct llamafile_zip_entry *entry;
 
     // try opening from this executable's zip store
-    if ((fd = open(prog, O_RDONLY | O_CLOEXEC)) == -1) {
-        free(file);
+    // its central directory only gets parsed the first time it's used
+    if (!(zip = llamafile_zip_index(prog)))
         return 0;
-    }
-    ssize_t rc;
-    if ((rc = lseek(fd, 0, SEEK_END)) == -1)
-        goto Failure;
-    file->size = rc;
-
-    // read the last 64kb of file
-    // the zip file format magic can be anywhere in there
-    int amt;
-    uint64_t off;
-    if (file->size <= 65536) {
-        off = 0;
-        amt = file->size;
-    } else {
-        off = file->size - 65536;
-        amt = file->size - off;
-    }
-    if (!(bufdata = gc(malloc(65536))))
-        goto Failure;
-    if (pread(fd, bufdata, amt, off) != amt) {
-        fprintf(stderr, "%s: warning: failed to read last 64kb of file: %s\n", prog,
-                strerror(errno));
-        goto Failure;
-    }
-
-    // search backwards for the end-of-central-directory record
-    // the eocd (cdir) says where the central directory (cfile) array is located
-    // we consistency check some legacy fields, to be extra sure that it is eocd
-    unsigned cnt = 0;
-    for (int i = amt - Min(kZipCdirHdrMinSize, kZipCdir64LocatorSize); i >= 0; --i) {
-        uint32_t magic = ZIP_READ32(bufdata + i);
-        if (magic == kZipCdir64LocatorMagic && i + kZipCdir64LocatorSize <= amt &&
-            pread(fd, bufdata, kZipCdir64HdrMinSize, ZIP_LOCATE64_OFFSET(bufdata + i)) ==
-                (long)kZipCdir64HdrMinSize &&
-            ZIP_READ32(bufdata) == kZipCdir64HdrMagic &&
-            ZIP_CDIR64_RECORDS(bufdata) == ZIP_CDIR64_RECORDSONDISK(bufdata) &&
-            ZIP_CDIR64_RECORDS(bufdata) && ZIP_CDIR64_SIZE(bufdata) <= INT_MAX) {
-            cnt = ZIP_CDIR64_RECORDS(bufdata);
-            off = ZIP_CDIR64_OFFSET(bufdata);
-            amt = ZIP_CDIR64_SIZE(bufdata);
-            break;
-        }
-        if (magic == kZipCdirHdrMagic && i + kZipCdirHdrMinSize <= amt &&
-            ZIP_CDIR_RECORDS(bufdata + i) == ZIP_CDIR_RECORDSONDISK(bufdata + i) &&
-            ZIP_CDIR_RECORDS(bufdata + i) && ZIP_CDIR_SIZE(bufdata + i) <= INT_MAX &&
-            ZIP_CDIR_OFFSET(bufdata + i) != 0xffffffffu) {
-            cnt = ZIP_CDIR_RECORDS(bufdata + i);
-            off = ZIP_CDIR_OFFSET(bufdata + i);
-            amt = ZIP_CDIR_SIZE(bufdata + i);
-            break;
-        }
-    }
-    if (cnt <= 0) {
-        // this executable isn't a zip file
-        fprintf(stderr, "%s: warning: not a pkzip archive\n", prog);
-        goto Invalid;
-    }
-
-    // read the central directory
-    cdirsize = amt;
-    if (!(cdirdata = gc(malloc(cdirsize))))
-        goto Failure;
-    if (pread(fd, cdirdata, cdirsize, off) != (long)cdirsize) {
-        fprintf(stderr, "%s: warning: failed to pread zip cdir: %s\n", prog, strerror(errno));
-        goto Failure;
-    }
-    if (ZIP_READ32(cdirdata) != kZipCfileHdrMagic) {
-        fprintf(stderr, "%s: warning: failed to locate zip central directory\n", prog);
-        goto Invalid;
-    }
 
     // look for filename in the directory
-    int found = 0;
-    char *zip_name = 0;
-    unsigned cdir_offset;
-    int fname_len = fname ? strlen(fname) : 0;
-    unsigned entry_index, entry_offset;
-    for (entry_index = entry_offset = 0;
-         entry_index < cnt && entry_offset + kZipCfileHdrMinSize <= cdirsize &&
-         entry_offset + ZIP_CFILE_HDRSIZE(cdirdata + entry_offset) <= cdirsize;
-         ++entry_index, entry_offset += ZIP_CFILE_HDRSIZE(cdirdata + entry_offset)) {
-        if (ZIP_CFILE_MAGIC(cdirdata + entry_offset) != kZipCfileHdrMagic) {
-            fprintf(stderr, "error: corrupted zip central directory entry magic: %s\n", prog);
-            errno = EINVAL;
-            goto Failure;
-        }
-        int entry_name_len = ZIP_CFILE_NAMESIZE(cdirdata + entry_offset);
-        const char *entry_name_bytes = ZIP_CFILE_NAME(cdirdata + entry_offset);
-        if ((fname ? (fname_len == entry_name_len && !memcmp(fname, entry_name_bytes, fname_len))
-                   : (entry_name_len > 5 &&
-                      !memcasecmp(entry_name_bytes + entry_name_len - 5, ".gguf", 5)))) {
-            zip_name = gc(strndup(entry_name_bytes, entry_name_len));
-            off = get_zip_cfile_offset(cdirdata + entry_offset);
-            file->size = get_zip_cfile_compressed_size(cdirdata + entry_offset);
-            cdir_offset = entry_offset;
-            ++found;
-        }
+    int found;
+    if (fname) {
+        entry = llamafile_zip_find(zip, fname, strlen(fname));
+        found = entry ? entry->count : 0;
+    } else {
+        entry = llamafile_zip_find_gguf(zip, &found);
     }
     if (!found) {
         fprintf(stderr, "%s: error: no %s file found in zip archive\n", prog,
                 fname ? fname : ".gguf");
-        goto Invalid;
+        errno = EINVAL;
+        return 0;
     }
     if (found != 1) {
         // TODO: Support opening LLaVA llamafiles.
         fprintf(stderr, "%s: error: multiple %s files found in zip archive\n", prog,
                 fname ? fname : ".gguf");
-        goto Invalid;
+        errno = EINVAL;
+        return 0;
     }
-    strlcat(file->fname, "@", PATH_MAX);
-    strlcat(file->fname, zip_name, PATH_MAX);
-    if (ZIP_CFILE_COMPRESSIONMETHOD(cdirdata + cdir_offset) != kZipCompressionNone) {
+
+    if (!(file = calloc(1, sizeof(struct llamafile))))
+        return 0;
+    snprintf(file->fname, PATH_MAX, "%s@%.*s", prog, (int)entry->namelen, entry->name);
+    file->size = entry->size;
+    if (entry->method != kZipCompressionNone) {
         fprintf(
             stderr,
             "%s: error: weights stored in the zip executable can't be stored using compression\n",
@@ -194,16 +105,14 @@ static struct llamafile *llamafile_open_zip(const char *prog, const char *fname,
 
     // read the zip local file header
     // this is needed to determine offset of file content
-    uint8_t lfile[kZipLfileHdrMinSize];
-    if (pread(fd, lfile, kZipLfileHdrMinSize, off) != kZipLfileHdrMinSize) {
-        fprintf(stderr, "%s: error: failed to pread lfile\n", file->fname);
+    int64_t off;
+    if ((off = llamafile_zip_offset(zip, entry)) == -1) {
+        if (errno == EINVAL)
+            fprintf(stderr, "%s: error: corrupted zip local file magic\n", file->fname);
+        else
+            fprintf(stderr, "%s: error: failed to pread lfile\n", file->fname);
         goto Failure;
     }
-    if (ZIP_LFILE_MAGIC(lfile) != kZipLfileHdrMagic) {
-        fprintf(stderr, "%s: error: corrupted zip local file magic\n", file->fname);
-        goto Invalid;
-    }
-    off += ZIP_LFILE_HDRSIZE(lfile);
 
     // perform sanity check
     // mapping weights for apple metal gpu requires 16kb alignment
@@ -212,6 +121,7 @@ static struct llamafile *llamafile_open_zip(const char *prog, const char *fname,
                 file->fname);
 
     // map the file into memory
+    int fd = llamafile_zip_fd(zip);
     long pagesz = sysconf(_SC_GRANSIZE);
     off_t mapoff = off & -pagesz;
     long skew = off - mapoff;
@@ -227,22 +137,33 @@ static struct llamafile *llamafile_open_zip(const char *prog, const char *fname,
         fprintf(stderr, "%s: warning: posix_fadvise(.., POSIX_FADV_SEQUENTIAL) failed: %s\n",
                 file->fname, strerror(err));
 
+    // ask linux to fault weights in as 2mb pages, since tlb misses on
+    // 4kb pages are a measurable share of decode time on large models.
+    if (FLAG_hugepages && IsLinux() && madvise(file->mapping, file->mapsize, MADV_HUGEPAGE))
+        fprintf(stderr, "%s: warning: madvise(.., MADV_HUGEPAGE) failed: %s\n", file->fname,
+                strerror(errno));
+
     // setup our synthetic file
     file->position = 0;
     file->content = (char *)file->mapping + skew;
 
     // return object
-    close(fd);
     return file;
 
 Invalid:
     errno = EINVAL;
 Failure:
     free(file);
-    close(fd);
     return 0;
 }
 
+static struct llamafile *llamafile_open_zip(const char *prog, const char *fname, const char *mode) {
+    llamafile_startup_begin("open zip");
+    struct llamafile *file = llamafile_open_zip_impl(prog, fname, mode);
+    llamafile_startup_end("open zip");
+    return file;
+}
+
 static struct llamafile *llamafile_open_file(const char *fname, const char *mode) {
     struct llamafile *file;
     if (!(file = calloc(1, sizeof(struct llamafile))))
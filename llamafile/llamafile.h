@@ -1,6 +1,7 @@
 #ifndef LLAMAFILE_H_
 #define LLAMAFILE_H_
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #ifdef __cplusplus
 extern "C" {
@@ -8,8 +9,10 @@ extern "C" {
 
 extern bool FLAGS_READY;
 extern bool FLAG_ascii;
+extern bool FLAG_autotune;
 extern bool FLAG_completion_mode;
 extern bool FLAG_fast;
+extern bool FLAG_hugepages;
 extern bool FLAG_iq;
 extern bool FLAG_log_disable;
 extern bool FLAG_mlock;
@@ -19,6 +22,7 @@ extern bool FLAG_nocompile;
 extern bool FLAG_nologo;
 extern bool FLAG_precise;
 extern bool FLAG_recompile;
+extern bool FLAG_startup_report;
 extern bool FLAG_tinyblas;
 extern bool FLAG_trace;
 extern bool FLAG_trap;
@@ -33,12 +37,16 @@ extern const char *FLAG_listen;
 extern const char *FLAG_mmproj;
 extern const char *FLAG_model;
 extern const char *FLAG_prompt;
+extern const char *FLAG_save_warm_state;
+extern const char *FLAG_tensor_dedup;
 extern const char *FLAG_url_prefix;
+extern const char *FLAG_warm_state;
 extern const char *FLAG_www_root;
 extern double FLAG_token_rate;
 extern float FLAG_decay_growth;
 extern float FLAG_frequency_penalty;
 extern float FLAG_presence_penalty;
+extern float FLAG_ready_fraction;
 extern float FLAG_reserve_tokens;
 extern float FLAG_temperature;
 extern float FLAG_top_p;
@@ -53,6 +61,7 @@ extern int FLAG_http_obuf_size;
 extern int FLAG_keepalive;
 extern int FLAG_main_gpu;
 extern int FLAG_n_gpu_layers;
+extern int FLAG_prefetch;
 extern int FLAG_slots;
 extern int FLAG_split_mode;
 extern int FLAG_threads;
@@ -63,6 +72,7 @@ extern int FLAG_ubatch;
 extern int FLAG_verbose;
 extern int FLAG_warmup;
 extern int FLAG_workers;
+extern size_t FLAG_memory_budget;
 extern unsigned FLAG_seed;
 
 struct llamafile;
@@ -79,6 +89,22 @@ bool llamafile_eof(struct llamafile *file);
 FILE *llamafile_fp(struct llamafile *);
 void llamafile_ref(struct llamafile *);
 void llamafile_unref(struct llamafile *);
+
+struct llamafile_zip;
+struct llamafile_zip_entry {
+    const char *name; // not nul terminated
+    size_t namelen;
+    int method; // kZipCompressionNone or kZipCompressionDeflate
+    int count; // number of entries in archive having this name
+    int64_t lfile; // offset of local file header
+    int64_t size; // compressed size
+    int64_t uncompressed_size;
+};
+struct llamafile_zip *llamafile_zip_index(const char *);
+int llamafile_zip_fd(struct llamafile_zip *);
+const struct llamafile_zip_entry *llamafile_zip_find(struct llamafile_zip *, const char *, size_t);
+const struct llamafile_zip_entry *llamafile_zip_find_gguf(struct llamafile_zip *, int *);
+int64_t llamafile_zip_offset(struct llamafile_zip *, const struct llamafile_zip_entry *);
 char *llamafile_get_prompt(void);
 
 void llamafile_govern(void);
@@ -90,6 +116,9 @@ bool llamafile_has(char **, const char *);
 bool llamafile_extract(const char *, const char *);
 int llamafile_is_file_newer_than(const char *, const char *);
 void llamafile_schlep(const void *, size_t);
+void llamafile_startup_begin(const char *);
+void llamafile_startup_end(const char *);
+void llamafile_startup_report(void);
 void llamafile_get_app_dir(char *, size_t);
 void llamafile_launch_browser(const char *);
 void llamafile_get_flags(int, char **);
@@ -268,7 +268,10 @@ static bool ImportMetalImpl(void) {
 }
 
 static void ImportMetal(void) {
-    if (ImportMetalImpl()) {
+    llamafile_startup_begin("metal probe");
+    bool ok = ImportMetalImpl();
+    llamafile_startup_end("metal probe");
+    if (ok) {
         ggml_metal.supported = true;
         tinylog("Apple Metal GPU support successfully loaded\n", NULL);
     } else if (FLAG_gpu == LLAMAFILE_GPU_APPLE) {
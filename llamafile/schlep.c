@@ -16,6 +16,7 @@
 // limitations under the License.
 
 #include "llama.cpp/ggml.h"
+#include "llamafile/llamafile.h"
 #include "llamafile/log.h"
 #include <cosmo.h>
 #include <errno.h>
@@ -89,6 +90,7 @@ void llamafile_schlep(const void *data, size_t size) {
 
     // launch threads
     errno_t err;
+    llamafile_startup_begin("warmup");
     atomic_long faults = 0;
     long pagesz = getpagesize();
     long stride = size / THREADS;
@@ -123,4 +125,5 @@ void llamafile_schlep(const void *data, size_t size) {
     // wait for workers
     for (int i = 0; i < THREADS; ++i)
         pthread_join(pf[i].th, 0);
+    llamafile_startup_end("warmup");
 }
@@ -0,0 +1,113 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "adapters.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/flags.h"
+#include "llamafile/server/client.h"
+#include "llamafile/server/log.h"
+#include <cstdlib>
+#include <string>
+
+namespace lf {
+namespace server {
+
+static std::vector<Adapter> g_adapters;
+
+// loads every --lora-adapter NAME=PATH[@SCALE] against the base model
+//
+// adapters are tiny compared to the model they're applied to, so they
+// are all kept resident and the slots switch between them per request
+bool
+adapters_load(llama_model* model)
+{
+    for (const std::string& spec : FLAG_lora_adapters) {
+        Adapter adapter;
+        size_t eq = spec.find('=');
+        adapter.name = spec.substr(0, eq);
+        adapter.path = spec.substr(eq + 1);
+        adapter.scale = 1;
+        // paths may contain '@' too, so it's only a scale if it's a number
+        size_t at = adapter.path.rfind('@');
+        if (at != std::string::npos && at + 1 < adapter.path.size()) {
+            char* end;
+            const char* s = adapter.path.c_str() + at + 1;
+            float scale = strtof(s, &end);
+            if (!*end) {
+                adapter.scale = scale;
+                adapter.path.resize(at);
+            }
+        }
+        if (adapter_find(adapter.name)) {
+            SLOG("%s: duplicate lora adapter name", adapter.name.c_str());
+            return false;
+        }
+        if (!(adapter.lora =
+                llama_adapter_lora_init(model, adapter.path.c_str()))) {
+            SLOG("%s: failed to load lora adapter", adapter.path.c_str());
+            return false;
+        }
+        SLOG("loaded lora adapter %s from %s with scale %g",
+             adapter.name.c_str(),
+             adapter.path.c_str(),
+             adapter.scale);
+        g_adapters.emplace_back(std::move(adapter));
+    }
+    return true;
+}
+
+void
+adapters_free()
+{
+    for (Adapter& adapter : g_adapters)
+        llama_adapter_lora_free(adapter.lora);
+    g_adapters.clear();
+}
+
+const std::vector<Adapter>&
+adapters()
+{
+    return g_adapters;
+}
+
+const Adapter*
+adapter_find(std::string_view name)
+{
+    for (const Adapter& adapter : g_adapters)
+        if (adapter.name == name)
+            return &adapter;
+    return nullptr;
+}
+
+// chooses lora adapter for request
+//
+// the X-Lora-Adapter header takes precedence and must name an adapter
+// that was loaded. otherwise the openai model field is consulted, but a
+// model name that isn't an adapter alias just means the base model, as
+// clients will often send whatever model name they were configured for
+bool
+Client::get_adapter(const std::string& model, const Adapter** out)
+{
+    std::string_view name = get_header("X-Lora-Adapter");
+    if (!name.empty())
+        return (*out = adapter_find(name)) != nullptr;
+    *out = adapter_find(model);
+    return true;
+}
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,51 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct llama_model;
+struct llama_adapter_lora;
+
+namespace lf {
+namespace server {
+
+// lora adapter that requests may select by model name or header
+struct Adapter
+{
+    std::string name;
+    std::string path;
+    float scale;
+    llama_adapter_lora* lora;
+};
+
+bool
+adapters_load(llama_model*);
+
+void
+adapters_free();
+
+const std::vector<Adapter>&
+adapters();
+
+const Adapter*
+adapter_find(std::string_view);
+
+} // namespace server
+} // namespace lf
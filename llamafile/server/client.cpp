@@ -655,6 +655,38 @@ Client::dispatch()
     return res;
 }
 
+// looks up static asset in the zip index of our executable, so stored
+// files under /zip/ can be served without being opened and scanned for
+bool
+Client::find_zip_asset(int* fd, int64_t* base, size_t* size)
+{
+    if (!startswith(resolved_.c_str(), "/zip/"))
+        return false;
+    llamafile_zip* zip;
+    if (!(zip = llamafile_zip_index(GetProgramExecutableName())))
+        return false;
+    std::string name = resolved_.substr(5);
+    const llamafile_zip_entry* e;
+    if (name.empty() || name.back() == '/' ||
+        !(e = llamafile_zip_find(zip, name.data(), name.size())) ||
+        (e->namelen && e->name[e->namelen - 1] == '/')) {
+        // directory, e.g. `GET /`, so serve its index instead
+        name = resolve(name, "index.html");
+        if (!(e = llamafile_zip_find(zip, name.data(), name.size())))
+            return false;
+    }
+    if (e->method)
+        return false; // deflated, so let the zip filesystem inflate it
+    int64_t off;
+    if ((off = llamafile_zip_offset(zip, e)) == -1)
+        return false;
+    resolved_ = "/zip/" + name;
+    *fd = llamafile_zip_fd(zip);
+    *base = off;
+    *size = e->size;
+    return true;
+}
+
 bool
 Client::dispatcher()
 {
@@ -705,6 +737,8 @@ Client::dispatcher()
         return slotz();
     if (p1 == "flagz")
         return flagz();
+    if (p1 == "readyz")
+        return readyz();
 
 #if 0
     // TODO: implement frontend for database
@@ -730,40 +764,43 @@ Client::dispatcher()
     // serve static endpoints
     int infd;
     size_t size;
+    int64_t base = 0;
     resolved_ = resolve(FLAG_www_root, p1);
-    for (;;) {
-        infd = open(resolved_.c_str(), O_RDONLY);
-        if (infd == -1) {
-            if (errno == ENOENT || errno == ENOTDIR) {
-                SLOG("path not found: %s", resolved_.c_str());
-                return send_error(404);
-            } else if (errno == EPERM || errno == EACCES) {
-                SLOG("path not authorized: %s", resolved_.c_str());
-                return send_error(401);
-            } else {
+    if (!find_zip_asset(&infd, &base, &size)) {
+        for (;;) {
+            infd = open(resolved_.c_str(), O_RDONLY);
+            if (infd == -1) {
+                if (errno == ENOENT || errno == ENOTDIR) {
+                    SLOG("path not found: %s", resolved_.c_str());
+                    return send_error(404);
+                } else if (errno == EPERM || errno == EACCES) {
+                    SLOG("path not authorized: %s", resolved_.c_str());
+                    return send_error(401);
+                } else {
+                    SLOG("%s: %s", strerror(errno), resolved_.c_str());
+                    return send_error(500);
+                }
+            }
+            struct stat st;
+            if (fstat(infd, &st)) {
                 SLOG("%s: %s", strerror(errno), resolved_.c_str());
+                ::close(infd);
+                return send_error(500);
+            }
+            size = st.st_size;
+            if (S_ISREG(st.st_mode)) {
+                break;
+            } else if (S_ISDIR(st.st_mode)) {
+                ::close(infd);
+                resolved_ = resolve(resolved_, "index.html");
+            } else {
+                ::close(infd);
+                SLOG("won't serve special file: %s", resolved_.c_str());
                 return send_error(500);
             }
         }
-        struct stat st;
-        if (fstat(infd, &st)) {
-            SLOG("%s: %s", strerror(errno), resolved_.c_str());
-            ::close(infd);
-            return send_error(500);
-        }
-        size = st.st_size;
-        if (S_ISREG(st.st_mode)) {
-            break;
-        } else if (S_ISDIR(st.st_mode)) {
-            ::close(infd);
-            resolved_ = resolve(resolved_, "index.html");
-        } else {
-            ::close(infd);
-            SLOG("won't serve special file: %s", resolved_.c_str());
-            return send_error(500);
-        }
+        defer_cleanup(cleanup_fildes, (void*)(intptr_t)infd);
     }
-    defer_cleanup(cleanup_fildes, (void*)(intptr_t)infd);
     char* p = append_http_response_message(obuf_.p, 200, "OK");
     p = stpcpy(p, "Content-Type: ");
     p = stpcpy(p, pick_content_type(resolved_));
@@ -781,7 +818,7 @@ Client::dispatcher()
         chunk = size - i;
         if (chunk > sizeof(buf))
             chunk = sizeof(buf);
-        ssize_t got = pread(infd, buf, chunk, i);
+        ssize_t got = pread(infd, buf, chunk, base + i);
         if (got == -1) {
             SLOG("static asset pread failed: %s", strerror(errno));
             close_connection_ = true;
@@ -39,6 +39,7 @@ struct llama_model;
 namespace lf {
 namespace server {
 
+struct Adapter;
 struct Cleanup;
 struct Slot;
 struct Worker;
@@ -97,6 +98,7 @@ struct Client
     char* append_header(const std::string_view, const std::string_view);
     bool has_at_most_this_element(int, const std::string_view);
     std::string_view get_header(const std::string_view&);
+    bool get_adapter(const std::string&, const Adapter**) __wur;
     bool fun() __wur;
 
     std::string_view path();
@@ -104,6 +106,7 @@ struct Client
 
     bool dispatch() __wur;
     bool dispatcher() __wur;
+    bool find_zip_asset(int*, int64_t*, size_t*) __wur;
 
     bool tokenize() __wur;
     bool get_tokenize_params(TokenizeParams*) __wur;
@@ -121,6 +124,7 @@ struct Client
 
     bool slotz() __wur;
     bool flagz() __wur;
+    bool readyz() __wur;
     bool db_chat(int64_t) __wur;
     bool db_chats() __wur;
     bool db_message(int64_t) __wur;
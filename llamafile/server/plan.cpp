@@ -0,0 +1,226 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "plan.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/server/adapters.h"
+#include "llamafile/server/log.h"
+#include <algorithm>
+#include <cosmo.h>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+
+// estimates memory needed by slots before any context gets created
+//
+// every slot is its own llama_context, with a kv cache, compute buffer
+// and logits buffer of its own, whereas the weights and lora adapters
+// are loaded once and shared. the kv cache is estimated from the gguf
+// hyperparameters as if every layer had full multi-head attention over
+// the padded context, so models with sliding window layers or latent
+// attention (mla) get an upper bound. the compute buffer is estimated
+// from the largest tensors live at once in the worst case graph, which
+// is what the ggml allocator reserves. none of this is exact, since the
+// backends add alignment and scratch of their own.
+
+namespace lf {
+namespace server {
+
+// reads integer hyperparameter of model architecture
+//
+// some architectures store per-layer arrays, e.g. "[8, 8, 16]", in which
+// case the largest element is returned, since that's what sizes buffers
+static long
+get_hparam(llama_model* model, const char* name, long dflt)
+{
+    char arch[64];
+    char key[128];
+    char val[4096];
+    if (llama_model_meta_val_str(model, "general.architecture", arch, sizeof(arch)) < 0)
+        return dflt;
+    snprintf(key, sizeof(key), "%s.%s", arch, name);
+    if (llama_model_meta_val_str(model, key, val, sizeof(val)) < 0)
+        return dflt;
+    long res = -1;
+    for (char* p = val; *p;) {
+        char* ep;
+        long x = strtol(p, &ep, 10);
+        if (ep == p) {
+            ++p;
+        } else {
+            res = std::max(res, x);
+            p = ep;
+        }
+    }
+    return res >= 0 ? res : dflt;
+}
+
+static size_t
+get_file_size(const char* path)
+{
+    struct stat st;
+    if (!path || stat(path, &st))
+        return 0;
+    return st.st_size;
+}
+
+static int
+get_ctx_size(llama_model* model, int ctx_size)
+{
+    int n_ctx_train = llama_n_ctx_train(model);
+    if (ctx_size <= 0 || ctx_size > n_ctx_train)
+        return n_ctx_train;
+    return ctx_size;
+}
+
+static const char*
+format_bytes(char buf[32], size_t bytes)
+{
+    if (bytes >= 1024 * 1024 * 1024)
+        snprintf(buf, 32, "%.2f GiB", bytes / (1024. * 1024 * 1024));
+    else if (bytes >= 1024 * 1024)
+        snprintf(buf, 32, "%.2f MiB", bytes / (1024. * 1024));
+    else
+        snprintf(buf, 32, "%.2f KiB", bytes / 1024.);
+    return buf;
+}
+
+size_t
+Plan::shared_bytes() const
+{
+    return weights + adapters;
+}
+
+size_t
+Plan::slot_bytes() const
+{
+    return kv_cache + compute + output + mmproj;
+}
+
+size_t
+Plan::total() const
+{
+    return shared_bytes() + slots * slot_bytes();
+}
+
+Plan
+plan_memory(llama_model* model, int ctx_size, int slots)
+{
+    const size_t f16 = 2;
+    const size_t f32 = 4;
+    long n_vocab = llama_n_vocab(model);
+    long n_embd = get_hparam(model, "embedding_length", llama_n_embd(model));
+    long n_layer = get_hparam(model, "block_count", 0);
+    long n_head = get_hparam(model, "attention.head_count", 0);
+    long n_head_kv = get_hparam(model, "attention.head_count_kv", n_head);
+    long n_ff = get_hparam(model, "feed_forward_length", 4 * n_embd);
+    long n_embd_head = n_head ? n_embd / n_head : 0;
+    long n_embd_k_gqa =
+      get_hparam(model, "attention.key_length", n_embd_head) * n_head_kv;
+    long n_embd_v_gqa =
+      get_hparam(model, "attention.value_length", n_embd_head) * n_head_kv;
+
+    // mirror how llama.cpp clamps the batch sizes of a context
+    long n_ctx = get_ctx_size(model, ctx_size);
+    long n_batch = std::min<long>(FLAG_batch, n_ctx);
+    long n_ubatch = std::min<long>(FLAG_ubatch, n_batch);
+
+    Plan plan = {};
+    plan.slots = slots;
+    plan.ctx_size = n_ctx;
+    plan.weights = llama_model_size(model);
+    plan.mmproj = get_file_size(FLAG_mmproj);
+    for (const Adapter& adapter : adapters())
+        plan.adapters += get_file_size(adapter.path.c_str());
+
+    // keys and values are stored as f16 for every position of every layer
+    // and llama.cpp rounds the number of kv cells up to a multiple of 256
+    long n_kv = (n_ctx + 255) & -256;
+    plan.kv_cache = n_kv * n_layer * (n_embd_k_gqa + n_embd_v_gqa) * f16;
+
+    // the allocator reuses memory between layers, so the buffer is sized
+    // by whichever stage of the graph peaks, plus the residual stream
+    size_t attn = n_ubatch * (n_embd + n_embd_k_gqa + n_embd_v_gqa) * f32;
+    if (FLAG_flash_attn)
+        attn += n_ubatch * n_embd * f32;
+    else
+        attn += n_ctx * n_ubatch * n_head * f32; // kq scores
+    size_t ffn = n_ubatch * n_ff * 2 * f32;
+    size_t logits = n_ubatch * n_vocab * f32;
+    plan.compute = std::max({ attn, ffn, logits }) + n_ubatch * n_embd * 3 * f32;
+
+    // only the last token's logits are kept for sampling
+    plan.output = (n_vocab + n_embd) * f32;
+
+    return plan;
+}
+
+// chooses the largest slots × ctx_size that fits inside memory budget
+//
+// the ctx size passed by the user is the most any slot will get, and is
+// halved until slots fit. the same goes for the number of slots, unless
+// it's zero, in which case as many are made as there are cpu cores.
+bool
+plan_fit(llama_model* model, size_t budget, Plan* out)
+{
+    int max_slots = FLAG_slots > 0 ? FLAG_slots : __get_cpu_count();
+    int ctx_size = get_ctx_size(model, FLAG_ctx_size);
+    long best = 0;
+    for (;;) {
+        Plan plan = plan_memory(model, ctx_size, 1);
+        if (plan.shared_bytes() < budget) {
+            size_t n = (budget - plan.shared_bytes()) / plan.slot_bytes();
+            plan.slots = std::min<size_t>(n, max_slots);
+            if (plan.slots && (long)plan.slots * plan.ctx_size > best) {
+                best = (long)plan.slots * plan.ctx_size;
+                *out = plan;
+            }
+        }
+        if (ctx_size <= 512)
+            break;
+        ctx_size = std::max(ctx_size / 2, 512);
+    }
+    if (!best)
+        *out = plan_memory(model, 512, 1);
+    return best > 0;
+}
+
+void
+plan_print(const Plan& plan, size_t budget)
+{
+    char b[6][32];
+    SLOG("memory plan: %d slots × %d ctx_size = %s of %s budget",
+         plan.slots,
+         plan.ctx_size,
+         format_bytes(b[0], plan.total()),
+         format_bytes(b[1], budget));
+    SLOG("memory plan: %s weights + %s adapters + %d × %s per slot",
+         format_bytes(b[0], plan.weights),
+         format_bytes(b[2], plan.adapters),
+         plan.slots,
+         format_bytes(b[1], plan.slot_bytes()));
+    SLOG("memory plan: each slot has %s kv cache + %s compute + %s output"
+         " + %s mmproj",
+         format_bytes(b[2], plan.kv_cache),
+         format_bytes(b[3], plan.compute),
+         format_bytes(b[4], plan.output),
+         format_bytes(b[5], plan.mmproj));
+}
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,53 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <cstddef>
+
+struct llama_model;
+
+namespace lf {
+namespace server {
+
+// memory footprint of serving a model with some number of slots
+struct Plan
+{
+    int slots;
+    int ctx_size;
+    size_t weights; // shared by all slots
+    size_t adapters; // shared by all slots
+    size_t kv_cache; // per slot
+    size_t compute; // per slot
+    size_t output; // per slot
+    size_t mmproj; // per slot
+
+    size_t shared_bytes() const;
+    size_t slot_bytes() const;
+    size_t total() const;
+};
+
+Plan
+plan_memory(llama_model*, int ctx_size, int slots);
+
+bool
+plan_fit(llama_model*, size_t budget, Plan*);
+
+void
+plan_print(const Plan&, size_t budget);
+
+} // namespace server
+} // namespace lf
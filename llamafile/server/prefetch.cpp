@@ -0,0 +1,180 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "prefetch.h"
+#include "llama.cpp/ggml-backend.h"
+#include "llama.cpp/ggml.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/server/log.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cosmo.h>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+// faults weights into memory from background threads
+//
+// the weights of a freshly started server are paged in lazily by the
+// first requests, which makes first token latency awful after deploys.
+// these threads walk tensors in layer order, since that's the order a
+// forward pass wants them, and read one byte per page so the kernel has
+// to make them resident. multiple threads keep the disk queue full.
+
+#define PREFETCH_CHUNK (2 * 1024 * 1024)
+
+namespace lf {
+namespace server {
+
+struct Extent
+{
+    const char* data;
+    size_t size;
+    int layer;
+};
+
+static std::vector<Extent> g_extents;
+static std::vector<pthread_t> g_threads;
+static std::atomic_size_t g_next;
+static std::atomic_size_t g_loaded;
+static std::atomic_bool g_cancel;
+static size_t g_total;
+static timespec g_started;
+
+// puts the token embeddings first and the output tensors last
+static int
+get_layer(const char* name)
+{
+    if (!strncmp(name, "blk.", 4))
+        return atoi(name + 4);
+    if (!strncmp(name, "token_embd.", 11))
+        return -1;
+    return INT_MAX;
+}
+
+static void*
+prefetch_worker(void* arg)
+{
+    long pagesz = getpagesize();
+    set_thread_name("prefetch");
+    for (;;) {
+        size_t i = g_next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= g_extents.size())
+            break;
+        const Extent& e = g_extents[i];
+        for (size_t off = 0; off < e.size && !g_cancel; off += PREFETCH_CHUNK) {
+            size_t len = std::min(e.size - off, (size_t)PREFETCH_CHUNK);
+            const char* p = e.data + off;
+            const char* page = (const char*)((uintptr_t)p & -pagesz);
+            madvise((void*)page, p + len - page, MADV_WILLNEED);
+            for (const char* q = page; q < p + len; q += pagesz)
+                (void)*(const volatile char*)std::max(q, p);
+            g_loaded.fetch_add(len, std::memory_order_relaxed);
+        }
+    }
+    return 0;
+}
+
+void
+prefetch_start(llama_model* model, int threads)
+{
+    gguf_init_params params = {
+        .no_alloc = true,
+        .ctx = nullptr,
+    };
+    gguf_context* gguf;
+    if (!(gguf = gguf_init_from_file(FLAG_model, params))) {
+        SLOG("prefetch: failed to read tensor list of %s", FLAG_model);
+        return;
+    }
+    for (int i = 0; i < gguf_get_n_tensors(gguf); ++i) {
+        const char* name = gguf_get_tensor_name(gguf, i);
+        ggml_tensor* t = llama_get_model_tensor(model, name);
+        if (!t || !t->data || !t->buffer || !ggml_backend_buffer_is_host(t->buffer))
+            continue; // e.g. offloaded to gpu
+        g_extents.push_back({ (const char*)t->data, ggml_nbytes(t), get_layer(name) });
+        g_total += ggml_nbytes(t);
+    }
+    gguf_free(gguf);
+    std::stable_sort(
+      g_extents.begin(), g_extents.end(), [](const Extent& a, const Extent& b) {
+          return a.layer < b.layer;
+      });
+    g_started = timespec_real();
+    for (int i = 0; i < threads; ++i) {
+        errno_t err;
+        pthread_t th;
+        if ((err = pthread_create(&th, 0, prefetch_worker, 0))) {
+            SLOG("prefetch: pthread_create failed: %s", strerror(err));
+            break;
+        }
+        g_threads.push_back(th);
+    }
+    SLOG("prefetching %zu MB of weights with %zu threads",
+         g_total / 1024 / 1024,
+         g_threads.size());
+}
+
+double
+prefetch_progress()
+{
+    if (g_threads.empty() || !g_total)
+        return 1;
+    return (double)g_loaded.load(std::memory_order_relaxed) / g_total;
+}
+
+// returns true if enough weights are resident to take traffic
+bool
+prefetch_ready()
+{
+    return prefetch_progress() >= (FLAG_ready_fraction > 0 ? FLAG_ready_fraction : 1);
+}
+
+// blocks until given fraction of weights are resident
+void
+prefetch_wait(double fraction)
+{
+    double progress;
+    while ((progress = prefetch_progress()) < std::min(fraction, 1.)) {
+        SLOG("waiting for weights to load %.0f%% of %.0f%%",
+             progress * 100,
+             fraction * 100);
+        usleep(1000000);
+    }
+    SLOG("%.0f%% of weights resident after %.3f seconds",
+         progress * 100,
+         timespec_tonanos(timespec_sub(timespec_real(), g_started)) * 1e-9);
+}
+
+void
+prefetch_stop()
+{
+    g_cancel = true;
+    for (pthread_t th : g_threads)
+        pthread_join(th, 0);
+    g_threads.clear();
+    g_extents.clear();
+}
+
+} // namespace server
+} // namespace lf
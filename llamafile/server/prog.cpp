@@ -18,7 +18,10 @@
 #include "llama.cpp/llama.h"
 #include "llamafile/llamafile.h"
 #include "llamafile/pool.h"
+#include "llamafile/server/adapters.h"
 #include "llamafile/server/log.h"
+#include "llamafile/server/plan.h"
+#include "llamafile/server/prefetch.h"
 #include "llamafile/server/server.h"
 #include "llamafile/server/signals.h"
 #include "llamafile/server/slots.h"
@@ -78,23 +81,52 @@ main(int argc, char* argv[])
         .progress_callback = nullptr,
         .progress_callback_user_data = nullptr,
         .kv_overrides = nullptr,
+        .tensor_dedup_dir = FLAG_tensor_dedup,
         .vocab_only = false,
         .use_mmap = true,
         .use_mlock = false,
         .check_tensors = false,
+        .use_hugepages = FLAG_hugepages,
     };
+    llamafile_startup_begin("load model");
     llama_model* model = llama_load_model_from_file(FLAG_model, mparams);
+    llamafile_startup_end("load model");
     if (!model) {
         fprintf(stderr, "%s: failed to load model\n", FLAG_model);
         exit(1);
     }
 
+    // load lora adapters that requests may choose between
+    if (!adapters_load(model))
+        exit(1);
+
+    // choose slots and context size that fit in the memory budget
+    if (FLAG_memory_budget) {
+        Plan plan;
+        bool ok = plan_fit(model, FLAG_memory_budget, &plan);
+        plan_print(plan, FLAG_memory_budget);
+        if (!ok) {
+            SLOG("a single slot won't fit in --memory-budget");
+            exit(1);
+        }
+        FLAG_slots = plan.slots;
+        FLAG_ctx_size = plan.ctx_size;
+    }
+
+    // fault weights in from background threads
+    if (FLAG_ready_fraction > 0 && !FLAG_prefetch)
+        FLAG_prefetch = 8;
+    if (FLAG_prefetch)
+        prefetch_start(model, FLAG_prefetch);
+
     // create slots
+    llamafile_startup_begin("create slots");
     Slots* slots = new Slots(model);
     if (!slots->start(FLAG_slots)) {
         SLOG("no slots could be created");
         exit(1);
     }
+    llamafile_startup_end("create slots");
 
     // create server
     if (FLAG_workers <= 0)
@@ -102,10 +134,16 @@ main(int argc, char* argv[])
     if (FLAG_workers <= 0)
         FLAG_workers = 16;
     set_thread_name("server");
+    if (FLAG_ready_fraction > 0) {
+        llamafile_startup_begin("prefetch wait");
+        prefetch_wait(FLAG_ready_fraction);
+        llamafile_startup_end("prefetch wait");
+    }
     g_server =
       new Server(create_listening_socket(FLAG_listen, 0, 0), slots, model);
     for (int i = 0; i < FLAG_workers; ++i)
         npassert(!g_server->spawn());
+    llamafile_startup_report();
 
     // run server
     signals_init();
@@ -120,6 +158,8 @@ main(int argc, char* argv[])
     g_server->close();
     delete g_server;
     delete slots;
+    adapters_free();
+    prefetch_stop();
     llama_free_model(model);
     tokenbucket_destroy();
     time_destroy();
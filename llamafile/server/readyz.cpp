@@ -0,0 +1,42 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "client.h"
+#include "llamafile/json.h"
+#include "llamafile/server/prefetch.h"
+
+namespace lf {
+namespace server {
+
+// reports whether weights are resident enough to serve traffic, so
+// load balancers can hold off on routing requests to a cold server.
+bool
+Client::readyz()
+{
+    jt::Json json;
+    bool ready = prefetch_ready();
+    json["ready"] = ready;
+    json["resident"] = prefetch_progress();
+    dump_ = json.toStringPretty();
+    dump_ += '\n';
+    char* p = append_http_response_message(obuf_.p, ready ? 200 : 503);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, dump_);
+}
+
+} // namespace server
+} // namespace lf
@@ -22,6 +22,7 @@
 #include "llamafile/llama.h"
 #include "llamafile/llamafile.h"
 #include "llamafile/macros.h"
+#include "llamafile/server/adapters.h"
 #include "llamafile/server/atom.h"
 #include "llamafile/server/image.h"
 #include "llamafile/server/log.h"
@@ -128,6 +129,15 @@ Slot::start()
     if (FLAG_mmproj)
         if (!(clip_ctx_ = clip_model_load(FLAG_mmproj, FLAG_verbose)))
             return false;
+
+    // restore system prompt prefill that was packaged in the llamafile
+    // so prefill() only needs to evaluate what follows it in requests
+    std::vector<int> tokens;
+    if (llamafile_warm_state_load(ctx_, FLAG_warm_state, &tokens)) {
+        for (int token : tokens)
+            history_.emplace_back(token);
+        SLOG("loaded %zu tokens of warm state", tokens.size());
+    }
     return true;
 }
 
@@ -287,6 +297,25 @@ Slot::eval_atoms(const std::vector<Atom>& atoms,
     return token_count;
 }
 
+void
+Slot::use_adapter(const Adapter* adapter)
+{
+    if (adapter == adapter_)
+        return;
+    if (ctx_) {
+        llama_clear_adapter_lora(ctx_);
+        if (adapter)
+            llama_set_adapter_lora(ctx_, adapter->lora, adapter->scale);
+        // cached keys and values were computed with the other weights
+        llama_kv_cache_clear(ctx_);
+        history_.clear();
+    }
+    adapter_ = adapter;
+    SLOG("slot #%d switched to %s",
+         id_,
+         adapter ? adapter->name.c_str() : "base model");
+}
+
 int
 Slot::prefill(const std::vector<Atom>& atoms, const ProgressCallback& progress)
 {
@@ -33,6 +33,7 @@ namespace server {
 
 using ProgressCallback = std::function<void(int processed, int total)>;
 
+struct Adapter;
 struct Atom;
 struct Image;
 
@@ -56,6 +57,7 @@ struct Slot
     llama_model* model_;
     clip_ctx* clip_ctx_ = nullptr;
     llama_context* ctx_ = nullptr;
+    const Adapter* adapter_ = nullptr;
     std::vector<Atom> history_;
     std::string system_fingerprint_;
 
@@ -64,6 +66,7 @@ struct Slot
     int ctx_size() const;
     int ctx_used() const;
     bool start();
+    void use_adapter(const Adapter*);
     int eval_token(int);
     int eval_tokens(const std::vector<int>&, const ProgressCallback& = nullptr);
     int eval_image(const std::string_view&, const ProgressCallback& = nullptr);
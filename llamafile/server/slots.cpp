@@ -73,7 +73,7 @@ Slots::start(int count)
 }
 
 Slot*
-Slots::take(const std::vector<Atom>& atoms)
+Slots::take(const std::vector<Atom>& atoms, const Adapter* adapter)
 {
     pthread_mutex_lock(&lock_);
     for (;;) {
@@ -90,13 +90,19 @@ Slots::take(const std::vector<Atom>& atoms)
             double decay =
               age + exp(FLAG_decay_growth * (age - FLAG_decay_delay));
 
+            // a different lora adapter would invalidate the whole cache,
+            // so requests for the same adapter gravitate to the same slots
+            bool same_adapter = SLOT(e)->adapter_ == adapter;
+
             // common prefix length is good
-            int cpl = vector_common_prefix_length(SLOT(e)->history_, atoms);
+            int cpl = 0;
+            if (same_adapter)
+                cpl = vector_common_prefix_length(SLOT(e)->history_, atoms);
 
             // common suffix length is good
             int csl = 0;
             int size = SLOT(e)->history_.size();
-            for (int i = cpl + 1; i < size; ++i) {
+            for (int i = cpl + 1; same_adapter && i < size; ++i) {
                 if (size - i > atoms.size() - cpl)
                     continue;
                 if (std::equal(SLOT(e)->history_.begin() + i,
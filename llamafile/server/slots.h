@@ -26,6 +26,7 @@ struct Dll;
 namespace lf {
 namespace server {
 
+struct Adapter;
 class Atom;
 class SlotEntry;
 struct Slot;
@@ -46,7 +47,7 @@ struct Slots
     size_t size();
     int start(int);
     void tokenize(std::vector<Atom>*, std::string_view, bool);
-    Slot* take(const std::vector<Atom>&);
+    Slot* take(const std::vector<Atom>&, const Adapter* = nullptr);
     void give(Slot*);
 };
 
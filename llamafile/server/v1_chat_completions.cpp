@@ -527,6 +527,11 @@ Client::v1_chat_completions()
     V1ChatCompletionResponse* response = new V1ChatCompletionResponse;
     defer_cleanup(cleanup_response, response);
 
+    // select lora adapter
+    const Adapter* adapter;
+    if (!get_adapter(params->model, &adapter))
+        return send_error(400, "unknown lora adapter");
+
     // turn prompt into atom array that'll fit in context window
     for (;;) {
         // add bos token if it's needed
@@ -543,8 +548,9 @@ Client::v1_chat_completions()
 
         // acquire best slot
         if (!slot_) {
-            slot_ = worker_->server_->slots_->take(state->atoms);
+            slot_ = worker_->server_->slots_->take(state->atoms, adapter);
             defer_cleanup(cleanup_slot, this);
+            slot_->use_adapter(adapter);
         }
 
         // check if image uploading is supported
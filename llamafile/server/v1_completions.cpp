@@ -426,9 +426,15 @@ Client::v1_completions()
     // we don't support multiple images yet
     state->atoms = remove_old_image_atoms(state->atoms);
 
+    // select lora adapter
+    const Adapter* adapter;
+    if (!get_adapter(params->model, &adapter))
+        return send_error(400, "unknown lora adapter");
+
     // find appropriate slot
-    slot_ = worker_->server_->slots_->take(state->atoms);
+    slot_ = worker_->server_->slots_->take(state->atoms, adapter);
     defer_cleanup(cleanup_slot, this);
+    slot_->use_adapter(adapter);
 
     // init sampling
     llama_sampling_context* sampler = create_sampler(params);
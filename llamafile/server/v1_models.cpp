@@ -19,6 +19,7 @@
 #include "llama.cpp/llama.h"
 #include "llamafile/json.h"
 #include "llamafile/llamafile.h"
+#include "llamafile/server/adapters.h"
 #include "llamafile/string.h"
 #include <ctime>
 
@@ -35,11 +36,20 @@ Client::v1_models()
 {
     jt::Json json;
     json["object"] = "list";
+    std::string id = stripext(basename(FLAG_model));
     Json& model = json["data"][0];
-    model["id"] = stripext(basename(FLAG_model));
+    model["id"] = id;
     model["object"] = "model";
     model["created"] = model_creation_time;
     model["owned_by"] = "llamafile";
+    for (size_t i = 0; i < adapters().size(); ++i) {
+        Json& lora = json["data"][i + 1];
+        lora["id"] = adapters()[i].name;
+        lora["object"] = "model";
+        lora["created"] = model_creation_time;
+        lora["owned_by"] = "llamafile";
+        lora["parent"] = id;
+    }
     char* p = append_http_response_message(obuf_.p, 200);
     p = stpcpy(p, "Content-Type: application/json\r\n");
     return send_response(obuf_.p, p, json.toString());
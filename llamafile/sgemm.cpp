@@ -16,15 +16,33 @@
 // limitations under the License.
 
 #include "sgemm.h"
+#include "compute.h"
+#include "llama.cpp/ggml.h"
 #include "llamafile.h"
+#include "log.h"
 #include <cassert>
 #include <cosmo.h>
 #include <cpuid.h>
 #include <libc/sysv/consts/hwcap.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
 #include <sys/auxv.h>
 
+#ifndef AT_HWCAP2
+#define AT_HWCAP2 26
+#endif
+#ifndef HWCAP2_I8MM
+#define HWCAP2_I8MM (1 << 13)
+#endif
+
+static void llamafile_sgemm_autotune(void);
+
 static const struct GemmFuncs {
     typeof(llamafile_sgemm) *sgemm;
+    typeof(llamafile_tinyblas) *tinyblas;
     typeof(llamafile_mixmul) *mixmul;
     typeof(llamafile_mixmul_iqk) *iqk_mixmul = iqk_mul_mat_moe_unsupported;
     GemmFuncs() {
@@ -40,23 +58,27 @@ static const struct GemmFuncs {
                             X86_HAVE(AVX512_BF16)) {
                             // AMD Zen4+ (2023-)
                             sgemm = llamafile_sgemm_amd_zen4;
+                            tinyblas = llamafile_tinyblas_amd_zen4;
                             mixmul = llamafile_mixmul_amd_zen4;
                             iqk_mixmul = iqk_mul_mat_moe_zen4;
                         } else {
                             // Intel Xeon Skylake+ (2015-)
                             sgemm = llamafile_sgemm_amd_avx512f;
+                            tinyblas = llamafile_tinyblas_amd_avx512f;
                             mixmul = llamafile_mixmul_amd_avx512f;
                             iqk_mixmul = iqk_mul_mat_moe;
                         }
                     } else if (X86_HAVE(AVXVNNI)) {
                         // Intel Alderlake (2021-)
                         sgemm = llamafile_sgemm_amd_avxvnni;
+                        tinyblas = llamafile_tinyblas_amd_avxvnni;
                         mixmul = llamafile_mixmul_amd_avxvnni;
                         iqk_mixmul = iqk_mul_mat_moe;
                     } else {
                         // Intel Haswell/Broadwell/Skylake (2013-2020)
                         // AMD Excavator (2015-2022)
                         sgemm = llamafile_sgemm_amd_avx2;
+                        tinyblas = llamafile_tinyblas_amd_avx2;
                         mixmul = llamafile_mixmul_amd_avx2;
                         if (X86_HAVE(F16C))
                             iqk_mixmul = iqk_mul_mat_moe;
@@ -64,6 +86,7 @@ static const struct GemmFuncs {
                 } else {
                     // AMD Piledriver (2011-2014)
                     sgemm = llamafile_sgemm_amd_fma;
+                    tinyblas = llamafile_tinyblas_amd_fma;
                     mixmul = llamafile_mixmul_amd_fma;
                     if (X86_HAVE(F16C))
                         iqk_mixmul = iqk_mul_mat_moe;
@@ -72,35 +95,62 @@ static const struct GemmFuncs {
                 // Intel Sandybridge/Ivybridge (2010-2012)
                 // AMD Bulldozer (2011)
                 sgemm = llamafile_sgemm_amd_avx;
+                tinyblas = llamafile_tinyblas_amd_avx;
                 mixmul = llamafile_mixmul_amd_avx;
             }
         } else {
             // AMD K8/Barcelona (2003-2010)
             // Intel Core/Nehalem (2006-2009)
             sgemm = llamafile_sgemm_unsupported;
+            tinyblas = llamafile_sgemm_unsupported;
             mixmul = llamafile_mixmul_unsupported;
         }
 #elif defined(__aarch64__)
         long hwcap = getauxval(AT_HWCAP);
+        long hwcap2 = getauxval(AT_HWCAP2);
         if ((hwcap & HWCAP_FPHP) && // fp16 scalar isa (ID_AA64PFR0_EL1.FP == 1)
             (hwcap & HWCAP_ASIMDHP) && // fp16 vector isa (ID_AA64PFR0_EL1.AdvSIMD == 1)
-            (hwcap & HWCAP_ASIMDDP)) { // dotprod isa (ID_AA64ISAR0_EL1.DP == 1)
+            (hwcap & HWCAP_ASIMDDP) && // dotprod isa (ID_AA64ISAR0_EL1.DP == 1)
+            (hwcap2 & HWCAP2_I8MM)) { // int8 matmul isa (ID_AA64ISAR1_EL1.I8MM == 1)
+            // e.g. Apple M2, AWS Graviton3, Neoverse V1/V2/N2
+            sgemm = llamafile_sgemm_arm86;
+            tinyblas = llamafile_tinyblas_arm86;
+            mixmul = llamafile_mixmul_arm86;
+            iqk_mixmul = iqk_mul_mat_moe_arm82;
+        } else if ((hwcap & HWCAP_FPHP) && // fp16 scalar isa (ID_AA64PFR0_EL1.FP == 1)
+                   (hwcap & HWCAP_ASIMDHP) && // fp16 vector isa (ID_AA64PFR0_EL1.AdvSIMD == 1)
+                   (hwcap & HWCAP_ASIMDDP)) { // dotprod isa (ID_AA64ISAR0_EL1.DP == 1)
             // e.g. Apple M1, Raspberry Pi 5
             sgemm = llamafile_sgemm_arm82;
+            tinyblas = llamafile_tinyblas_arm82;
             mixmul = llamafile_mixmul_arm82;
             iqk_mixmul = iqk_mul_mat_moe_arm82;
         } else {
             // ARM64 baseline ISA
             sgemm = llamafile_sgemm_arm80;
+            tinyblas = llamafile_tinyblas_arm80;
             mixmul = llamafile_mixmul_arm80;
         }
 #else
         sgemm = llamafile_sgemm_unsupported;
+        tinyblas = llamafile_sgemm_unsupported;
         mixmul = llamafile_mixmul_unsupported;
 #endif
     }
 } funcs;
 
+static bool g_sgemm_disabled;
+
+/**
+ * Makes llamafile_sgemm() decline every request while `disable` is set.
+ *
+ * GGML then falls back to its own vec_dot kernels, which is useful for
+ * benchmarking them against tinyBLAS and iqk in the same process.
+ */
+void llamafile_sgemm_disable(bool disable) {
+    __atomic_store_n(&g_sgemm_disabled, disable, __ATOMIC_RELAXED);
+}
+
 /**
  * Performs optimized matrix multiplication on CPU.
  *
@@ -127,9 +177,27 @@ static const struct GemmFuncs {
  */
 bool llamafile_sgemm(long m, long n, long k, const void *A, long lda, const void *B, long ldb,
                      void *C, long ldc, int ith, int nth, int Atype, int Btype, int Ctype) {
+    if (__atomic_load_n(&g_sgemm_disabled, __ATOMIC_RELAXED))
+        return false;
+    if (FLAG_autotune)
+        llamafile_sgemm_autotune();
     return funcs.sgemm(m, n, k, A, lda, B, ldb, C, ldc, ith, nth, Atype, Btype, Ctype);
 }
 
+/**
+ * Performs matrix multiplication on CPU using tinyBLAS kernels only.
+ *
+ * This is the same as llamafile_sgemm() except it never hands work to
+ * iqk_mul_mat(), which otherwise takes most quantized matmuls. It's
+ * useful for benchmarking tinyBLAS against the other kernels.
+ */
+bool llamafile_tinyblas(long m, long n, long k, const void *A, long lda, const void *B, long ldb,
+                        void *C, long ldc, int ith, int nth, int Atype, int Btype, int Ctype) {
+    if (FLAG_autotune)
+        llamafile_sgemm_autotune();
+    return funcs.tinyblas(m, n, k, A, lda, B, ldb, C, ldc, ith, nth, Atype, Btype, Ctype);
+}
+
 /**
  * Performs "mixture of experts" tensor multiplication on CPU.
  */
@@ -143,3 +211,224 @@ bool llamafile_mixmul_iqk(long Nx, long Ny, long ne00, int ne11, int typeA, cons
                           int ith, int nth) {
     return funcs.iqk_mixmul(Nx, Ny, ne00, ne11, typeA, A, B, C, nb1, nb2, vrow_mapping, ith, nth);
 }
+
+#define MAX_EXPERTS 512
+
+static long g_mixmul_calls;
+static long g_expert_tokens[MAX_EXPERTS];
+
+/**
+ * Records how many tokens were routed to each expert.
+ *
+ * This only does something when `--trace` is passed, in which case a
+ * per-expert utilization table is printed to stderr on exit, which is
+ * useful for understanding how skewed a mixture of experts model is.
+ */
+void llamafile_mixmul_tally(int experts, const long *counts) {
+    if (!FLAG_trace)
+        return;
+    __atomic_fetch_add(&g_mixmul_calls, 1, __ATOMIC_RELAXED);
+    for (int expert = 0; expert < experts && expert < MAX_EXPERTS; ++expert)
+        __atomic_fetch_add(&g_expert_tokens[expert], counts[expert], __ATOMIC_RELAXED);
+}
+
+__attribute__((__destructor__)) static void mixmul_report(void) {
+    long total = 0, hottest = 0;
+    int experts = 0;
+    if (!g_mixmul_calls)
+        return;
+    for (int expert = 0; expert < MAX_EXPERTS; ++expert)
+        if (g_expert_tokens[expert]) {
+            total += g_expert_tokens[expert];
+            hottest = MAX(hottest, g_expert_tokens[expert]);
+            experts = expert + 1;
+        }
+    fprintf(stderr, "mixmul: %ld calls routed %ld tokens to %d experts\n", g_mixmul_calls, total,
+            experts);
+    for (int expert = 0; expert < experts; ++expert)
+        fprintf(stderr, "mixmul: expert %3d %12ld tokens %6.2f%% utilization\n", expert,
+                g_expert_tokens[expert], 100. * g_expert_tokens[expert] / hottest);
+    fprintf(stderr, "mixmul: hottest expert got %.2fx its fair share\n",
+            (double)hottest * experts / total);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// TILE SHAPE AUTOTUNING
+
+#define TILE_VARIANTS 3
+#define TILE_N_BUCKETS 3
+#define TILE_K_BUCKETS 2
+
+static const int kTunedTypes[] = {
+    GGML_TYPE_F32, GGML_TYPE_F16, GGML_TYPE_BF16, GGML_TYPE_Q8_0, GGML_TYPE_Q4_0,
+};
+
+static int g_tile_forced = -1;
+static signed char g_tiles[GGML_TYPE_COUNT][TILE_N_BUCKETS][TILE_K_BUCKETS];
+
+static int tile_n_bucket(long n) {
+    if (n < 32)
+        return 0;
+    if (n < 256)
+        return 1;
+    return 2;
+}
+
+static int tile_k_bucket(long k) {
+    return k >= 1024;
+}
+
+/**
+ * Returns which tile shape variant tinyBLAS should use.
+ *
+ * Zero means the handwritten default for the microarchitecture. Other
+ * values are only returned when `--autotune` measured them to be faster
+ * on this CPU for a similar problem size.
+ *
+ * @param type is GGML data type of `A`
+ * @param m is rows in `A`
+ * @param n is cols in `B`
+ * @param k is number of scalar elements in each dot product
+ */
+int llamafile_sgemm_tile(int type, long m, long n, long k) {
+    if (g_tile_forced != -1)
+        return g_tile_forced;
+    if (type < 0 || type >= GGML_TYPE_COUNT)
+        return 0;
+    return g_tiles[type][tile_n_bucket(n)][tile_k_bucket(k)];
+}
+
+static std::string llamafile_sgemm_profile_path(void) {
+    char dir[PATH_MAX];
+    llamafile_get_app_dir(dir, sizeof(dir));
+    std::string name = llamafile_describe_cpu();
+    for (char &c : name)
+        if (!isalnum(c) && c != '-' && c != '.')
+            c = '_';
+    return std::string(dir) + "tinyblas/" + name + ".txt";
+}
+
+static bool llamafile_sgemm_load_profile(const std::string &path) {
+    FILE *f;
+    char line[128];
+    int type, nb, kb, tile;
+    if (!(f = fopen(path.c_str(), "r")))
+        return false;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "%d %d %d %d", &type, &nb, &kb, &tile) == 4 && //
+            0 <= type && type < GGML_TYPE_COUNT && //
+            0 <= nb && nb < TILE_N_BUCKETS && //
+            0 <= kb && kb < TILE_K_BUCKETS && //
+            0 <= tile && tile < TILE_VARIANTS)
+            g_tiles[type][nb][kb] = tile;
+    fclose(f);
+    return true;
+}
+
+static void llamafile_sgemm_save_profile(const std::string &path) {
+    FILE *f;
+    std::string dir = path.substr(0, path.rfind('/'));
+    makedirs(dir.c_str(), 0755);
+    std::string tmp = path + ".tmp";
+    if (!(f = fopen(tmp.c_str(), "w"))) {
+        perror(tmp.c_str());
+        return;
+    }
+    fprintf(f, "# tinyBLAS tile profile for %s\n", llamafile_describe_cpu().c_str());
+    fprintf(f, "# type n_bucket k_bucket variant\n");
+    for (int type : kTunedTypes)
+        for (int nb = 0; nb < TILE_N_BUCKETS; ++nb)
+            for (int kb = 0; kb < TILE_K_BUCKETS; ++kb)
+                fprintf(f, "%d %d %d %d\n", type, nb, kb, g_tiles[type][nb][kb]);
+    fclose(f);
+    rename(tmp.c_str(), path.c_str());
+}
+
+// returns best of several runs in nanoseconds, or -1 if unsupported
+//
+// this calls tinyBLAS directly, because the llamafile_sgemm() dispatcher
+// sends most quantized matmuls to iqk, whose speed doesn't depend on the
+// tile shapes being tuned here
+static long long llamafile_sgemm_time(long m, long n, long k, const void *A, long lda,
+                                      const void *B, long ldb, float *C, int Atype, int Btype) {
+    long long best = -1;
+    for (int i = 0; i < 4; ++i) {
+        struct timespec start = timespec_real();
+        if (!funcs.tinyblas(m, n, k, A, lda, B, ldb, C, m, 0, 1, Atype, Btype, GGML_TYPE_F32))
+            return -1;
+        long long took = timespec_tonanos(timespec_sub(timespec_real(), start));
+        if (i && (best == -1 || took < best)) // first run warms the cache
+            best = took;
+    }
+    return best;
+}
+
+static void llamafile_sgemm_tune(void) {
+    static const long kN[TILE_N_BUCKETS] = {16, 64, 256};
+    static const long kK[TILE_K_BUCKETS] = {512, 2048};
+    long m = 256;
+    long kmax = kK[TILE_K_BUCKETS - 1];
+    long nmax = kN[TILE_N_BUCKETS - 1];
+    char *A = (char *)memalign(4096, sizeof(float) * m * kmax);
+    char *B = (char *)memalign(4096, sizeof(float) * nmax * kmax);
+    float *C = (float *)memalign(4096, sizeof(float) * m * nmax);
+    if (!A || !B || !C) {
+        free(C);
+        free(B);
+        free(A);
+        return;
+    }
+    memset(A, 0x3c, sizeof(float) * m * kmax);
+    memset(B, 0x3c, sizeof(float) * nmax * kmax);
+    tinylog("tuning tinyBLAS tile shapes for this cpu...\n", NULL);
+    for (int Atype : kTunedTypes)
+        for (int nb = 0; nb < TILE_N_BUCKETS; ++nb)
+            for (int kb = 0; kb < TILE_K_BUCKETS; ++kb) {
+                int Btype;
+                long n = kN[nb];
+                long k = kK[kb] / ggml_blck_size((ggml_type)Atype);
+                long long took, best = -1;
+                for (int tile = 0; tile < TILE_VARIANTS; ++tile) {
+                    g_tile_forced = tile;
+                    Btype = Atype == GGML_TYPE_Q4_0 ? GGML_TYPE_Q8_0 : Atype;
+                    took = llamafile_sgemm_time(m, n, k, A, k, B, k, C, Atype, Btype);
+                    if (took == -1) {
+                        Btype = GGML_TYPE_F32;
+                        took = llamafile_sgemm_time(m, n, k, A, k, B, k, C, Atype, Btype);
+                    }
+                    if (took == -1)
+                        break;
+                    // only switch away from the default if it's clearly better
+                    if (!tile || took * 100 < best * 97) {
+                        best = took;
+                        g_tiles[Atype][nb][kb] = tile;
+                    }
+                }
+            }
+    g_tile_forced = -1;
+    free(C);
+    free(B);
+    free(A);
+}
+
+static void llamafile_sgemm_autotune_init(void) {
+    std::string path = llamafile_sgemm_profile_path();
+    if (llamafile_sgemm_load_profile(path))
+        return;
+    llamafile_sgemm_tune();
+    llamafile_sgemm_save_profile(path);
+    tinylog("saved tinyBLAS tile profile to ", path.c_str(), "\n", NULL);
+}
+
+/**
+ * Loads tile shapes that were measured to be fastest on this CPU.
+ *
+ * The first time this runs on a given microprocessor model, candidate
+ * tile shapes are benchmarked for each data type and problem size, and
+ * the winners are saved to ~/.llamafile/v/<version>/tinyblas/<cpu>.txt
+ * so that subsequent runs don't need to pay the tuning cost.
+ */
+static void llamafile_sgemm_autotune(void) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, llamafile_sgemm_autotune_init);
+}
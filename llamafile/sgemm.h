@@ -22,10 +22,15 @@ bool iqk_mul_mat_moe_unsupported(long, long, long, int, int, const void *, const
 
 bool llamafile_sgemm(long, long, long, const void *, long, const void *, long, void *, long, int,
                      int, int, int, int);
+bool llamafile_tinyblas(long, long, long, const void *, long, const void *, long, void *, long, int,
+                        int, int, int, int);
 bool llamafile_mixmul(const struct ggml_compute_params *, const struct ggml_tensor *,
                       const struct ggml_tensor *, const struct ggml_tensor *, struct ggml_tensor *);
 size_t llamafile_mixmul_needs(const struct ggml_tensor *, const struct ggml_tensor *,
                               const struct ggml_tensor *);
+void llamafile_mixmul_tally(int, const long *);
+int llamafile_sgemm_tile(int, long, long, long);
+void llamafile_sgemm_disable(bool);
 
 bool llamafile_sgemm_unsupported(long, long, long, const void *, long, const void *, long, void *,
                                  long, int, int, int, int, int);
@@ -45,6 +50,27 @@ bool llamafile_sgemm_arm80(long, long, long, const void *, long, const void *, l
                            int, int, int, int, int);
 bool llamafile_sgemm_arm82(long, long, long, const void *, long, const void *, long, void *, long,
                            int, int, int, int, int);
+bool llamafile_sgemm_arm86(long, long, long, const void *, long, const void *, long, void *, long,
+                           int, int, int, int, int);
+
+bool llamafile_tinyblas_amd_avx(long, long, long, const void *, long, const void *, long, void *,
+                                long, int, int, int, int, int);
+bool llamafile_tinyblas_amd_fma(long, long, long, const void *, long, const void *, long, void *,
+                                long, int, int, int, int, int);
+bool llamafile_tinyblas_amd_avx2(long, long, long, const void *, long, const void *, long, void *,
+                                 long, int, int, int, int, int);
+bool llamafile_tinyblas_amd_avxvnni(long, long, long, const void *, long, const void *, long,
+                                    void *, long, int, int, int, int, int);
+bool llamafile_tinyblas_amd_avx512f(long, long, long, const void *, long, const void *, long,
+                                    void *, long, int, int, int, int, int);
+bool llamafile_tinyblas_amd_zen4(long, long, long, const void *, long, const void *, long, void *,
+                                 long, int, int, int, int, int);
+bool llamafile_tinyblas_arm80(long, long, long, const void *, long, const void *, long, void *,
+                              long, int, int, int, int, int);
+bool llamafile_tinyblas_arm82(long, long, long, const void *, long, const void *, long, void *,
+                              long, int, int, int, int, int);
+bool llamafile_tinyblas_arm86(long, long, long, const void *, long, const void *, long, void *,
+                              long, int, int, int, int, int);
 
 bool llamafile_mixmul_unsupported(const struct ggml_compute_params *, const struct ggml_tensor *,
                                   const struct ggml_tensor *, const struct ggml_tensor *,
@@ -73,6 +99,9 @@ bool llamafile_mixmul_arm80(const struct ggml_compute_params *, const struct ggm
 bool llamafile_mixmul_arm82(const struct ggml_compute_params *, const struct ggml_tensor *,
                             const struct ggml_tensor *, const struct ggml_tensor *,
                             struct ggml_tensor *);
+bool llamafile_mixmul_arm86(const struct ggml_compute_params *, const struct ggml_tensor *,
+                            const struct ggml_tensor *, const struct ggml_tensor *,
+                            struct ggml_tensor *);
 bool llamafile_mixmul_iqk(long, long, long, int, int, const void *, const void *, float *, long,
                           long, const void *, int, int);
 
@@ -0,0 +1,195 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ansiblas.h"
+#include "bench.h"
+#include "debug.h"
+#include "float.h"
+#include "llama.cpp/ggml-quants.h"
+#include "llama.cpp/ggml.h"
+#include "macros.h"
+#include "micros.h"
+#include "numba.h"
+#include "sgemm.h"
+#include <cassert>
+#include <cmath>
+
+#define ITERATIONS 30
+#define ALLOC(n) (float *)memalign(4096, sizeof(float) * (n))
+
+void llamafile_sgemm_openmp(long m, long n, long k, const void *A, long lda, const void *B,
+                            long ldb, void *C, long ldc, int Atype, int Btype, int Ctype) {
+    static int nth = cpu_get_num_math();
+#pragma omp parallel for
+    for (int ith = 0; ith < nth; ++ith) {
+        bool res = llamafile_sgemm(m, n, k, A, lda, B, ldb, C, ldc, ith, nth, Atype, Btype, Ctype);
+        assert(res);
+    }
+}
+
+int test(int n) {
+    int m = 8192;
+    int k = 4099;
+    int lda = ROUNDUP(k, 16);
+    int ldb = ROUNDUP(k, 16);
+    int ldc = ROUNDUP(m, 16);
+    float *A = ALLOC(lda * m);
+    float *B = ALLOC(ldb * n);
+    float *C = ALLOC(ldc * n);
+    float *G = ALLOC(ldc * n);
+    broadcast(A, lda * m, NAN);
+    broadcast(B, ldb * n, NAN);
+    broadcast(C, ldc * n, NAN);
+    broadcast(G, ldc * n, NAN);
+    randomize(k, m, A, lda);
+    randomize(k, n, B, ldb);
+
+    BENCH(ansiBLAS::sgemm(m, n, k, A, lda, B, ldb, G, ldc));
+    BENCH(llamafile_sgemm_openmp(m, n, k, A, lda, B, ldb, C, ldc, GGML_TYPE_F32, GGML_TYPE_F32,
+                                 GGML_TYPE_F32));
+
+    long long start = micros();
+    for (int i = 0; i < ITERATIONS; ++i)
+        llamafile_sgemm_openmp(m, n, k, A, lda, B, ldb, C, ldc, GGML_TYPE_F32, GGML_TYPE_F32,
+                               GGML_TYPE_F32);
+    long long took = (micros() - start + ITERATIONS - 1) / ITERATIONS;
+    fprintf(stderr, "%12g GB/s weight streaming (n=%d)\n",
+            (double)sizeof(float) * lda * m / 1e3 / (took ? took : 1), n);
+
+    double err_sum = 0;
+    long long err_worst = 0;
+    for (int i = 0; i < m; ++i)
+        for (int j = 0; j < n; ++j) {
+            float g = G[ldc * j + i];
+            float c = C[ldc * j + i];
+            if (flt::isnan(g)) {
+                fprintf(stderr, "%s:%d: found nan in reference matrix: i=%d j=%d\n", __FILE__,
+                        __LINE__, i, j);
+                return 3;
+            }
+            if (flt::isnan(c)) {
+                fprintf(stderr, "%s:%d: found nan in output matrix: i=%d j=%d\n", __FILE__,
+                        __LINE__, i, j);
+                return 4;
+            }
+            long long gi = flt::toint(g);
+            long long ci = flt::toint(c);
+            long long err = gi - ci;
+            if (err < 0)
+                err = -err;
+            err_sum += err;
+            if (err > err_worst)
+                err_worst = err;
+        }
+
+    double err_avg = err_sum / (m * n);
+    fprintf(stderr, "%12g ulp average\n", err_avg);
+    fprintf(stderr, "%12lld ulp worst\n", err_worst);
+
+    free(G);
+    free(C);
+    free(B);
+    free(A);
+
+    if (err_avg > 100)
+        return 5;
+
+    return 0;
+}
+
+float unquant(const block_q8_0 *b, int i) {
+    return GGML_FP16_TO_FP32(b->d) * b->qs[i];
+}
+
+float unquant(const block_q4_0 *b, int i) {
+    int q = i < QK4_0 / 2 ? b->qs[i] & 15 : b->qs[i - QK4_0 / 2] >> 4;
+    return GGML_FP16_TO_FP32(b->d) * (q - 8);
+}
+
+template <typename TA>
+int test_quant(int Atype, int n) {
+    int m = 8192;
+    int k = 4096;
+    int lda = k / QK8_0;
+    int ldb = k / QK8_0;
+    int ldc = m;
+    float *F = ALLOC(k * m);
+    TA *A = (TA *)memalign(4096, sizeof(TA) * lda * m);
+    block_q8_0 *B = (block_q8_0 *)memalign(4096, sizeof(block_q8_0) * ldb * n);
+    float *C = ALLOC(ldc * n);
+    broadcast(C, ldc * n, NAN);
+    randomize(F, k * m);
+    ggml_quantize_chunk((ggml_type)Atype, F, A, 0, m, k, nullptr);
+    randomize(F, k * n);
+    ggml_quantize_chunk(GGML_TYPE_Q8_0, F, B, 0, n, k, nullptr);
+
+    BENCH(llamafile_sgemm_openmp(m, n, lda, A, lda, B, ldb, C, ldc, Atype, GGML_TYPE_Q8_0,
+                                 GGML_TYPE_F32));
+
+    long long start = micros();
+    for (int i = 0; i < ITERATIONS; ++i)
+        llamafile_sgemm_openmp(m, n, lda, A, lda, B, ldb, C, ldc, Atype, GGML_TYPE_Q8_0,
+                               GGML_TYPE_F32);
+    long long took = (micros() - start + ITERATIONS - 1) / ITERATIONS;
+    fprintf(stderr, "%12g GB/s weight streaming (%s n=%d)\n",
+            (double)sizeof(TA) * lda * m / 1e3 / (took ? took : 1),
+            ggml_type_name((ggml_type)Atype), n);
+
+    double err_worst = 0;
+    for (int i = 0; i < m; ++i)
+        for (int j = 0; j < n; ++j) {
+            double g = 0;
+            for (int l = 0; l < k; ++l)
+                g += unquant(A + lda * i + l / QK8_0, l % QK8_0) *
+                     unquant(B + ldb * j + l / QK8_0, l % QK8_0);
+            double err = fabs(g - C[ldc * j + i]) / (fabs(g) + 1);
+            if (std::isnan(err)) {
+                fprintf(stderr, "%s:%d: found nan in output matrix: i=%d j=%d\n", __FILE__,
+                        __LINE__, i, j);
+                return 6;
+            }
+            if (err > err_worst)
+                err_worst = err;
+        }
+    fprintf(stderr, "%12g relative error worst\n", err_worst);
+
+    free(C);
+    free(B);
+    free(A);
+    free(F);
+
+    if (err_worst > 1e-3)
+        return 7;
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rc;
+
+    // llamafile_trapping_enabled(+1);
+
+    for (int n = 1; n <= 4; ++n) {
+        printf("\n");
+        if ((rc = test(n)))
+            return rc;
+        if ((rc = test_quant<block_q8_0>(GGML_TYPE_Q8_0, n)))
+            return rc;
+        if ((rc = test_quant<block_q4_0>(GGML_TYPE_Q4_0, n)))
+            return rc;
+    }
+}
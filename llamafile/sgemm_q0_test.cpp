@@ -0,0 +1,127 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bench.h"
+#include "llama.cpp/ggml-quants.h"
+#include "llama.cpp/ggml.h"
+#include "numba.h"
+#include "sgemm.h"
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <libc/sysv/consts/hwcap.h>
+#include <sys/auxv.h>
+
+#ifndef AT_HWCAP2
+#define AT_HWCAP2 26
+#endif
+#ifndef HWCAP2_I8MM
+#define HWCAP2_I8MM (1 << 13)
+#endif
+
+#define ITERATIONS 10
+
+// the generic entry point picks iqk over tinyBLAS for most of these shapes
+// unless the cpu has i8mm, so call the armv8.6 build directly when we can,
+// to make sure it's the mmla kernels that get tested on those machines
+static bool (*sgemm)(long, long, long, const void *, long, const void *, long, void *, long,
+                     int, int, int, int, int) = llamafile_sgemm;
+
+void llamafile_sgemm_openmp(long m, long n, long k, const void *A, long lda, const void *B,
+                            long ldb, void *C, long ldc, int Atype, int Btype, int Ctype) {
+    static int nth = cpu_get_num_math();
+#pragma omp parallel for
+    for (int ith = 0; ith < nth; ++ith) {
+        bool res = sgemm(m, n, k, A, lda, B, ldb, C, ldc, ith, nth, Atype, Btype, Ctype);
+        assert(res);
+    }
+}
+
+float unquant(const block_q8_0 *b, int i) {
+    return GGML_FP16_TO_FP32(b->d) * b->qs[i];
+}
+
+float unquant(const block_q4_0 *b, int i) {
+    int q = i < QK4_0 / 2 ? b->qs[i] & 15 : b->qs[i - QK4_0 / 2] >> 4;
+    return GGML_FP16_TO_FP32(b->d) * (q - 8);
+}
+
+template <typename TA>
+int test(int Atype, int m, int n, int k) {
+    int lda = k / QK8_0;
+    int ldb = k / QK8_0;
+    int ldc = m;
+    float *F = (float *)malloc(sizeof(float) * k * (m > n ? m : n));
+    TA *A = (TA *)malloc(sizeof(TA) * lda * m);
+    block_q8_0 *B = (block_q8_0 *)malloc(sizeof(block_q8_0) * ldb * n);
+    float *C = (float *)malloc(sizeof(float) * ldc * n);
+    broadcast(C, ldc * n, NAN);
+    randomize(F, k * m);
+    ggml_quantize_chunk((ggml_type)Atype, F, A, 0, m, k, nullptr);
+    randomize(F, k * n);
+    ggml_quantize_chunk(GGML_TYPE_Q8_0, F, B, 0, n, k, nullptr);
+
+    BENCH(llamafile_sgemm_openmp(m, n, lda, A, lda, B, ldb, C, ldc, Atype, GGML_TYPE_Q8_0,
+                                 GGML_TYPE_F32));
+
+    double err_worst = 0;
+    for (int i = 0; i < m; ++i)
+        for (int j = 0; j < n; ++j) {
+            double g = 0;
+            for (int l = 0; l < k; ++l)
+                g += unquant(A + lda * i + l / QK8_0, l % QK8_0) *
+                     unquant(B + ldb * j + l / QK8_0, l % QK8_0);
+            double err = fabs(g - C[ldc * j + i]) / (fabs(g) + 1);
+            if (std::isnan(err)) {
+                fprintf(stderr, "%s:%d: found nan in output matrix: i=%d j=%d\n", __FILE__,
+                        __LINE__, i, j);
+                return 3;
+            }
+            if (err > err_worst)
+                err_worst = err;
+        }
+    fprintf(stderr, "%12g relative error worst (%s m=%d n=%d k=%d)\n", err_worst,
+            ggml_type_name((ggml_type)Atype), m, n, k);
+
+    free(C);
+    free(B);
+    free(A);
+    free(F);
+
+    if (err_worst > 1e-3)
+        return 4;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rc;
+#ifdef __aarch64__
+    if (getauxval(AT_HWCAP2) & HWCAP2_I8MM) {
+        sgemm = llamafile_sgemm_arm86;
+        fprintf(stderr, "testing armv8.6 i8mm kernels\n");
+    } else {
+        fprintf(stderr, "cpu lacks i8mm; mmla kernels not tested\n");
+    }
+#endif
+    static const int ns[] = {1, 3, 4, 7, 16, 33};
+    for (int n : ns) {
+        if ((rc = test<block_q8_0>(GGML_TYPE_Q8_0, 131, n, 4096)))
+            return rc;
+        if ((rc = test<block_q4_0>(GGML_TYPE_Q4_0, 131, n, 4096)))
+            return rc;
+    }
+}
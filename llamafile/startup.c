@@ -0,0 +1,149 @@
+// -*- mode:c;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=c ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile.h"
+#include "trace.h"
+
+#include <cosmo.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+// startup profiler
+//
+// getting from exec to the first token involves loading the ape, then
+// scanning the zip, parsing gguf, probing gpus, allocating the context
+// and warming up. each phase records its wall time, page faults, and
+// block input here, so `--startup-report` can say where seconds went.
+// phases are also emitted as trace events, so `--trace` gets them too.
+
+#define MAX_PHASES 64
+
+struct StartupPhase {
+    const char *name;
+    int depth;
+    bool done;
+    struct timespec start;
+    struct timespec end;
+    struct rusage ru_start;
+    struct rusage ru_end;
+};
+
+static int g_depth;
+static int g_count;
+static bool g_reported;
+static struct StartupPhase g_phases[MAX_PHASES];
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void llamafile_startup_begin(const char *name) {
+    llamafile_trace_begin(name);
+    pthread_mutex_lock(&g_lock);
+    if (g_count < MAX_PHASES && !g_reported) {
+        struct StartupPhase *p = g_phases + g_count++;
+        p->name = name;
+        p->depth = g_depth++;
+        p->done = false;
+        getrusage(RUSAGE_SELF, &p->ru_start);
+        p->start = timespec_real();
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+void llamafile_startup_end(const char *name) {
+    pthread_mutex_lock(&g_lock);
+    for (int i = g_count; i--;) {
+        struct StartupPhase *p = g_phases + i;
+        if (!p->done && !strcmp(p->name, name)) {
+            p->end = timespec_real();
+            getrusage(RUSAGE_SELF, &p->ru_end);
+            p->done = true;
+            --g_depth;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    llamafile_trace_end(name);
+}
+
+// returns milliseconds elapsed between exec() and the first phase
+static double llamafile_startup_exec_millis(void) {
+    FILE *f;
+    char buf[1024];
+    if (!IsLinux() || !(f = fopen("/proc/self/stat", "r")))
+        return -1;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = 0;
+    char *p = strrchr(buf, ')'); // comm may contain spaces
+    if (!p)
+        return -1;
+    unsigned long long starttime = 0;
+    for (int field = 2; field < 22 && (p = strchr(p + 1, ' '));)
+        if (++field == 22)
+            starttime = strtoull(p + 1, 0, 10);
+    struct timespec boot;
+    if (clock_gettime(CLOCK_BOOTTIME, &boot))
+        return -1;
+    double now = timespec_tonanos(boot) / 1e6;
+    double then = starttime * 1e3 / sysconf(_SC_CLK_TCK);
+    double age = timespec_tonanos(timespec_sub(timespec_real(), g_phases[0].start)) / 1e6;
+    return now - age - then;
+}
+
+static void llamafile_startup_row(const char *name, int depth, double millis,
+                                  const struct rusage *a, const struct rusage *b) {
+    fprintf(stderr, "%*s%-*s %10.1f %10ld %8ld %10ld\n", depth * 2, "", 28 - depth * 2, name,
+            millis, b->ru_minflt - a->ru_minflt, b->ru_majflt - a->ru_majflt,
+            (b->ru_inblock - a->ru_inblock) / 2);
+}
+
+/**
+ * Prints table of startup phases if `--startup-report` was passed.
+ */
+void llamafile_startup_report(void) {
+    if (!FLAG_startup_report)
+        return;
+    pthread_mutex_lock(&g_lock);
+    if (g_reported || !g_count) {
+        pthread_mutex_unlock(&g_lock);
+        return;
+    }
+    g_reported = true;
+    fprintf(stderr, "\n%-28s %10s %10s %8s %10s\n", "startup phase", "ms", "minflt", "majflt",
+            "read_kb");
+    struct rusage zero = {0};
+    double exec = llamafile_startup_exec_millis();
+    if (exec >= 0)
+        llamafile_startup_row("exec", 0, exec, &zero, &g_phases[0].ru_start);
+    for (int i = 0; i < g_count; ++i) {
+        struct StartupPhase *p = g_phases + i;
+        if (!p->done)
+            continue;
+        llamafile_startup_row(p->name, p->depth, timespec_tonanos(timespec_sub(p->end, p->start)) / 1e6,
+                              &p->ru_start, &p->ru_end);
+    }
+    struct rusage now;
+    getrusage(RUSAGE_SELF, &now);
+    double total = timespec_tonanos(timespec_sub(timespec_real(), g_phases[0].start)) / 1e6;
+    llamafile_startup_row("total", 0, total + (exec >= 0 ? exec : 0), &zero, &now);
+    fprintf(stderr, "\n");
+    pthread_mutex_unlock(&g_lock);
+}
@@ -50,6 +50,8 @@
 #pragma GCC diagnostic ignored "-Wignored-attributes"
 
 #define CHUNK 8
+#define GEMV_MAX_N 4
+#define GEMV_PREFETCH 1024
 #define ROW_ALIGN 64
 #define MATRIX_ALIGN 4096
 #define MAX_ALIGN 4096
@@ -88,6 +90,31 @@ inline float unhalf(ggml_bf16_t d) {
     return GGML_BF16_TO_FP32(d);
 }
 
+/**
+ * Asks memory subsystem to start streaming the bytes at `p`.
+ *
+ * Weights are only touched once per token during matvec, so we use a
+ * non-temporal hint; that way they don't evict the vector from cache.
+ */
+inline void stream(const void *p, long bytes) {
+    for (long i = 0; i < bytes; i += 64)
+        __builtin_prefetch((const char *)p + GEMV_PREFETCH + i, 0, 0);
+}
+
+/**
+ * Returns half-open interval of matrix rows owned by thread `ith`.
+ *
+ * Each thread gets a single contiguous band, so the weights it reads
+ * form one long sequential stream. The band is rounded up to a whole
+ * cache line of output floats to avoid false sharing on the result.
+ */
+inline void gemv_rows(long m, int ith, int nth, long *start, long *end) {
+    long duty = (m + nth - 1) / nth;
+    duty = (duty + 15) & -16;
+    *start = MIN(duty * ith, m);
+    *end = MIN(*start + duty, m);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // MATRIX MEMORY INDEXING
 
@@ -118,6 +145,10 @@ template <>
 struct ggml_type_trait<block_q8_0> {
     static constexpr ggml_type id = GGML_TYPE_Q8_0;
 };
+template <>
+struct ggml_type_trait<block_q4_0> {
+    static constexpr ggml_type id = GGML_TYPE_Q4_0;
+};
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // VECTORIZED ARITHMETIC OPERATIONS
@@ -421,17 +452,130 @@ class tinyBLAS {
   public:
     tinyBLAS(long k, const TA *A, long lda, const TB *B, long ldb, TC *C, long ldc, int ith,
              int nth)
-        : A(A), B(B), C(C), k(k), lda(lda), ldb(ldb), ldc(ldc), ith(ith), nth(nth) {
+        : A(A), B(B), C(C), k(k), lda(lda), ldb(ldb), ldc(ldc), ith(ith), nth(nth), tile(0) {
     }
 
     void matmul(long m, long n) {
-        mnpack(0, m, 0, n);
+        switch (n) {
+        case 1:
+            gemv<1>(m);
+            break;
+        case 2:
+            gemv<2>(m);
+            break;
+        case 3:
+            gemv<3>(m);
+            break;
+        case 4:
+            gemv<4>(m);
+            break;
+        default:
+            tile = llamafile_sgemm_tile(ggml_type_trait<TA>::id, m, n, k);
+            mnpack(0, m, 0, n);
+            break;
+        }
+        static_assert(GEMV_MAX_N == 4);
     }
 
   private:
+    template <int RN>
+    NOINLINE void gemv(long m) {
+        // several independent accumulators per column hide fma latency
+        constexpr int ACC = RN * 4 <= VECTOR_REGISTERS / 2 ? 4 : 2;
+        D stack[bsr(k / CHUNK + 1) + 1][RN];
+        long start, end;
+        gemv_rows(m, ith, nth, &start, &end);
+        for (long ii = start; ii < end; ++ii) {
+
+            size_t chunk, sp = 0;
+            int a, j, rule, step = 2;
+            for (chunk = 0; chunk + KN * CHUNK * 4 <= k; chunk += KN * CHUNK * 4, step += 2, ++sp) {
+
+                stream(INDEX(A, lda, ii, chunk), sizeof(TA) * KN * CHUNK * 4);
+                D Cv[RN][ACC] = {};
+                for (long l = 0; l < KN * CHUNK * 4; l += KN * ACC)
+#pragma GCC unroll 100
+                    for (a = 0; a < ACC; ++a)
+#pragma GCC unroll 100
+                        for (j = 0; j < RN; ++j)
+                            Cv[j][a] = madd(load<V>(INDEX(A, lda, ii, chunk + l + KN * a)), //
+                                            load<V>(INDEX(B, ldb, j, chunk + l + KN * a)), //
+                                            Cv[j][a]);
+
+                for (j = 0; j < RN; ++j)
+                    for (a = 1; a < ACC; ++a)
+                        Cv[j][0] += Cv[j][a];
+
+                for (rule = bsr(step & -step); --rule;)
+                    for (--sp, j = 0; j < RN; ++j)
+                        Cv[j][0] += stack[sp][j];
+
+                for (j = 0; j < RN; ++j)
+                    stack[sp][j] = Cv[j][0];
+            }
+
+            D Cv[RN] = {};
+            for (; chunk + KN <= k; chunk += KN)
+#pragma GCC unroll 100
+                for (j = 0; j < RN; ++j)
+                    Cv[j] = madd(load<V>(INDEX(A, lda, ii, chunk)), //
+                                 load<V>(INDEX(B, ldb, j, chunk)), //
+                                 Cv[j]);
+
+            while (sp--)
+                for (j = 0; j < RN; ++j)
+                    Cv[j] += stack[sp][j];
+
+            float Cf[RN];
+            for (j = 0; j < RN; ++j)
+                Cf[j] = hsum(Cv[j]);
+
+            for (; chunk < k; ++chunk)
+                for (j = 0; j < RN; ++j)
+                    Cf[j] = fmaf(load<float>(INDEX(A, lda, ii, chunk)), //
+                                 load<float>(INDEX(B, ldb, j, chunk)), //
+                                 Cf[j]);
+
+            for (j = 0; j < RN; ++j)
+                store(INDEX(C, ldc, j, ii), Cf[j]);
+        }
+    }
+
+    // alternative tile shapes that the autotuner may choose
+    bool mntune(long m0, long m, long n0, long n) {
+        switch (tile) {
+#if VECTOR_REGISTERS == 32
+        case 1:
+            return mntile<4, 6>(m0, m, n0, n);
+        case 2:
+            return mntile<6, 4>(m0, m, n0, n);
+#else
+        case 1:
+            return mntile<3, 4>(m0, m, n0, n);
+#endif
+        default:
+            return false;
+        }
+    }
+
+    template <int RM, int RN>
+    bool mntile(long m0, long m, long n0, long n) {
+        if (m - m0 < RM || n - n0 < RN)
+            return false;
+        gemm<RM, RN>(m0, m, n0, n);
+        long mp = m0 + (m - m0) / RM * RM;
+        long np = n0 + (n - n0) / RN * RN;
+        mnpack(mp, m, n0, np);
+        mnpack(m0, m, np, n);
+        return true;
+    }
+
     NOINLINE void mnpack(long m0, long m, long n0, long n) {
         long mc, nc, mp, np;
 
+        if (tile && mntune(m0, m, n0, n))
+            return;
+
 #if VECTOR_REGISTERS == 32
         switch ((MIN(m - m0, 5) << 4) | MIN(n - n0, 5)) {
         case 0x55:
@@ -610,6 +754,7 @@ class tinyBLAS {
     const long ldc;
     const int ith;
     const int nth;
+    int tile;
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -621,17 +766,113 @@ class tinyBLAS_Q0_ARM {
   public:
     tinyBLAS_Q0_ARM(long k, const TA *A, long lda, const TB *B, long ldb, TC *C, long ldc, int ith,
                     int nth)
-        : A(A), B(B), C(C), k(k), lda(lda), ldb(ldb), ldc(ldc), ith(ith), nth(nth) {
+        : A(A), B(B), C(C), k(k), lda(lda), ldb(ldb), ldc(ldc), ith(ith), nth(nth), tile(0) {
     }
 
     void matmul(long m, long n) {
-        mnpack(0, m, 0, n);
+        switch (n) {
+        case 1:
+            FLAG_precise ? gemv<1, true>(m) : gemv<1, false>(m);
+            break;
+        case 2:
+            FLAG_precise ? gemv<2, true>(m) : gemv<2, false>(m);
+            break;
+        case 3:
+            FLAG_precise ? gemv<3, true>(m) : gemv<3, false>(m);
+            break;
+        case 4:
+            FLAG_precise ? gemv<4, true>(m) : gemv<4, false>(m);
+            break;
+        default:
+            if (!FLAG_precise)
+                tile = llamafile_sgemm_tile(ggml_type_trait<TA>::id, m, n, k * QK8_0);
+            mnpack(0, m, 0, n);
+            break;
+        }
+        static_assert(GEMV_MAX_N == 4);
     }
 
   private:
+    template <int RN, int PRECISE>
+    NOINLINE void gemv(long m) {
+        long start, end;
+        gemv_rows(m, ith, nth, &start, &end);
+        for (long ii = start; ii < end; ++ii) {
+            float32x4_t Cv[RN][2] = {};
+            float32x4_t Ce[RN][2] = {};
+            long l = 0;
+            for (; l + 2 <= k; l += 2) {
+                stream(INDEX(A, lda, ii, l), sizeof(TA) * 2);
+#pragma GCC unroll 100
+                for (int a = 0; a < 2; ++a) {
+                    int8x16_t alo = load_lo(INDEX(A, lda, ii, l + a));
+                    int8x16_t ahi = load_hi(INDEX(A, lda, ii, l + a));
+                    float ad = unhalf(INDEX(A, lda, ii, l + a)->d);
+#pragma GCC unroll 100
+                    for (int j = 0; j < RN; ++j) {
+                        float32x4_t p = vcvtq_f32_s32(vdotq_s32(
+                            vdotq_s32(vdupq_n_s32(0), alo, load_lo(INDEX(B, ldb, j, l + a))), ahi,
+                            load_hi(INDEX(B, ldb, j, l + a))));
+                        float d = ad * unhalf(INDEX(B, ldb, j, l + a)->d);
+                        if (PRECISE)
+                            Cv[j][a] = badder(p, d, Cv[j][a], &Ce[j][a]);
+                        else
+                            Cv[j][a] = vmlaq_n_f32(Cv[j][a], p, d);
+                    }
+                }
+            }
+            for (; l < k; ++l)
+                for (int j = 0; j < RN; ++j) {
+                    float32x4_t p = vcvtq_f32_s32(
+                        vdotq_s32(vdotq_s32(vdupq_n_s32(0), load_lo(INDEX(A, lda, ii, l)),
+                                            load_lo(INDEX(B, ldb, j, l))),
+                                  load_hi(INDEX(A, lda, ii, l)), load_hi(INDEX(B, ldb, j, l))));
+                    float d = unhalf(INDEX(A, lda, ii, l)->d) * unhalf(INDEX(B, ldb, j, l)->d);
+                    if (PRECISE)
+                        Cv[j][0] = badder(p, d, Cv[j][0], &Ce[j][0]);
+                    else
+                        Cv[j][0] = vmlaq_n_f32(Cv[j][0], p, d);
+                }
+            for (int j = 0; j < RN; ++j)
+                store(INDEX(C, ldc, j, ii), hsum(Cv[j][0]) + hsum(Cv[j][1]));
+        }
+    }
+
+    // alternative tile shapes that the autotuner may choose
+    bool mntune(long m0, long m, long n0, long n) {
+        switch (tile) {
+        case 1:
+            return mntile<4, 2>(m0, m, n0, n);
+        case 2:
+            return mntile<2, 4>(m0, m, n0, n);
+        default:
+            return false;
+        }
+    }
+
+    template <int RM, int RN>
+    bool mntile(long m0, long m, long n0, long n) {
+        if (m - m0 < RM || n - n0 < RN)
+            return false;
+        gemm<RM, RN, false>(m0, m, n0, n);
+        long mp = m0 + (m - m0) / RM * RM;
+        long np = n0 + (n - n0) / RN * RN;
+        mnpack(mp, m, n0, np);
+        mnpack(m0, m, np, n);
+        return true;
+    }
+
     NOINLINE void mnpack(long m0, long m, long n0, long n) {
         long mc, nc, mp, np;
 
+        if (tile && mntune(m0, m, n0, n))
+            return;
+
+#if defined(__ARM_FEATURE_MATMUL_INT8)
+        if (!FLAG_precise && (mmtile<4, 4>(m0, m, n0, n) || mmtile<2, 2>(m0, m, n0, n)))
+            return;
+#endif
+
         if (!FLAG_precise) {
             switch ((MIN(m - m0, 3) << 4) | MIN(n - n0, 3)) {
             case 0x33:
@@ -708,6 +949,97 @@ class tinyBLAS_Q0_ARM {
         mnpack(m0, m, np, n);
     }
 
+#if defined(__ARM_FEATURE_MATMUL_INT8)
+    template <int RM, int RN>
+    bool mmtile(long m0, long m, long n0, long n) {
+        if (m - m0 < RM || n - n0 < RN)
+            return false;
+        mmla<RM, RN>(m0, m, n0, n);
+        long mp = m0 + (m - m0) / RM * RM;
+        long np = n0 + (n - n0) / RN * RN;
+        mnpack(mp, m, n0, np);
+        mnpack(m0, m, np, n);
+        return true;
+    }
+
+    // computes tiles using the armv8.6 int8 matrix multiply instruction
+    //
+    // smmla multiplies a 2x8 matrix of bytes by the transpose of another
+    // 2x8 matrix, producing four dot products at once, so each block of
+    // 32 quants from a pair of rows and a pair of columns needs just four
+    // instructions, versus eight sdot instructions for the same work.
+    template <int RM, int RN>
+    NOINLINE void mmla(long m0, long m, long n0, long n) {
+        static_assert(!(RM % 2) && !(RN % 2));
+        long ytiles = (m - m0) / RM;
+        long xtiles = (n - n0) / RN;
+        long tiles = xtiles * ytiles;
+        long duty = (tiles + nth - 1) / nth;
+        long start = duty * ith;
+        long end = start + duty;
+        if (end > tiles)
+            end = tiles;
+        for (long job = start; job < end; ++job) {
+            long ii = m0 + job / xtiles * RM;
+            long jj = n0 + job % xtiles * RN;
+            float32x4_t Cv[RN / 2][RM / 2] = {};
+            for (long l = 0; l < k; ++l) {
+                int8x16_t Av[RM / 2][4];
+                int8x16_t Bv[RN / 2][4];
+                float32x4_t Ad[RM / 2];
+                float32x4_t Bd[RN / 2];
+#pragma GCC unroll 100
+                for (int i = 0; i < RM / 2; ++i) {
+                    interleave(Av[i], INDEX(A, lda, ii + i * 2, l), INDEX(A, lda, ii + i * 2 + 1, l));
+                    float d0 = unhalf(INDEX(A, lda, ii + i * 2, l)->d);
+                    float d1 = unhalf(INDEX(A, lda, ii + i * 2 + 1, l)->d);
+                    Ad[i] = (float32x4_t){d0, d0, d1, d1};
+                }
+#pragma GCC unroll 100
+                for (int j = 0; j < RN / 2; ++j) {
+                    interleave(Bv[j], INDEX(B, ldb, jj + j * 2, l), INDEX(B, ldb, jj + j * 2 + 1, l));
+                    float d0 = unhalf(INDEX(B, ldb, jj + j * 2, l)->d);
+                    float d1 = unhalf(INDEX(B, ldb, jj + j * 2 + 1, l)->d);
+                    Bd[j] = (float32x4_t){d0, d1, d0, d1};
+                }
+#pragma GCC unroll 100
+                for (int j = 0; j < RN / 2; ++j)
+#pragma GCC unroll 100
+                    for (int i = 0; i < RM / 2; ++i) {
+                        int32x4_t p = vdupq_n_s32(0);
+                        p = vmmlaq_s32(p, Av[i][0], Bv[j][0]);
+                        p = vmmlaq_s32(p, Av[i][1], Bv[j][1]);
+                        p = vmmlaq_s32(p, Av[i][2], Bv[j][2]);
+                        p = vmmlaq_s32(p, Av[i][3], Bv[j][3]);
+                        Cv[j][i] = vmlaq_f32(Cv[j][i], vcvtq_f32_s32(p), vmulq_f32(Ad[i], Bd[j]));
+                    }
+            }
+#pragma GCC unroll 100
+            for (int j = 0; j < RN / 2; ++j)
+#pragma GCC unroll 100
+                for (int i = 0; i < RM / 2; ++i) {
+                    store(INDEX(C, ldc, jj + j * 2 + 0, ii + i * 2 + 0), vgetq_lane_f32(Cv[j][i], 0));
+                    store(INDEX(C, ldc, jj + j * 2 + 1, ii + i * 2 + 0), vgetq_lane_f32(Cv[j][i], 1));
+                    store(INDEX(C, ldc, jj + j * 2 + 0, ii + i * 2 + 1), vgetq_lane_f32(Cv[j][i], 2));
+                    store(INDEX(C, ldc, jj + j * 2 + 1, ii + i * 2 + 1), vgetq_lane_f32(Cv[j][i], 3));
+                }
+        }
+    }
+
+    // packs two blocks into the 2x8 layout smmla wants
+    template <typename T>
+    inline void interleave(int8x16_t v[4], const T *x, const T *y) {
+        int64x2_t xlo = vreinterpretq_s64_s8(load_lo(x));
+        int64x2_t ylo = vreinterpretq_s64_s8(load_lo(y));
+        int64x2_t xhi = vreinterpretq_s64_s8(load_hi(x));
+        int64x2_t yhi = vreinterpretq_s64_s8(load_hi(y));
+        v[0] = vreinterpretq_s8_s64(vzip1q_s64(xlo, ylo));
+        v[1] = vreinterpretq_s8_s64(vzip2q_s64(xlo, ylo));
+        v[2] = vreinterpretq_s8_s64(vzip1q_s64(xhi, yhi));
+        v[3] = vreinterpretq_s8_s64(vzip2q_s64(xhi, yhi));
+    }
+#endif // __ARM_FEATURE_MATMUL_INT8
+
     template <int RM, int RN, int PRECISE>
     NOINLINE void gemm(long m0, long m, long n0, long n) {
         long ytiles = RM > 1 ? (m - m0) / RM : 1;
@@ -773,6 +1105,7 @@ class tinyBLAS_Q0_ARM {
     const long ldc;
     const int ith;
     const int nth;
+    int tile;
 };
 #endif // __ARM_FEATURE_DOTPROD
 
@@ -782,17 +1115,113 @@ class tinyBLAS_Q0_AVX2 {
   public:
     tinyBLAS_Q0_AVX2(long k, const TA *A, long lda, const TB *B, long ldb, TC *C, long ldc, int ith,
                      int nth)
-        : A(A), B(B), C(C), k(k), lda(lda), ldb(ldb), ldc(ldc), ith(ith), nth(nth) {
+        : A(A), B(B), C(C), k(k), lda(lda), ldb(ldb), ldc(ldc), ith(ith), nth(nth), tile(0) {
     }
 
     void matmul(long m, long n) {
-        mnpack(0, m, 0, n);
+        switch (n) {
+        case 1:
+            FLAG_precise ? gemv<1, true>(m) : gemv<1, false>(m);
+            break;
+        case 2:
+            FLAG_precise ? gemv<2, true>(m) : gemv<2, false>(m);
+            break;
+        case 3:
+            FLAG_precise ? gemv<3, true>(m) : gemv<3, false>(m);
+            break;
+        case 4:
+            FLAG_precise ? gemv<4, true>(m) : gemv<4, false>(m);
+            break;
+        default:
+            if (!FLAG_precise)
+                tile = llamafile_sgemm_tile(ggml_type_trait<TA>::id, m, n, k * QK8_0);
+            mnpack(0, m, 0, n);
+            break;
+        }
+        static_assert(GEMV_MAX_N == 4);
     }
 
   private:
+    template <int RN, int PRECISE>
+    NOINLINE void gemv(long m) {
+        long start, end;
+        gemv_rows(m, ith, nth, &start, &end);
+        for (long ii = start; ii < end; ++ii) {
+            __m256 Cv[RN][2] = {};
+            __m256 Ce[RN][2] = {};
+            long l = 0;
+            for (; l + 2 <= k; l += 2) {
+                stream(INDEX(A, lda, ii, l), sizeof(TA) * 2);
+#pragma GCC unroll 100
+                for (int a = 0; a < 2; ++a) {
+                    // dequantize each weight block once, then reuse it for every column
+                    __m256i w = load(INDEX(A, lda, ii, l + a));
+                    __m256i u = _mm256_sign_epi8(w, w);
+                    float ad = unhalf(INDEX(A, lda, ii, l + a)->d);
+#pragma GCC unroll 100
+                    for (int j = 0; j < RN; ++j) {
+                        __m256 d = _mm256_set1_ps(ad * unhalf(INDEX(B, ldb, j, l + a)->d));
+                        __m256 p = updot(u, _mm256_sign_epi8(load(INDEX(B, ldb, j, l + a)), w));
+                        if (PRECISE)
+                            Cv[j][a] = madder(d, p, Cv[j][a], &Ce[j][a]);
+                        else
+                            Cv[j][a] = madd(d, p, Cv[j][a]);
+                    }
+                }
+            }
+            for (; l < k; ++l) {
+                __m256i w = load(INDEX(A, lda, ii, l));
+                __m256i u = _mm256_sign_epi8(w, w);
+                float ad = unhalf(INDEX(A, lda, ii, l)->d);
+                for (int j = 0; j < RN; ++j) {
+                    __m256 d = _mm256_set1_ps(ad * unhalf(INDEX(B, ldb, j, l)->d));
+                    __m256 p = updot(u, _mm256_sign_epi8(load(INDEX(B, ldb, j, l)), w));
+                    if (PRECISE)
+                        Cv[j][0] = madder(d, p, Cv[j][0], &Ce[j][0]);
+                    else
+                        Cv[j][0] = madd(d, p, Cv[j][0]);
+                }
+            }
+            for (int j = 0; j < RN; ++j)
+                store(INDEX(C, ldc, j, ii), hsum(Cv[j][0]) + hsum(Cv[j][1]));
+        }
+    }
+
+    // alternative tile shapes that the autotuner may choose
+    bool mntune(long m0, long m, long n0, long n) {
+        switch (tile) {
+#if VECTOR_REGISTERS == 32
+        case 1:
+            return mntile<4, 3>(m0, m, n0, n);
+        case 2:
+            return mntile<3, 4>(m0, m, n0, n);
+#else
+        case 1:
+            return mntile<4, 2>(m0, m, n0, n);
+#endif
+        default:
+            return false;
+        }
+    }
+
+    template <int RM, int RN>
+    bool mntile(long m0, long m, long n0, long n) {
+        if (m - m0 < RM || n - n0 < RN)
+            return false;
+        gemm<RM, RN, false>(m0, m, n0, n);
+        long mp = m0 + (m - m0) / RM * RM;
+        long np = n0 + (n - n0) / RN * RN;
+        mnpack(mp, m, n0, np);
+        mnpack(m0, m, np, n);
+        return true;
+    }
+
     void mnpack(long m0, long m, long n0, long n) {
         long mc, nc, mp, np;
 
+        if (tile && mntune(m0, m, n0, n))
+            return;
+
 #if VECTOR_REGISTERS == 32
         if (!FLAG_precise) {
             switch ((MIN(m - m0, 3) << 4) | MIN(n - n0, 3)) {
@@ -1001,6 +1430,7 @@ class tinyBLAS_Q0_AVX2 {
     const long ldc;
     const int ith;
     const int nth;
+    int tile;
 };
 #endif // __AVX2__
 
@@ -0,0 +1,4 @@
+#ifdef __aarch64__
+#define llamafile_mixmul llamafile_mixmul_arm86
+#include "tinyblas_cpu_mixmul.inc"
+#endif // __aarch64__
@@ -1,4 +1,5 @@
 #ifdef __aarch64__
 #define llamafile_sgemm llamafile_sgemm_arm80
+#define llamafile_tinyblas llamafile_tinyblas_arm80
 #include "tinyblas_cpu_sgemm.inc"
 #endif // __aarch64__
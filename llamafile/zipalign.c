@@ -20,15 +20,20 @@
 
 #include <assert.h>
 #include <cosmo.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
+#include <unistd.h>
 #include <third_party/getopt/getopt.internal.h>
 #include <third_party/zlib/zlib.h>
 #include <time.h>
@@ -37,6 +42,33 @@
 #include <libc/mem/tinymalloc.inc>
 
 #define CHUNK 2097152
+#define SLICE (CHUNK * 32)
+#define MAX_THREADS 64
+
+// linux reflink ioctl, see ioctl_ficlonerange(2)
+#define FICLONERANGE_ 0x4020940d
+struct FileCloneRange {
+    int64_t src_fd;
+    uint64_t src_offset;
+    uint64_t src_length;
+    uint64_t dest_offset;
+};
+
+// stored assets are split into slices that get checksummed by separate
+// threads and whose crcs are glued back together with crc32_combine()
+struct Slice {
+    const char *path;
+    const char *zpath;
+    const uint8_t *map;
+    int fd;
+    int zfd;
+    bool cloned;
+    uint64_t off;
+    uint64_t len;
+    uint64_t dst;
+    uint32_t crc;
+    pthread_t th;
+};
 
 #define Min(a, b) ((a) < (b) ? (a) : (b))
 #define DOS_DATE(YEAR, MONTH_IDX1, DAY_IDX1) (((YEAR) - 1980) << 9 | (MONTH_IDX1) << 5 | (DAY_IDX1))
@@ -83,6 +115,94 @@ static void *Realloc(void *p, size_t n) {
     return p;
 }
 
+// asks the filesystem to share the extents of the input file with the
+// output file (btrfs, xfs, bcachefs, zfs). dst must be block aligned.
+static bool CloneFile(int fd, int zfd, uint64_t dst) {
+    if (!IsLinux())
+        return false;
+    struct FileCloneRange fcr = {fd, 0, 0, dst};
+    return !ioctl(zfd, FICLONERANGE_, &fcr);
+}
+
+// copies bytes from input to output without leaving the kernel if it's
+// supported, otherwise falls back to writing from the memory map.
+static void CopyRange(struct Slice *s, uint64_t off, uint64_t len) {
+    while (len) {
+        ssize_t rc;
+        int64_t in = off;
+        int64_t out = s->dst + off;
+        if ((rc = copy_file_range(s->fd, &in, s->zfd, &out, len, 0)) == -1) {
+            if (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP)
+                DieSys(s->zpath);
+            if ((rc = pwrite(s->zfd, s->map + off, len, s->dst + off)) == -1)
+                DieSys(s->zpath);
+        } else if (!rc) {
+            Die(s->path, "file shrank while being copied");
+        }
+        off += rc;
+        len -= rc;
+    }
+}
+
+static void *CopySlice(void *arg) {
+    struct Slice *s = arg;
+    uint32_t crc = 0;
+    for (uint64_t i = 0; i < s->len; i += CHUNK) {
+        uint64_t n = Min(s->len - i, CHUNK);
+        crc = crc32(crc, s->map + s->off + i, n);
+        if (!s->cloned)
+            CopyRange(s, s->off + i, n);
+    }
+    s->crc = crc;
+    return 0;
+}
+
+// adds uncompressed asset to output at dst and returns its crc32. the
+// payload is reflinked or copied by the kernel, while the input memory
+// map is checksummed by a thread per slice, so that multi-gigabyte
+// weights don't need to pass through a single core's read buffer.
+static uint32_t CopyStored(const char *path, int fd, uint64_t size, const char *zpath, int zfd,
+                           uint64_t dst) {
+    if (!size)
+        return 0;
+    uint8_t *map;
+    if ((map = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+        DieSys(path);
+    madvise(map, size, MADV_SEQUENTIAL);
+    bool cloned = CloneFile(fd, zfd, dst);
+    int n = Min(Min(__get_cpu_count(), MAX_THREADS), (size + SLICE - 1) / SLICE);
+    if (n < 1)
+        n = 1;
+    uint64_t per = (size / n + CHUNK - 1) / CHUNK * CHUNK;
+    struct Slice slices[MAX_THREADS];
+    for (int i = 0; i < n; ++i) {
+        slices[i].path = path;
+        slices[i].zpath = zpath;
+        slices[i].map = map;
+        slices[i].fd = fd;
+        slices[i].zfd = zfd;
+        slices[i].cloned = cloned;
+        slices[i].off = Min(size, per * i);
+        slices[i].len = Min(size, per * (i + 1)) - slices[i].off;
+        slices[i].dst = dst;
+    }
+    for (int i = 1; i < n; ++i)
+        if ((errno = pthread_create(&slices[i].th, 0, CopySlice, slices + i)))
+            DieSys("pthread_create");
+    CopySlice(slices);
+    uint32_t crc = slices[0].crc;
+    for (int i = 1; i < n; ++i) {
+        if ((errno = pthread_join(slices[i].th, 0)))
+            DieSys("pthread_join");
+        crc = crc32_combine(crc, slices[i].crc, slices[i].len);
+    }
+    if (munmap(map, size))
+        DieSys(path);
+    if (flag_verbose > 1)
+        tinyprint(2, path, cloned ? ": reflinked" : ": copied", "\n", NULL);
+    return crc;
+}
+
 static void GetDosLocalTime(int64_t utcunixts, uint16_t *out_time, uint16_t *out_date) {
     struct tm tm;
     localtime_r(&utcunixts, &tm);
@@ -322,39 +442,36 @@ int main(int argc, char *argv[]) {
         uint64_t compsize = 0;
         _Alignas(4096) static uint8_t iobuf[CHUNK];
         _Alignas(4096) static uint8_t cdbuf[CHUNK];
-        for (off_t i = 0; i < size; i += rc) {
+        if (!flag_level) {
+            crc = CopyStored(path, fd, size, zpath, zfd, zsize + hdrlen);
+            compsize = size;
+        }
+        for (off_t i = 0; flag_level && i < size; i += rc) {
             // read chunk
             if ((rc = pread(fd, iobuf, Min(size, CHUNK), i)) <= 0)
                 DieSys(path);
             posix_fadvise(fd, i, Min(size, CHUNK), POSIX_FADV_DONTNEED);
             crc = crc32(crc, iobuf, rc);
-            if (!flag_level) {
-                // write uncompressed chunk to output
-                if (pwrite(zfd, iobuf, rc, zsize + hdrlen + compsize) != rc)
+            // compress chunk and write to output
+            zs.avail_in = rc;
+            zs.next_in = iobuf;
+            do {
+                zs.next_out = cdbuf;
+                zs.avail_out = CHUNK;
+                int boop;
+                switch ((boop = deflate(&zs, rc != CHUNK ? Z_FINISH : Z_FULL_FLUSH))) {
+                case Z_MEM_ERROR:
+                    DieOom();
+                case Z_STREAM_ERROR:
+                    npassert(!"deflate() stream error");
+                default:
+                    break;
+                }
+                ssize_t have = CHUNK - zs.avail_out;
+                if (pwrite(zfd, cdbuf, have, zsize + hdrlen + compsize) != have)
                     DieSys(zpath);
-                compsize += rc;
-            } else {
-                // compress chunk and write to output
-                zs.avail_in = rc;
-                zs.next_in = iobuf;
-                do {
-                    zs.next_out = cdbuf;
-                    zs.avail_out = CHUNK;
-                    int boop;
-                    switch ((boop = deflate(&zs, rc != CHUNK ? Z_FINISH : Z_FULL_FLUSH))) {
-                    case Z_MEM_ERROR:
-                        DieOom();
-                    case Z_STREAM_ERROR:
-                        npassert(!"deflate() stream error");
-                    default:
-                        break;
-                    }
-                    ssize_t have = CHUNK - zs.avail_out;
-                    if (pwrite(zfd, cdbuf, have, zsize + hdrlen + compsize) != have)
-                        DieSys(zpath);
-                    compsize += have;
-                } while (!zs.avail_out);
-            }
+                compsize += have;
+            } while (!zs.avail_out);
         }
         if (flag_level)
             npassert(deflateEnd(&zs) == Z_OK);
@@ -0,0 +1,430 @@
+// -*- mode:c;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=c ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llamafile.h"
+#include "zip.h"
+#include <cosmo.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+// process-wide index of zip central directories
+//
+// an archive is only parsed the first time it's used. its names then go
+// into a perfect hash table built with the hash and displace algorithm,
+// so looking up an asset costs one hash and a single name comparison no
+// matter how many files are stored inside the llamafile executable. the
+// file descriptor stays open, so entries can be read or mapped later on
+// without any further opens or scans of the central directory.
+//
+
+#define Min(a, b) ((a) < (b) ? (a) : (b))
+
+#define EMPTY 0xffffffffu
+#define MAX_DISPLACEMENT 65536
+
+struct llamafile_zip {
+    struct llamafile_zip *next;
+    char *path;
+    struct stat st;
+    int fd;
+    uint8_t *cdir;
+    uint32_t count;
+    struct llamafile_zip_entry *entries;
+    _Atomic(int64_t) *offsets;
+    uint32_t nslots;
+    uint32_t *slots;
+    uint32_t nbuckets;
+    uint32_t *disp;
+    int gguf_count;
+    const struct llamafile_zip_entry *gguf;
+};
+
+struct zip_key {
+    uint64_t hash;
+    uint32_t entry;
+    uint32_t bucket;
+    uint32_t bucket_size;
+};
+
+static pthread_mutex_t g_zip_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct llamafile_zip *g_zips;
+
+static uint64_t zip_hash(const char *s, size_t n) {
+    uint64_t h = 0xcbf29ce484222325;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+static uint32_t zip_slot(uint64_t hash, uint32_t disp, uint32_t nslots) {
+    uint64_t x = hash + (disp + 1) * 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    x ^= x >> 31;
+    return x % nslots;
+}
+
+static bool zip_same_name(const struct llamafile_zip_entry *a,
+                          const struct llamafile_zip_entry *b) {
+    return a->namelen == b->namelen && !memcmp(a->name, b->name, a->namelen);
+}
+
+static int zip_compare_names(const void *a, const void *b) {
+    const struct zip_key *x = a;
+    const struct zip_key *y = b;
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    return x->entry < y->entry ? -1 : x->entry > y->entry;
+}
+
+static int zip_compare_buckets(const void *a, const void *b) {
+    const struct zip_key *x = a;
+    const struct zip_key *y = b;
+    if (x->bucket_size != y->bucket_size)
+        return x->bucket_size > y->bucket_size ? -1 : 1;
+    return x->bucket < y->bucket ? -1 : x->bucket > y->bucket;
+}
+
+// builds the perfect hash table, or returns false if the names can't
+// be placed, in which case lookups fall back to scanning the entries
+static bool zip_build_table(struct llamafile_zip *zip) {
+    bool ok = false;
+    struct zip_key *keys;
+    uint32_t *sizes = 0;
+    if (!(keys = malloc(zip->count * sizeof(*keys))))
+        return false;
+
+    // entries of the same name are merged into the first one, so they
+    // can be reported as ambiguous, rather than being silently ignored
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < zip->count; ++i) {
+        keys[i].hash = zip_hash(zip->entries[i].name, zip->entries[i].namelen);
+        keys[i].entry = i;
+    }
+    qsort(keys, zip->count, sizeof(*keys), zip_compare_names);
+    for (uint32_t i = 0; i < zip->count; ++i) {
+        uint32_t j = n;
+        while (j-- > 0 && keys[j].hash == keys[i].hash)
+            if (zip_same_name(zip->entries + keys[j].entry, zip->entries + keys[i].entry))
+                break;
+        if (j != (uint32_t)-1 && keys[j].hash == keys[i].hash)
+            zip->entries[keys[j].entry].count++;
+        else
+            keys[n++] = keys[i];
+    }
+
+    // put about four names in each bucket, and place the largest buckets
+    // first, by searching for a displacement that lands all their names
+    // on free slots of the table
+    zip->nbuckets = n / 4 + 1;
+    zip->nslots = n + n / 8 + 1;
+    if (!(sizes = calloc(zip->nbuckets, sizeof(*sizes))) ||
+        !(zip->disp = calloc(zip->nbuckets, sizeof(*zip->disp))) ||
+        !(zip->slots = malloc(zip->nslots * sizeof(*zip->slots))))
+        goto Finish;
+    for (uint32_t i = 0; i < n; ++i)
+        sizes[keys[i].bucket = keys[i].hash % zip->nbuckets]++;
+    for (uint32_t i = 0; i < n; ++i)
+        keys[i].bucket_size = sizes[keys[i].bucket];
+    qsort(keys, n, sizeof(*keys), zip_compare_buckets);
+    for (uint32_t i = 0; i < zip->nslots; ++i)
+        zip->slots[i] = EMPTY;
+    for (uint32_t i = 0, j; i < n; i = j) {
+        for (j = i; j < n && keys[j].bucket == keys[i].bucket; ++j) {
+        }
+        uint32_t d;
+        for (d = 0; d < MAX_DISPLACEMENT; ++d) {
+            uint32_t k;
+            for (k = i; k < j; ++k) {
+                uint32_t s = zip_slot(keys[k].hash, d, zip->nslots);
+                if (zip->slots[s] != EMPTY)
+                    break;
+                zip->slots[s] = keys[k].entry;
+            }
+            if (k == j)
+                break;
+            while (k-- > i) // undo the partial placement
+                zip->slots[zip_slot(keys[k].hash, d, zip->nslots)] = EMPTY;
+        }
+        if (d == MAX_DISPLACEMENT)
+            goto Finish;
+        zip->disp[keys[i].bucket] = d;
+    }
+    ok = true;
+
+Finish:
+    if (!ok) {
+        free(zip->slots);
+        free(zip->disp);
+        zip->slots = 0;
+        zip->disp = 0;
+    }
+    free(sizes);
+    free(keys);
+    return ok;
+}
+
+static void zip_free(struct llamafile_zip *zip) {
+    if (zip->fd != -1)
+        close(zip->fd);
+    free(zip->offsets);
+    free(zip->entries);
+    free(zip->slots);
+    free(zip->disp);
+    free(zip->cdir);
+    free(zip->path);
+    free(zip);
+}
+
+static struct llamafile_zip *zip_load(const char *path) {
+    struct llamafile_zip *zip;
+    if (!(zip = calloc(1, sizeof(struct llamafile_zip))))
+        return 0;
+    if ((zip->fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+        free(zip);
+        return 0;
+    }
+    if (fstat(zip->fd, &zip->st) || !(zip->path = strdup(path)))
+        goto Failure;
+
+    // read the last 64kb of file
+    // the zip file format magic can be anywhere in there
+    int amt;
+    uint64_t off;
+    uint8_t *bufdata;
+    if (!(bufdata = gc(malloc(65536))))
+        goto Failure;
+    if (zip->st.st_size <= 65536) {
+        off = 0;
+        amt = zip->st.st_size;
+    } else {
+        off = zip->st.st_size - 65536;
+        amt = zip->st.st_size - off;
+    }
+    if (pread(zip->fd, bufdata, amt, off) != amt) {
+        fprintf(stderr, "%s: warning: failed to read last 64kb of file: %s\n", path,
+                strerror(errno));
+        goto Failure;
+    }
+
+    // search backwards for the end-of-central-directory record
+    // the eocd (cdir) says where the central directory (cfile) array is located
+    // we consistency check some legacy fields, to be extra sure that it is eocd
+    unsigned cnt = 0;
+    for (int i = amt - Min(kZipCdirHdrMinSize, kZipCdir64LocatorSize); i >= 0; --i) {
+        uint32_t magic = ZIP_READ32(bufdata + i);
+        if (magic == kZipCdir64LocatorMagic && i + kZipCdir64LocatorSize <= amt &&
+            pread(zip->fd, bufdata, kZipCdir64HdrMinSize, ZIP_LOCATE64_OFFSET(bufdata + i)) ==
+                (long)kZipCdir64HdrMinSize &&
+            ZIP_READ32(bufdata) == kZipCdir64HdrMagic &&
+            ZIP_CDIR64_RECORDS(bufdata) == ZIP_CDIR64_RECORDSONDISK(bufdata) &&
+            ZIP_CDIR64_RECORDS(bufdata) && ZIP_CDIR64_SIZE(bufdata) <= INT_MAX) {
+            cnt = ZIP_CDIR64_RECORDS(bufdata);
+            off = ZIP_CDIR64_OFFSET(bufdata);
+            amt = ZIP_CDIR64_SIZE(bufdata);
+            break;
+        }
+        if (magic == kZipCdirHdrMagic && i + kZipCdirHdrMinSize <= amt &&
+            ZIP_CDIR_RECORDS(bufdata + i) == ZIP_CDIR_RECORDSONDISK(bufdata + i) &&
+            ZIP_CDIR_RECORDS(bufdata + i) && ZIP_CDIR_SIZE(bufdata + i) <= INT_MAX &&
+            ZIP_CDIR_OFFSET(bufdata + i) != 0xffffffffu) {
+            cnt = ZIP_CDIR_RECORDS(bufdata + i);
+            off = ZIP_CDIR_OFFSET(bufdata + i);
+            amt = ZIP_CDIR_SIZE(bufdata + i);
+            break;
+        }
+    }
+    if (cnt <= 0) {
+        // this executable isn't a zip file
+        fprintf(stderr, "%s: warning: not a pkzip archive\n", path);
+        goto Invalid;
+    }
+
+    // read the central directory
+    // it's kept in memory, since the index points to the names inside it
+    size_t cdirsize = amt;
+    if (!(zip->cdir = malloc(cdirsize)))
+        goto Failure;
+    if (pread(zip->fd, zip->cdir, cdirsize, off) != (long)cdirsize) {
+        fprintf(stderr, "%s: warning: failed to pread zip cdir: %s\n", path, strerror(errno));
+        goto Failure;
+    }
+    if (ZIP_READ32(zip->cdir) != kZipCfileHdrMagic) {
+        fprintf(stderr, "%s: warning: failed to locate zip central directory\n", path);
+        goto Invalid;
+    }
+
+    // turn the directory into an array of entries
+    if (!(zip->entries = calloc(cnt, sizeof(struct llamafile_zip_entry))))
+        goto Failure;
+    unsigned entry_index, entry_offset;
+    for (entry_index = entry_offset = 0;
+         entry_index < cnt && entry_offset + kZipCfileHdrMinSize <= cdirsize &&
+         entry_offset + ZIP_CFILE_HDRSIZE(zip->cdir + entry_offset) <= cdirsize;
+         ++entry_index, entry_offset += ZIP_CFILE_HDRSIZE(zip->cdir + entry_offset)) {
+        const uint8_t *cfile = zip->cdir + entry_offset;
+        if (ZIP_CFILE_MAGIC(cfile) != kZipCfileHdrMagic) {
+            fprintf(stderr, "error: corrupted zip central directory entry magic: %s\n", path);
+            goto Invalid;
+        }
+        struct llamafile_zip_entry *e = zip->entries + zip->count++;
+        e->name = ZIP_CFILE_NAME(cfile);
+        e->namelen = ZIP_CFILE_NAMESIZE(cfile);
+        e->method = ZIP_CFILE_COMPRESSIONMETHOD(cfile);
+        e->count = 1;
+        e->lfile = get_zip_cfile_offset(cfile);
+        e->size = get_zip_cfile_compressed_size(cfile);
+        e->uncompressed_size = get_zip_cfile_uncompressed_size(cfile);
+    }
+    if (!(zip->offsets = malloc(zip->count * sizeof(*zip->offsets))))
+        goto Failure;
+    for (uint32_t i = 0; i < zip->count; ++i)
+        atomic_init(zip->offsets + i, -1);
+
+    // find the weights, for when no name is specified
+    for (uint32_t i = 0; i < zip->count; ++i) {
+        const struct llamafile_zip_entry *e = zip->entries + i;
+        if (e->namelen > 5 && !memcasecmp(e->name + e->namelen - 5, ".gguf", 5)) {
+            if (!zip->gguf_count++)
+                zip->gguf = e;
+        }
+    }
+
+    zip_build_table(zip);
+    return zip;
+
+Invalid:
+    errno = EINVAL;
+Failure:
+    zip_free(zip);
+    return 0;
+}
+
+/**
+ * Returns central directory index of zip archive at `path`.
+ *
+ * The archive is parsed the first time this is called, and the index is
+ * then shared by all threads for the rest of the process. An index gets
+ * rebuilt if its file is modified, with the exception of our executable
+ * which is trusted not to change while it's running.
+ *
+ * @return index, or NULL w/ errno if the archive couldn't be read
+ */
+struct llamafile_zip *llamafile_zip_index(const char *path) {
+    struct stat st;
+    struct llamafile_zip *zip;
+    bool self = !strcmp(path, GetProgramExecutableName());
+    if (!self && stat(path, &st))
+        return 0;
+    pthread_mutex_lock(&g_zip_lock);
+    for (zip = g_zips; zip; zip = zip->next)
+        if (!strcmp(zip->path, path) &&
+            (self || (zip->st.st_dev == st.st_dev && zip->st.st_ino == st.st_ino &&
+                      zip->st.st_size == st.st_size &&
+                      zip->st.st_mtim.tv_sec == st.st_mtim.tv_sec &&
+                      zip->st.st_mtim.tv_nsec == st.st_mtim.tv_nsec)))
+            break;
+    if (!zip && (zip = zip_load(path))) {
+        // stale indexes are never freed, since their entries may still be in use
+        zip->next = g_zips;
+        g_zips = zip;
+    }
+    pthread_mutex_unlock(&g_zip_lock);
+    return zip;
+}
+
+/**
+ * Returns file descriptor of indexed archive.
+ *
+ * This descriptor is owned by the index and must not be closed, nor can
+ * its file position be used. Use pread() or mmap() instead.
+ */
+int llamafile_zip_fd(struct llamafile_zip *zip) {
+    return zip->fd;
+}
+
+/**
+ * Looks up zip entry by name.
+ *
+ * If multiple entries have the same name, then the first one is returned
+ * and its `count` field says how many there are.
+ *
+ * @return entry, or NULL if it doesn't exist
+ */
+const struct llamafile_zip_entry *llamafile_zip_find(struct llamafile_zip *zip, const char *name,
+                                                     size_t namelen) {
+    struct llamafile_zip_entry key = {.name = name, .namelen = namelen};
+    if (zip->slots) {
+        uint64_t hash = zip_hash(name, namelen);
+        uint32_t disp = zip->disp[hash % zip->nbuckets];
+        uint32_t i = zip->slots[zip_slot(hash, disp, zip->nslots)];
+        if (i != EMPTY && zip_same_name(zip->entries + i, &key))
+            return zip->entries + i;
+        return 0;
+    }
+    for (uint32_t i = 0; i < zip->count; ++i)
+        if (zip_same_name(zip->entries + i, &key))
+            return zip->entries + i;
+    return 0;
+}
+
+/**
+ * Returns the .gguf file in archive, and how many of them there are.
+ */
+const struct llamafile_zip_entry *llamafile_zip_find_gguf(struct llamafile_zip *zip, int *count) {
+    *count = zip->gguf_count;
+    return zip->gguf;
+}
+
+/**
+ * Returns offset of entry content within archive.
+ *
+ * This needs to read the local file header the first time it's called
+ * for a given entry. The result is remembered afterwards.
+ *
+ * @return file offset, or -1 w/ errno
+ */
+int64_t llamafile_zip_offset(struct llamafile_zip *zip, const struct llamafile_zip_entry *e) {
+    _Atomic(int64_t) *cache = zip->offsets + (e - zip->entries);
+    int64_t off = atomic_load_explicit(cache, memory_order_relaxed);
+    if (off != -1)
+        return off;
+    uint8_t lfile[kZipLfileHdrMinSize];
+    if (pread(zip->fd, lfile, kZipLfileHdrMinSize, e->lfile) != kZipLfileHdrMinSize) {
+        errno = EIO;
+        return -1;
+    }
+    if (ZIP_LFILE_MAGIC(lfile) != kZipLfileHdrMagic) {
+        errno = EINVAL;
+        return -1;
+    }
+    off = e->lfile + ZIP_LFILE_HDRSIZE(lfile);
+    atomic_store_explicit(cache, off, memory_order_relaxed);
+    return off;
+}
@@ -363,6 +363,8 @@ struct ControlNet : public GGMLRunner {
         guided_hint        = NULL;
         guided_hint_cached = false;
         controls.clear();
+        // the graph writes into the tensors that were just freed
+        free_reusable_graph();
     }
 
     std::string get_desc() {
@@ -426,7 +428,14 @@ struct ControlNet : public GGMLRunner {
             return build_graph(x, hint, timesteps, context, y);
         };
 
-        GGMLRunner::compute(get_graph, n_threads, false, output, output_ctx);
+        // once the hint has been through its own layers, the graph starts
+        // from the cached result instead
+        GGMLRunner::compute_reusable(get_graph,
+                                     {x, guided_hint_cached ? NULL : hint, timesteps, context, y},
+                                     {(float)guided_hint_cached},
+                                     n_threads,
+                                     output,
+                                     output_ctx);
         guided_hint_cached = true;
     }
 
@@ -887,6 +887,16 @@ protected:
 
     std::map<struct ggml_tensor*, const void*> backend_tensor_data_map;
 
+    // graph kept by compute_reusable() for as long as its inputs keep their
+    // shapes, together with the graph tensors each input is copied into
+    struct ggml_cgraph* reusable_graph = NULL;
+    std::vector<int64_t> reusable_graph_key;
+    std::vector<std::pair<size_t, struct ggml_tensor*>> reusable_graph_slots;  // (index of input, graph tensor)
+
+    // (input, graph tensor) for each to_backend() call while building it
+    bool building_reusable_graph = false;
+    std::vector<std::pair<struct ggml_tensor*, struct ggml_tensor*>> reusable_graph_bindings;
+
     ggml_type wtype        = GGML_TYPE_F32;
     ggml_backend_t backend = NULL;
 
@@ -918,12 +928,49 @@ protected:
     }
 
     void free_compute_ctx() {
+        free_reusable_graph();
         if (compute_ctx != NULL) {
             ggml_free(compute_ctx);
             compute_ctx = NULL;
         }
     }
 
+    void free_reusable_graph() {
+        reusable_graph = NULL;
+        reusable_graph_key.clear();
+        reusable_graph_slots.clear();
+        reusable_graph_bindings.clear();
+    }
+
+    std::vector<int64_t> get_reusable_graph_key(const std::vector<struct ggml_tensor*>& inputs,
+                                                const std::vector<float>& params) {
+        std::vector<int64_t> key;
+        key.push_back(inputs.size());
+        for (auto tensor : inputs) {
+            if (tensor == NULL) {
+                key.push_back(-1);
+                continue;
+            }
+            key.push_back(tensor->type);
+            key.insert(key.end(), tensor->ne, tensor->ne + GGML_MAX_DIMS);
+        }
+        for (float param : params) {
+            uint32_t bits;
+            memcpy(&bits, &param, sizeof(bits));
+            key.push_back(bits);
+        }
+        return key;
+    }
+
+    // copies an input into its graph tensor, wherever either of them lives
+    void set_graph_input(struct ggml_tensor* slot, struct ggml_tensor* tensor) {
+        if (tensor->buffer == NULL || ggml_backend_buffer_is_host(tensor->buffer)) {
+            ggml_backend_tensor_set(slot, tensor->data, 0, ggml_nbytes(slot));
+        } else {
+            ggml_backend_tensor_copy(tensor, slot);
+        }
+    }
+
     bool alloc_compute_buffer(get_graph_cb_t get_graph) {
         if (compute_allocr != NULL) {
             return true;
@@ -1013,6 +1060,7 @@ public:
     }
 
     void free_compute_buffer() {
+        free_reusable_graph();
         if (compute_allocr != NULL) {
             ggml_gallocr_free(compute_allocr);
             compute_allocr = NULL;
@@ -1029,6 +1077,13 @@ public:
         if (tensor == NULL) {
             return NULL;
         }
+        // a graph that's reused reads its inputs from tensors of its own,
+        // which get refilled for every run
+        if (building_reusable_graph) {
+            auto graph_tensor = ggml_dup_tensor(compute_ctx, tensor);
+            reusable_graph_bindings.push_back({tensor, graph_tensor});
+            return graph_tensor;
+        }
         // it's performing a compute, check if backend isn't cpu
         if (!ggml_backend_is_cpu(backend) && (tensor->buffer == NULL || ggml_backend_buffer_is_host(tensor->buffer))) {
             // pass input tensors to gpu memory
@@ -1051,6 +1106,74 @@ public:
         struct ggml_cgraph* gf = get_graph();
         GGML_ASSERT(ggml_gallocr_alloc_graph(compute_allocr, gf));
         cpy_data_to_backend_tensor();
+        graph_compute(gf, n_threads, output, output_ctx);
+
+        if (free_compute_buffer_immediately) {
+            free_compute_buffer();
+        }
+    }
+
+    // computes a graph that's built from the same inputs many times in a
+    // row, like the diffusion model at every sampling step. the graph and
+    // its allocation are kept, and only built again once the shape of an
+    // input, or one of the params the graph was built with, changes. until
+    // then, the inputs are just copied into the graph. every tensor handed
+    // to to_backend() by get_graph must be one of the inputs, or the graph
+    // is built again on the next call, like compute() would
+    void compute_reusable(get_graph_cb_t get_graph,
+                          const std::vector<struct ggml_tensor*>& inputs,
+                          const std::vector<float>& params,
+                          int n_threads,
+                          struct ggml_tensor** output     = NULL,
+                          struct ggml_context* output_ctx = NULL) {
+        std::vector<int64_t> key = get_reusable_graph_key(inputs, params);
+
+        if (reusable_graph == NULL || key != reusable_graph_key) {
+            building_reusable_graph = true;
+            alloc_compute_buffer(get_graph);
+            reset_compute_ctx();
+            struct ggml_cgraph* gf = get_graph();
+            building_reusable_graph = false;
+            GGML_ASSERT(ggml_gallocr_alloc_graph(compute_allocr, gf));
+
+            bool reusable = backend_tensor_data_map.empty();
+            cpy_data_to_backend_tensor();
+
+            for (auto& binding : reusable_graph_bindings) {
+                auto it = std::find(inputs.begin(), inputs.end(), binding.first);
+                if (it == inputs.end()) {
+                    reusable = false;
+                    set_graph_input(binding.second, binding.first);
+                } else {
+                    reusable_graph_slots.push_back({(size_t)(it - inputs.begin()), binding.second});
+                }
+            }
+            reusable_graph_bindings.clear();
+
+            if (!reusable) {
+                for (auto& slot : reusable_graph_slots) {
+                    set_graph_input(slot.second, inputs[slot.first]);
+                }
+                graph_compute(gf, n_threads, output, output_ctx);
+                free_reusable_graph();
+                return;
+            }
+
+            reusable_graph     = gf;
+            reusable_graph_key = key;
+        }
+
+        for (auto& slot : reusable_graph_slots) {
+            set_graph_input(slot.second, inputs[slot.first]);
+        }
+        graph_compute(reusable_graph, n_threads, output, output_ctx);
+    }
+
+private:
+    void graph_compute(struct ggml_cgraph* gf,
+                       int n_threads,
+                       struct ggml_tensor** output,
+                       struct ggml_context* output_ctx) {
         if (ggml_backend_is_cpu(backend)) {
             ggml_backend_cpu_set_n_threads(backend, n_threads);
         }
@@ -1074,10 +1197,6 @@ public:
                 ggml_backend_tensor_get_and_sync(backend, result, (*output)->data, 0, ggml_nbytes(*output));
             }
         }
-
-        if (free_compute_buffer_immediately) {
-            free_compute_buffer();
-        }
     }
 };
 
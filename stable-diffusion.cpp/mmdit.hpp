@@ -719,7 +719,7 @@ struct MMDiTRunner : public GGMLRunner {
             return build_graph(x, timesteps, context, y);
         };
 
-        GGMLRunner::compute(get_graph, n_threads, false, output, output_ctx);
+        GGMLRunner::compute_reusable(get_graph, {x, timesteps, context, y}, {}, n_threads, output, output_ctx);
     }
 
     void test() {
@@ -690,6 +690,80 @@ public:
         }
         struct ggml_tensor* denoised = ggml_dup_tensor(work_ctx, x);
 
+        // with guidance, cond and uncond go through the model as one batch of
+        // two, so that each weight is read once per step instead of twice.
+        // that takes conditions of the same shape and a single latent, since
+        // the frames of a video are a batch already
+        //
+        // the batch gets a context of its own, sized from the tensors that go
+        // in it, i.e. the latent and model output twice over each, and every
+        // condition that may be batched, so it can't run out of room
+        auto batch_nbytes = [](ggml_tensor* t) -> size_t {
+            return t == NULL ? 0 : ggml_tensor_overhead() + GGML_PAD(ggml_nbytes(t), GGML_MEM_ALIGN);
+        };
+        size_t batch_mem_size = 2 * 2 * batch_nbytes(x);
+        for (const SDCondition* c : {&cond, &id_cond}) {
+            batch_mem_size += 2 * batch_nbytes(c->c_crossattn);
+            batch_mem_size += 2 * batch_nbytes(c->c_vector);
+        }
+        batch_mem_size += 2 * 2 * batch_nbytes(cond.c_concat);
+        struct ggml_init_params batch_params;
+        batch_params.mem_size   = batch_mem_size;
+        batch_params.mem_buffer = NULL;
+        batch_params.no_alloc   = false;
+        ggml_context* batch_ctx = NULL;
+        if (has_unconditioned && x->ne[3] == 1) {
+            batch_ctx = ggml_init(batch_params);
+        }
+
+        auto batch_with_uncond = [&](const SDCondition& c) -> SDCondition {
+            auto can_concat = [](ggml_tensor* a, ggml_tensor* b, int dim) {
+                if (a == NULL || b == NULL) {
+                    return a == b;
+                }
+                return ggml_are_same_shape(a, b) && a->type == GGML_TYPE_F32 && b->type == GGML_TYPE_F32 &&
+                       ggml_n_dims(a) <= dim;
+            };
+            if (batch_ctx == NULL || c.c_crossattn == NULL ||
+                !can_concat(c.c_crossattn, uncond.c_crossattn, 2) ||
+                !can_concat(c.c_vector, uncond.c_vector, 1) ||
+                !can_concat(c.c_concat, uncond.c_concat, 3)) {
+                return {};
+            }
+            SDCondition batched;
+            batched.c_crossattn = ggml_tensor_concat(batch_ctx, c.c_crossattn, uncond.c_crossattn, 2);
+            if (c.c_vector != NULL) {
+                batched.c_vector = ggml_tensor_concat(batch_ctx, c.c_vector, uncond.c_vector, 1);
+            }
+            if (c.c_concat != NULL) {
+                batched.c_concat = ggml_tensor_concat(batch_ctx, c.c_concat, uncond.c_concat, 3);
+            }
+            return batched;
+        };
+
+        SDCondition cond_batch = batch_with_uncond(cond);
+        SDCondition id_cond_batch;
+        if (start_merge_step != -1) {
+            id_cond_batch = batch_with_uncond(SDCondition(id_cond.c_crossattn, id_cond.c_vector, cond.c_concat));
+        }
+
+        struct ggml_tensor* input_batch = NULL;
+        struct ggml_tensor* out_batch   = NULL;
+        if (cond_batch.c_crossattn != NULL || id_cond_batch.c_crossattn != NULL) {
+            input_batch = ggml_new_tensor_4d(batch_ctx, GGML_TYPE_F32, x->ne[0], x->ne[1], x->ne[2], 2);
+            out_batch   = ggml_dup_tensor(batch_ctx, input_batch);
+        }
+
+        auto compute_controls = [&](ggml_tensor* input, ggml_tensor* timesteps, const SDCondition& c) {
+            // the outputs are kept between steps, so they're only reused at
+            // the batch size they were made for
+            if (!control_net->controls.empty() && control_net->controls[0]->ne[3] != input->ne[3]) {
+                control_net->free_control_ctx();
+            }
+            control_net->compute(n_threads, input, control_hint, timesteps, c.c_crossattn, c.c_vector);
+            return control_net->controls;
+        };
+
         auto denoise = [&](ggml_tensor* input, float sigma, int step) -> ggml_tensor* {
             if (step == 1) {
                 pretty_progress(0, (int)steps, 0);
@@ -703,70 +777,86 @@ public:
             float c_in   = scaling[2];
 
             float t = denoiser->sigma_to_t(sigma);
-            std::vector<float> timesteps_vec(x->ne[3], t);  // [N, ]
-            auto timesteps = vector_to_ggml_tensor(work_ctx, timesteps_vec);
 
             copy_ggml_tensor(noised_input, input);
             // noised_input = noised_input * c_in
             ggml_tensor_scale(noised_input, c_in);
 
+            const bool use_id_cond = start_merge_step != -1 && step > start_merge_step;
+            SDCondition positive   = use_id_cond ? SDCondition(id_cond.c_crossattn, id_cond.c_vector, cond.c_concat) : cond;
+            SDCondition& batched   = use_id_cond ? id_cond_batch : cond_batch;
+
             std::vector<struct ggml_tensor*> controls;
 
-            if (control_hint != NULL) {
-                control_net->compute(n_threads, noised_input, control_hint, timesteps, cond.c_crossattn, cond.c_vector);
-                controls = control_net->controls;
-                // print_ggml_tensor(controls[12]);
-                // GGML_ASSERT(0);
-            }
+            float* positive_data = NULL;
+            float* negative_data = NULL;
+            if (batched.c_crossattn != NULL) {
+                // cond and uncond
+                std::vector<float> timesteps_vec(input_batch->ne[3], t);  // [N, ]
+                auto timesteps = vector_to_ggml_tensor(work_ctx, timesteps_vec);
 
-            if (start_merge_step == -1 || step <= start_merge_step) {
-                // cond
+                memcpy(input_batch->data, noised_input->data, ggml_nbytes(noised_input));
+                memcpy((char*)input_batch->data + ggml_nbytes(noised_input), noised_input->data, ggml_nbytes(noised_input));
+
+                if (control_hint != NULL) {
+                    controls = compute_controls(input_batch, timesteps, cond_batch.c_crossattn != NULL ? cond_batch : batched);
+                }
                 diffusion_model->compute(n_threads,
-                                         noised_input,
+                                         input_batch,
                                          timesteps,
-                                         cond.c_crossattn,
-                                         cond.c_concat,
-                                         cond.c_vector,
+                                         batched.c_crossattn,
+                                         batched.c_concat,
+                                         batched.c_vector,
                                          -1,
                                          controls,
                                          control_strength,
-                                         &out_cond);
+                                         &out_batch);
+                positive_data = (float*)out_batch->data;
+                negative_data = positive_data + ggml_nelements(out_cond);
             } else {
-                diffusion_model->compute(n_threads,
-                                         noised_input,
-                                         timesteps,
-                                         id_cond.c_crossattn,
-                                         cond.c_concat,
-                                         id_cond.c_vector,
-                                         -1,
-                                         controls,
-                                         control_strength,
-                                         &out_cond);
-            }
+                std::vector<float> timesteps_vec(x->ne[3], t);  // [N, ]
+                auto timesteps = vector_to_ggml_tensor(work_ctx, timesteps_vec);
 
-            float* negative_data = NULL;
-            if (has_unconditioned) {
-                // uncond
                 if (control_hint != NULL) {
-                    control_net->compute(n_threads, noised_input, control_hint, timesteps, uncond.c_crossattn, uncond.c_vector);
-                    controls = control_net->controls;
+                    controls = compute_controls(noised_input, timesteps, cond);
+                    // print_ggml_tensor(controls[12]);
+                    // GGML_ASSERT(0);
                 }
+
+                // cond
                 diffusion_model->compute(n_threads,
                                          noised_input,
                                          timesteps,
-                                         uncond.c_crossattn,
-                                         uncond.c_concat,
-                                         uncond.c_vector,
+                                         positive.c_crossattn,
+                                         positive.c_concat,
+                                         positive.c_vector,
                                          -1,
                                          controls,
                                          control_strength,
-                                         &out_uncond);
-                negative_data = (float*)out_uncond->data;
+                                         &out_cond);
+                positive_data = (float*)out_cond->data;
+
+                if (has_unconditioned) {
+                    // uncond
+                    if (control_hint != NULL) {
+                        controls = compute_controls(noised_input, timesteps, uncond);
+                    }
+                    diffusion_model->compute(n_threads,
+                                             noised_input,
+                                             timesteps,
+                                             uncond.c_crossattn,
+                                             uncond.c_concat,
+                                             uncond.c_vector,
+                                             -1,
+                                             controls,
+                                             control_strength,
+                                             &out_uncond);
+                    negative_data = (float*)out_uncond->data;
+                }
             }
-            float* vec_denoised  = (float*)denoised->data;
-            float* vec_input     = (float*)input->data;
-            float* positive_data = (float*)out_cond->data;
-            int ne_elements      = (int)ggml_nelements(denoised);
+            float* vec_denoised = (float*)denoised->data;
+            float* vec_input    = (float*)input->data;
+            int ne_elements     = (int)ggml_nelements(denoised);
             for (int i = 0; i < ne_elements; i++) {
                 float latent_result = positive_data[i];
                 if (has_unconditioned) {
@@ -800,6 +890,9 @@ public:
             control_net->free_compute_buffer();
         }
         diffusion_model->free_compute_buffer();
+        if (batch_ctx != NULL) {
+            ggml_free(batch_ctx);
+        }
         return x;
     }
 
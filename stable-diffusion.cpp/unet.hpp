@@ -562,6 +562,7 @@ struct UNetModelRunner : public GGMLRunner {
 
         x         = to_backend(x);
         context   = to_backend(context);
+        c_concat  = to_backend(c_concat);
         y         = to_backend(y);
         timesteps = to_backend(timesteps);
 
@@ -604,7 +605,10 @@ struct UNetModelRunner : public GGMLRunner {
             return build_graph(x, timesteps, context, c_concat, y, num_video_frames, controls, control_strength);
         };
 
-        GGMLRunner::compute(get_graph, n_threads, false, output, output_ctx);
+        std::vector<struct ggml_tensor*> inputs = {x, timesteps, context, c_concat, y};
+        inputs.insert(inputs.end(), controls.begin(), controls.end());
+
+        GGMLRunner::compute_reusable(get_graph, inputs, {(float)num_video_frames, control_strength}, n_threads, output, output_ctx);
     }
 
     void test() {
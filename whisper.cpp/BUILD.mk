@@ -48,7 +48,33 @@ o/$(MODE)/whisper.cpp/mic2raw:				\
 		o/$(MODE)/whisper.cpp/whisper.cpp.a	\
 		o/$(MODE)/llama.cpp/llama.cpp.a		\
 
+o/$(MODE)/whisper.cpp/fft_test:			\
+		o/$(MODE)/whisper.cpp/fft_test.o	\
+		o/$(MODE)/whisper.cpp/whisper.cpp.a	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
+o/$(MODE)/whisper.cpp/cache_test:			\
+		o/$(MODE)/whisper.cpp/cache_test.o	\
+		o/$(MODE)/whisper.cpp/whisper.cpp.a	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
+o/$(MODE)/whisper.cpp/vad_test:			\
+		o/$(MODE)/whisper.cpp/vad_test.o	\
+		o/$(MODE)/whisper.cpp/whisper.cpp.a	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
+o/$(MODE)/whisper.cpp/batch_test:			\
+		o/$(MODE)/whisper.cpp/batch_test.o	\
+		o/$(MODE)/whisper.cpp/whisper.cpp.a	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
+o/$(MODE)/whisper.cpp/decode_bench:			\
+		o/$(MODE)/whisper.cpp/decode_bench.o	\
+		o/$(MODE)/whisper.cpp/whisper.cpp.a	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
 o/$(MODE)/whisper.cpp/miniaudio.o: private COPTS += -O3
+o/$(MODE)/whisper.cpp/whisper-fft.o: private COPTS += -O3
 
 $(WHISPER_CPP_OBJS): whisper.cpp/BUILD.mk
 
@@ -58,3 +84,8 @@ o/$(MODE)/whisper.cpp:					\
 		o/$(MODE)/whisper.cpp/stream		\
 		o/$(MODE)/whisper.cpp/mic2txt		\
 		o/$(MODE)/whisper.cpp/mic2raw		\
+		o/$(MODE)/whisper.cpp/fft_test.runs	\
+		o/$(MODE)/whisper.cpp/cache_test.runs	\
+		o/$(MODE)/whisper.cpp/vad_test.runs	\
+		o/$(MODE)/whisper.cpp/batch_test	\
+		o/$(MODE)/whisper.cpp/decode_bench	\
@@ -0,0 +1,259 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+
+//
+// batched encoding and shared beam decoding equivalence test
+//
+// encodes several windows one at a time and then as a single batch, and
+// checks that the decoder sees the same cross-attention memory either way,
+// with the batch encoding into fresh states.
+// it then runs beam search, which shares kv cache cells between beams that
+// have a common prefix, and checks the logits every beam saw against the
+// logits of decoding its tokens from scratch as a single sequence.
+//
+//     make -j o//whisper.cpp/batch_test
+//     o//whisper.cpp/batch_test -m ggml-tiny.en.bin -f whisper.cpp/jfk.wav
+//
+
+#include "slurp.h"
+#include "whisper.h"
+#include "llamafile/llamafile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#define TOLERANCE 1e-2
+
+struct step {
+    std::vector<whisper_token> tokens;
+    std::vector<float> logits;
+};
+
+static int n_threads = std::min(4, (int) std::thread::hardware_concurrency());
+
+static std::vector<whisper_token> prompt_init(whisper_context * ctx) {
+    std::vector<whisper_token> prompt = {whisper_token_sot(ctx)};
+    if (whisper_is_multilingual(ctx)) {
+        prompt.push_back(whisper_token_lang(ctx, whisper_lang_id("en")));
+        prompt.push_back(whisper_token_transcribe(ctx));
+    }
+    return prompt;
+}
+
+// logits of the next token after decoding tokens from an empty kv cache
+static bool decode(whisper_context * ctx, whisper_state * state,
+                   const std::vector<whisper_token> & tokens, std::vector<float> & logits) {
+    if (whisper_decode_with_state(ctx, state, tokens.data(), tokens.size(), 0, n_threads)) {
+        return false;
+    }
+    const float * p = whisper_get_logits_from_state(state);
+    logits.assign(p, p + whisper_n_vocab(ctx));
+    return true;
+}
+
+// worst difference between logits, relative to their size, ignoring
+// the ones the sampler had already suppressed
+static double compare(const std::vector<float> & got, const std::vector<float> & want) {
+    double worst = 0;
+    for (size_t i = 0; i < got.size(); ++i) {
+        if (std::isinf(got[i])) {
+            continue;
+        }
+        worst = std::max(worst, fabs(got[i] - want[i]) / (1 + fabs(want[i])));
+    }
+    return worst;
+}
+
+// state whose spectrogram is the audio after skipping some seconds
+static whisper_state * init_state(whisper_context * ctx, const std::vector<float> & pcm, int i) {
+    const int skip = std::min<int>(pcm.size() / 2, i * 2 * WHISPER_SAMPLE_RATE);
+    whisper_state * state = whisper_init_state(ctx);
+    if (state &&
+        whisper_pcm_to_mel_with_state(ctx, state, pcm.data() + skip, pcm.size() - skip, n_threads)) {
+        whisper_free_state(state);
+        return nullptr;
+    }
+    return state;
+}
+
+static int test_encode_batch(whisper_context * ctx, const std::vector<float> & pcm) {
+    const int n_batch = 3;
+    const std::vector<whisper_token> prompt = prompt_init(ctx);
+
+    // the batch gets states of its own, so nothing the sequential pass
+    // left behind in the cross-attention memory can make it look right
+    whisper_state * states[n_batch];
+    whisper_state * batch[n_batch];
+    int offsets[n_batch] = {};
+    for (int i = 0; i < n_batch; ++i) {
+        states[i] = init_state(ctx, pcm, i);
+        batch[i] = init_state(ctx, pcm, i);
+        if (!states[i] || !batch[i]) {
+            fprintf(stderr, "%s:%d: failed to compute spectrogram\n", __FILE__, __LINE__);
+            return 2;
+        }
+    }
+
+    std::vector<float> want[n_batch];
+    for (int i = 0; i < n_batch; ++i) {
+        if (whisper_encode_with_state(ctx, states[i], offsets[i], n_threads) ||
+            !decode(ctx, states[i], prompt, want[i])) {
+            fprintf(stderr, "%s:%d: failed to encode window %d\n", __FILE__, __LINE__, i);
+            return 3;
+        }
+    }
+
+    // the windows need to be further apart than the tolerance, or a batch
+    // that wrote each result into the wrong state would still pass
+    for (int i = 0; i < n_batch; ++i) {
+        for (int j = 0; j < i; ++j) {
+            if (compare(want[i], want[j]) <= 2 * TOLERANCE) {
+                fprintf(stderr, "%s:%d: windows %d and %d look the same\n",
+                        __FILE__, __LINE__, j, i);
+                return 4;
+            }
+        }
+    }
+
+    if (whisper_encode_batch_with_state(ctx, batch, offsets, n_batch, n_threads)) {
+        fprintf(stderr, "%s:%d: failed to encode batch\n", __FILE__, __LINE__);
+        return 5;
+    }
+
+    int rc = 0;
+    for (int i = 0; i < n_batch; ++i) {
+        std::vector<float> got;
+        if (!decode(ctx, batch[i], prompt, got)) {
+            fprintf(stderr, "%s:%d: failed to decode window %d\n", __FILE__, __LINE__, i);
+            return 6;
+        }
+        double err = compare(got, want[i]);
+        fprintf(stderr, "%12g relative error worst (batched encode, window %d)\n", err, i);
+        if (err > TOLERANCE) {
+            rc = 7;
+        }
+    }
+
+    for (int i = 0; i < n_batch; ++i) {
+        whisper_free_state(batch[i]);
+        whisper_free_state(states[i]);
+    }
+    return rc;
+}
+
+static void on_logits(whisper_context * ctx, whisper_state * state, const whisper_token_data * tokens,
+                      int n_tokens, float * logits, void * user_data) {
+    std::vector<step> & steps = *(std::vector<step> *) user_data;
+    step s;
+    for (int i = 0; i < n_tokens; ++i) {
+        s.tokens.push_back(tokens[i].id);
+    }
+    s.logits.assign(logits, logits + whisper_n_vocab(ctx));
+    steps.push_back(std::move(s));
+}
+
+static int test_beam_search(whisper_context * ctx, const std::vector<float> & pcm) {
+    std::vector<step> steps;
+
+    whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_BEAM_SEARCH);
+    wparams.n_threads                        = n_threads;
+    wparams.print_progress                   = false;
+    wparams.print_realtime                   = false;
+    wparams.print_timestamps                 = false;
+    wparams.language                         = "en";
+    wparams.temperature_inc                  = 0.0f; // no fallback, so every step is from the first window
+    wparams.beam_search.beam_size            = 5;
+    wparams.logits_filter_callback           = on_logits;
+    wparams.logits_filter_callback_user_data = &steps;
+
+    // one window, so the prompt of every step is known
+    const int n_samples = std::min<int>(pcm.size(), 29 * WHISPER_SAMPLE_RATE);
+    if (whisper_full(ctx, wparams, pcm.data(), n_samples)) {
+        fprintf(stderr, "%s:%d: failed to transcribe\n", __FILE__, __LINE__);
+        return 8;
+    }
+    for (int i = 0; i < whisper_full_n_segments(ctx); ++i) {
+        fprintf(stderr, "%s", whisper_full_get_segment_text(ctx, i));
+    }
+    fprintf(stderr, "\n");
+
+    whisper_state * state = whisper_init_state(ctx);
+    if (!state ||
+        whisper_pcm_to_mel_with_state(ctx, state, pcm.data(), n_samples, n_threads) ||
+        whisper_encode_with_state(ctx, state, 0, n_threads)) {
+        fprintf(stderr, "%s:%d: failed to encode\n", __FILE__, __LINE__);
+        return 9;
+    }
+
+    double worst = 0;
+    for (const step & s : steps) {
+        std::vector<whisper_token> tokens = prompt_init(ctx);
+        tokens.insert(tokens.end(), s.tokens.begin(), s.tokens.end());
+        std::vector<float> want;
+        if (!decode(ctx, state, tokens, want)) {
+            fprintf(stderr, "%s:%d: failed to decode\n", __FILE__, __LINE__);
+            return 10;
+        }
+        worst = std::max(worst, compare(s.logits, want));
+    }
+    fprintf(stderr, "%12g relative error worst (beam search, %zu steps)\n", worst, steps.size());
+
+    whisper_free_state(state);
+
+    if (steps.empty() || worst > TOLERANCE) {
+        return 11;
+    }
+    return 0;
+}
+
+int main(int argc, char ** argv) {
+    const char * model = nullptr;
+    const char * fname = "whisper.cpp/jfk.wav";
+
+    FLAG_log_disable = true;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+            model = argv[++i];
+        } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            fname = argv[++i];
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            n_threads = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s -m MODEL [-f WAV] [-t THREADS]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!model) {
+        fprintf(stderr, "%s: missing -m model\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<float> pcmf32;
+    std::vector<std::vector<float>> pcmf32s;
+    if (!slurp_audio_file(fname, pcmf32, pcmf32s, false)) {
+        fprintf(stderr, "%s: failed to read audio file\n", fname);
+        return 1;
+    }
+
+    whisper_context_params cparams = whisper_context_default_params();
+    cparams.cache_size = 0; // so every window really gets encoded
+    whisper_context * ctx = whisper_init_from_file_with_params(model, cparams);
+    if (!ctx) {
+        fprintf(stderr, "%s: failed to load model\n", model);
+        return 1;
+    }
+
+    int rc;
+    if ((rc = test_encode_batch(ctx, pcmf32)) || (rc = test_beam_search(ctx, pcmf32))) {
+        whisper_free(ctx);
+        return rc;
+    }
+
+    whisper_free(ctx);
+    return 0;
+}
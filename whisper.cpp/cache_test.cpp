@@ -0,0 +1,138 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+
+//
+// encoder cache unit test
+//
+// checks that entries are told apart by every field of their key, that
+// the least recently used entries are the ones dropped once the budget
+// is exceeded, and that audio hashes depend on every sample.
+//
+//     make -j o//whisper.cpp/cache_test
+//     o//whisper.cpp/cache_test
+//
+
+#include "whisper-cache.hpp"
+#include <cstdio>
+#include <vector>
+
+#define CHECK(x)                                                                                  \
+    do {                                                                                          \
+        if (!(x)) {                                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x);                 \
+            return 1;                                                                             \
+        }                                                                                         \
+    } while (0)
+
+static whisper_cache_value value(size_t size, int n_len) {
+    whisper_cache_value v;
+    v.data.resize(size, n_len);
+    v.n_len = n_len;
+    v.n_len_org = n_len;
+    return v;
+}
+
+static whisper_cache_key key(uint64_t audio, int offset) {
+    return {audio, 16000, WHISPER_CACHE_CROSS, offset, 1500};
+}
+
+static int test_get_put() {
+    whisper_cache cache(100);
+    CHECK(!cache.get(key(1, 0)));
+    cache.put(key(1, 0), value(10, 7));
+    auto v = cache.get(key(1, 0));
+    CHECK(v && v->n_len == 7 && v->data.size() == 10);
+
+    // replacing an entry doesn't count its old size against the budget
+    cache.put(key(1, 0), value(60, 8));
+    cache.put(key(2, 0), value(40, 9));
+    CHECK(cache.get(key(1, 0)) && cache.get(key(1, 0))->n_len == 8);
+    CHECK(cache.get(key(2, 0)));
+
+    // entries stay readable after the cache lets go of them
+    CHECK(v->n_len == 7);
+
+    // values larger than the whole budget aren't stored
+    cache.put(key(3, 0), value(101, 1));
+    CHECK(!cache.get(key(3, 0)));
+    CHECK(cache.get(key(1, 0)) && cache.get(key(2, 0)));
+    return 0;
+}
+
+static int test_key_fields() {
+    whisper_cache cache(1000);
+    const whisper_cache_key base = key(1, 0);
+    cache.put(base, value(1, 1));
+    whisper_cache_key k;
+    k = base, k.audio = 2;
+    CHECK(!cache.get(k));
+    k = base, k.n_samples = 16001;
+    CHECK(!cache.get(k));
+    k = base, k.kind = WHISPER_CACHE_MEL;
+    CHECK(!cache.get(k));
+    k = base, k.offset = 3000;
+    CHECK(!cache.get(k));
+    k = base, k.n_ctx = 750;
+    CHECK(!cache.get(k));
+    CHECK(cache.get(base));
+    return 0;
+}
+
+static int test_lru_eviction() {
+    whisper_cache cache(30);
+    cache.put(key(1, 0), value(10, 1));
+    cache.put(key(2, 0), value(10, 2));
+    cache.put(key(3, 0), value(10, 3));
+
+    // touching the oldest entry makes the second oldest the next to go
+    CHECK(cache.get(key(1, 0)));
+    cache.put(key(4, 0), value(10, 4));
+    CHECK(cache.get(key(1, 0)));
+    CHECK(!cache.get(key(2, 0)));
+    CHECK(cache.get(key(3, 0)));
+    CHECK(cache.get(key(4, 0)));
+
+    // as many entries are dropped as it takes to fit a big one
+    cache.put(key(5, 0), value(25, 5));
+    CHECK(cache.get(key(5, 0)));
+    CHECK(!cache.get(key(1, 0)));
+    CHECK(!cache.get(key(3, 0)));
+    CHECK(!cache.get(key(4, 0)));
+    return 0;
+}
+
+static int test_hash() {
+    whisper_cache cache(0);
+    for (int n : {0, 1, 3, 4, 5, 16, 4000}) {
+        std::vector<float> pcm(n);
+        for (int i = 0; i < n; ++i)
+            pcm[i] = i * .001f;
+        const uint64_t h = cache.hash(pcm.data(), n);
+        CHECK(h == cache.hash(pcm.data(), n));
+        for (int i = 0; i < n; ++i) {
+            pcm[i] += 1;
+            CHECK(h != cache.hash(pcm.data(), n));
+            pcm[i] -= 1;
+        }
+        if (n)
+            CHECK(h != cache.hash(pcm.data(), n - 1));
+    }
+
+    // hashes are seeded per cache, so they can't be predicted
+    std::vector<float> pcm(100, .5f);
+    whisper_cache other(0);
+    CHECK(cache.hash(pcm.data(), pcm.size()) != other.hash(pcm.data(), pcm.size()));
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rc;
+    if ((rc = test_get_put()))
+        return rc;
+    if ((rc = test_key_fields()))
+        return rc;
+    if ((rc = test_lru_eviction()))
+        return rc;
+    if ((rc = test_hash()))
+        return rc;
+}
@@ -0,0 +1,128 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+
+//
+// decoding strategy benchmark
+//
+// transcribes the same audio with greedy decoding, best-of sampling and
+// beam search, and reports how long each takes relative to greedy. the
+// encoder does the same work in every run, so the difference is the cost
+// of decoding several candidates at once.
+//
+//     make -j o//whisper.cpp/decode_bench
+//     o//whisper.cpp/decode_bench -m ggml-tiny.en.bin -f whisper.cpp/jfk.wav
+//
+
+#include "slurp.h"
+#include "whisper.h"
+#include "llamafile/llamafile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct strategy {
+    const char * name;
+    whisper_sampling_strategy sampling;
+    int best_of;
+    int beam_size;
+    float temperature;
+};
+
+static const strategy kStrategies[] = {
+    {"greedy",    WHISPER_SAMPLING_GREEDY,      1, -1, 0.0f},
+    {"best_of=5", WHISPER_SAMPLING_GREEDY,      5, -1, 0.2f},
+    {"beam=2",    WHISPER_SAMPLING_BEAM_SEARCH, 1,  2, 0.0f},
+    {"beam=5",    WHISPER_SAMPLING_BEAM_SEARCH, 1,  5, 0.0f},
+};
+
+static double transcribe(whisper_context * ctx, const strategy & s, int n_threads,
+                         const std::vector<float> & pcmf32, std::string & text) {
+    whisper_full_params wparams = whisper_full_default_params(s.sampling);
+    wparams.n_threads             = n_threads;
+    wparams.print_progress        = false;
+    wparams.print_realtime        = false;
+    wparams.print_timestamps      = false;
+    wparams.temperature           = s.temperature;
+    wparams.temperature_inc       = 0.0f; // no fallback, so every run decodes the same way
+    wparams.greedy.best_of        = s.best_of;
+    wparams.beam_search.beam_size = s.beam_size;
+
+    auto t_start = std::chrono::high_resolution_clock::now();
+    if (whisper_full(ctx, wparams, pcmf32.data(), pcmf32.size()) != 0) {
+        fprintf(stderr, "error: failed to process audio\n");
+        exit(1);
+    }
+    auto t_end = std::chrono::high_resolution_clock::now();
+
+    text.clear();
+    for (int i = 0; i < whisper_full_n_segments(ctx); ++i) {
+        text += whisper_full_get_segment_text(ctx, i);
+    }
+
+    return std::chrono::duration<double, std::milli>(t_end - t_start).count();
+}
+
+int main(int argc, char ** argv) {
+    const char * model = nullptr;
+    const char * fname = "whisper.cpp/jfk.wav";
+    int n_threads = std::min(4, (int) std::thread::hardware_concurrency());
+    int n_runs = 3;
+
+    FLAG_log_disable = true;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+            model = argv[++i];
+        } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            fname = argv[++i];
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            n_threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            n_runs = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s -m MODEL [-f WAV] [-t THREADS] [-n RUNS]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!model) {
+        fprintf(stderr, "%s: missing -m model\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<float> pcmf32;
+    std::vector<std::vector<float>> pcmf32s;
+    if (!slurp_audio_file(fname, pcmf32, pcmf32s, false)) {
+        fprintf(stderr, "%s: failed to read audio file\n", fname);
+        return 1;
+    }
+
+    whisper_context * ctx = whisper_init_from_file_with_params(model, whisper_context_default_params());
+    if (!ctx) {
+        fprintf(stderr, "%s: failed to load model\n", model);
+        return 1;
+    }
+
+    // warm up
+    std::string text;
+    transcribe(ctx, kStrategies[0], n_threads, pcmf32, text);
+
+    double greedy = 0;
+    for (const strategy & s : kStrategies) {
+        double best = 1e300;
+        for (int i = 0; i < n_runs; ++i) {
+            best = std::min(best, transcribe(ctx, s, n_threads, pcmf32, text));
+        }
+        if (!greedy) {
+            greedy = best;
+        }
+        printf("%-10s %10.2f ms %6.2fx %s\n", s.name, best, best / greedy, text.c_str());
+    }
+
+    whisper_free(ctx);
+    return 0;
+}
@@ -0,0 +1,174 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+
+//
+// log-mel spectrogram microbenchmark
+//
+// checks whisper_rfft against a double precision dft, and then compares
+// it with the recursive radix-2 fft whisper.cpp used to have, as well as
+// the sparse filterbank with the dense matrix multiply it replaces.
+//
+//     make -j o//whisper.cpp/fft_test
+//     o//whisper.cpp/fft_test
+//
+
+#include "llamafile/bench.h"
+#include "whisper-fft.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#define ITERATIONS 1000
+#define N_FFT 400
+#define N_MEL 80
+#define N_BLOCK 16
+
+static float sin_vals[N_FFT];
+static float cos_vals[N_FFT];
+
+static void dft(const float *in, int N, float *out) {
+    const int sin_cos_step = N_FFT / N;
+    for (int k = 0; k < N; k++) {
+        float re = 0;
+        float im = 0;
+        for (int n = 0; n < N; n++) {
+            int idx = (k * n * sin_cos_step) % N_FFT;
+            re += in[n] * cos_vals[idx];
+            im -= in[n] * sin_vals[idx];
+        }
+        out[k * 2 + 0] = re;
+        out[k * 2 + 1] = im;
+    }
+}
+
+// the old implementation, which needs 2N floats of input and 8N of output
+static void fft(float *in, int N, float *out) {
+    if (N == 1) {
+        out[0] = in[0];
+        out[1] = 0;
+        return;
+    }
+    const int half_N = N / 2;
+    if (N - half_N * 2 == 1) {
+        dft(in, N, out);
+        return;
+    }
+    float *even = in + N;
+    for (int i = 0; i < half_N; ++i)
+        even[i] = in[2 * i];
+    float *even_fft = out + 2 * N;
+    fft(even, half_N, even_fft);
+    float *odd = even;
+    for (int i = 0; i < half_N; ++i)
+        odd[i] = in[2 * i + 1];
+    float *odd_fft = even_fft + N;
+    fft(odd, half_N, odd_fft);
+    const int sin_cos_step = N_FFT / N;
+    for (int k = 0; k < half_N; k++) {
+        int idx = k * sin_cos_step;
+        float re = cos_vals[idx];
+        float im = -sin_vals[idx];
+        float re_odd = odd_fft[2 * k + 0];
+        float im_odd = odd_fft[2 * k + 1];
+        out[2 * k + 0] = even_fft[2 * k + 0] + re * re_odd - im * im_odd;
+        out[2 * k + 1] = even_fft[2 * k + 1] + re * im_odd + im * re_odd;
+        out[2 * (k + half_N) + 0] = even_fft[2 * k + 0] - re * re_odd + im * im_odd;
+        out[2 * (k + half_N) + 1] = even_fft[2 * k + 1] - re * im_odd - im * re_odd;
+    }
+}
+
+static void dense_filterbank(const whisper_filters &filters, const float *power, int n_frames,
+                             float *out) {
+    for (int b = 0; b < n_frames; ++b)
+        for (int j = 0; j < filters.n_mel; ++j) {
+            double sum = 0;
+            for (int k = 0; k < filters.n_fft; ++k)
+                sum += power[k * N_BLOCK + b] * filters.data[j * filters.n_fft + k];
+            out[j * N_BLOCK + b] = sum;
+        }
+}
+
+// triangles spaced evenly on the mel scale, like librosa makes
+static whisper_filters make_filters(int n_mel, int n_fft) {
+    whisper_filters filters;
+    filters.n_mel = n_mel;
+    filters.n_fft = n_fft;
+    filters.data.resize(n_mel * n_fft);
+    auto mel = [](double hz) { return 2595 * log10(1 + hz / 700); };
+    auto hz = [](double m) { return 700 * (pow(10, m / 2595) - 1); };
+    double top = mel(8000);
+    for (int j = 0; j < n_mel; ++j) {
+        double lo = hz(top * j / (n_mel + 1));
+        double mid = hz(top * (j + 1) / (n_mel + 1));
+        double hi = hz(top * (j + 2) / (n_mel + 1));
+        for (int k = 0; k < n_fft; ++k) {
+            double f = 8000. * k / (n_fft - 1);
+            double w = std::max(0., std::min((f - lo) / (mid - lo), (hi - f) / (hi - mid)));
+            filters.data[j * n_fft + k] = w;
+        }
+    }
+    return filters;
+}
+
+static int test_accuracy(int n) {
+    whisper_rfft rfft(n);
+    std::vector<float> in(n);
+    std::vector<float> out(n + 2);
+    std::vector<float> work(rfft.work_size());
+    for (int i = 0; i < n; ++i)
+        in[i] = rand() / (float)RAND_MAX - .5f;
+    rfft.forward(in.data(), out.data(), work.data());
+    double worst = 0;
+    for (int k = 0; k <= n / 2; ++k) {
+        double re = 0, im = 0;
+        for (int t = 0; t < n; ++t) {
+            re += in[t] * cos(2 * M_PI * k * t / n);
+            im -= in[t] * sin(2 * M_PI * k * t / n);
+        }
+        worst = std::max(worst, fabs(re - out[2 * k + 0]));
+        worst = std::max(worst, fabs(im - out[2 * k + 1]));
+    }
+    if (worst > 1e-5 * n) {
+        fprintf(stderr, "%s:%d: n=%d error %g too large\n", __FILE__, __LINE__, n, worst);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 0; i < N_FFT; i++) {
+        sin_vals[i] = sinf(2 * M_PI * i / N_FFT);
+        cos_vals[i] = cosf(2 * M_PI * i / N_FFT);
+    }
+
+    for (int n : {2, 4, 6, 10, 14, 30, 42, 256, 400, 1000})
+        if (test_accuracy(n))
+            return 1;
+
+    whisper_rfft rfft(N_FFT);
+    std::vector<float> in(N_FFT * 2);
+    std::vector<float> out(N_FFT * 8);
+    std::vector<float> work(rfft.work_size());
+    for (int i = 0; i < N_FFT; ++i)
+        in[i] = rand() / (float)RAND_MAX - .5f;
+    BENCH(fft(in.data(), N_FFT, out.data()));
+    BENCH(rfft.forward(in.data(), out.data(), work.data()));
+
+    whisper_filters filters = make_filters(N_MEL, N_FFT / 2 + 1);
+    whisper_mel_filterbank filterbank(filters);
+    std::vector<float> power(filters.n_fft * N_BLOCK);
+    std::vector<float> sums(N_MEL * N_BLOCK);
+    std::vector<float> want(N_MEL * N_BLOCK);
+    for (float &x : power)
+        x = rand() / (float)RAND_MAX;
+    BENCH(dense_filterbank(filters, power.data(), N_BLOCK, want.data()));
+    BENCH(filterbank.apply(power.data(), N_BLOCK, N_BLOCK, sums.data()));
+    for (int i = 0; i < N_MEL * N_BLOCK; ++i)
+        if (fabs(want[i] - sums[i]) > 1e-4 * (1 + fabs(want[i]))) {
+            fprintf(stderr, "%s:%d: filterbank mismatch %g vs. %g\n", __FILE__, __LINE__, sums[i],
+                    want[i]);
+            return 2;
+        }
+}
@@ -48,12 +48,14 @@ struct whisper_params {
     float grammar_penalty = 100.0f;
     float temperature     = 0.0f;
     float temperature_inc = 0.2f;
+    float vad_thold       = 10.0f;
 
     bool debug_mode      = false;
     bool translate       = false;
     bool detect_language = false;
     bool diarize         = false;
     bool tinydiarize     = false;
+    bool vad             = false;
     bool split_on_word   = false;
     bool no_fallback     = false;
     bool output_txt      = false;
@@ -176,6 +178,8 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         else if (arg == "-tr"   || arg == "--translate")       { params.translate       = true; }
         else if (arg == "-di"   || arg == "--diarize")         { params.diarize         = true; }
         else if (arg == "-tdrz" || arg == "--tinydiarize")     { params.tinydiarize     = true; }
+        else if (                  arg == "--vad")             { params.vad             = true; }
+        else if (arg == "-vth"  || arg == "--vad-thold")       { params.vad_thold       = std::stof(argv[++i]); }
         else if (arg == "-sow"  || arg == "--split-on-word")   { params.split_on_word   = true; }
         else if (arg == "-nf"   || arg == "--no-fallback")     { params.no_fallback     = true; }
         else if (arg == "-otxt" || arg == "--output-txt")      { params.output_txt      = true; }
@@ -245,6 +249,8 @@ static void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params
     fprintf(stderr, "  -tr,       --translate         [%-7s] translate from source language to english\n",      params.translate ? "true" : "false");
     fprintf(stderr, "  -di,       --diarize           [%-7s] stereo audio diarization\n",                       params.diarize ? "true" : "false");
     fprintf(stderr, "  -tdrz,     --tinydiarize       [%-7s] enable tinydiarize (requires a tdrz model)\n",     params.tinydiarize ? "true" : "false");
+    fprintf(stderr, "             --vad               [%-7s] only transcribe audio detected as speech\n",       params.vad ? "true" : "false");
+    fprintf(stderr, "  -vth N,    --vad-thold N       [%-7.2f] decibels above the noise floor for speech\n",     params.vad_thold);
     fprintf(stderr, "  -nf,       --no-fallback       [%-7s] do not use temperature fallback while decoding\n", params.no_fallback ? "true" : "false");
     fprintf(stderr, "  -otxt,     --output-txt        [%-7s] output result in a text file\n",                   params.output_txt ? "true" : "false");
     fprintf(stderr, "  -ovtt,     --output-vtt        [%-7s] output result in a vtt file\n",                    params.output_vtt ? "true" : "false");
@@ -1109,7 +1115,19 @@ int main(int argc, char ** argv) {
         std::vector<float> pcmf32;               // mono-channel F32 PCM
         std::vector<std::vector<float>> pcmf32s; // stereo-channel F32 PCM
 
-        if (!slurp_audio_file(fname_inp.c_str(), pcmf32, pcmf32s, params.diarize)) {
+        // unless diarization needs the whole file, or it's split between
+        // processors, the file is decoded on another thread as it's being
+        // transcribed, so memory doesn't depend on how long the file is
+        const bool streaming = !params.diarize && params.n_processors == 1 && params.offset_t_ms == 0 && params.duration_ms == 0;
+
+        slurp_stream * stream = nullptr;
+
+        if (streaming) {
+            if (!(stream = slurp_stream_open(fname_inp.c_str(), WHISPER_STREAM_CHUNK_SIZE*WHISPER_SAMPLE_RATE))) {
+                fprintf(stderr, "error: failed to read audio file '%s'\n", fname_inp.c_str());
+                continue;
+            }
+        } else if (!slurp_audio_file(fname_inp.c_str(), pcmf32, pcmf32s, params.diarize)) {
             fprintf(stderr, "error: failed to read audio file '%s'\n", fname_inp.c_str());
             continue;
         }
@@ -1133,8 +1151,12 @@ int main(int argc, char ** argv) {
 
             // print some info about the processing
             fprintf(stderr, "\n");
-            fprintf(stderr, "%s: processing '%s' (%d samples, %.1f sec), %d threads, %d processors, %d beams + best of %d, lang = %s, task = %s, %stimestamps = %d ...\n",
-                    __func__, fname_inp.c_str(), int(pcmf32.size()), float(pcmf32.size())/WHISPER_SAMPLE_RATE,
+            if (streaming) {
+                fprintf(stderr, "%s: streaming '%s' in chunks of %d sec, ", __func__, fname_inp.c_str(), WHISPER_STREAM_CHUNK_SIZE);
+            } else {
+                fprintf(stderr, "%s: processing '%s' (%d samples, %.1f sec), ", __func__, fname_inp.c_str(), int(pcmf32.size()), float(pcmf32.size())/WHISPER_SAMPLE_RATE);
+            }
+            fprintf(stderr, "%d threads, %d processors, %d beams + best of %d, lang = %s, task = %s, %stimestamps = %d ...\n",
                     params.n_threads, params.n_processors, params.beam_size, params.best_of,
                     params.language.c_str(),
                     params.translate ? "translate" : "transcribe",
@@ -1144,6 +1166,8 @@ int main(int argc, char ** argv) {
             fprintf(stderr, "\n");
         }
 
+        long n_samples = pcmf32.size();
+
         // run the inference
         {
             whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
@@ -1173,6 +1197,9 @@ int main(int argc, char ** argv) {
 
             wparams.tdrz_enable      = params.tinydiarize; // [TDRZ]
 
+            wparams.vad              = params.vad;
+            wparams.vad_thold        = params.vad_thold;
+
             wparams.suppress_regex   = params.suppress_regex.empty() ? nullptr : params.suppress_regex.c_str();
 
             wparams.initial_prompt   = params.prompt.c_str();
@@ -1240,7 +1267,18 @@ int main(int argc, char ** argv) {
                 wparams.abort_callback_user_data = &is_aborted;
             }
 
-            if (whisper_full_parallel(ctx, wparams, pcmf32.data(), pcmf32.size(), params.n_processors) != 0) {
+            if (streaming) {
+                const auto read = [](float * samples, int n_samples, void * stream) {
+                    return slurp_stream_read((slurp_stream *) stream, samples, n_samples);
+                };
+                const int ret = whisper_full_stream(ctx, wparams, read, stream);
+                n_samples = slurp_stream_samples(stream);
+                slurp_stream_close(stream);
+                if (ret != 0) {
+                    fprintf(stderr, "%s: failed to process audio\n", argv[0]);
+                    return 10;
+                }
+            } else if (whisper_full_parallel(ctx, wparams, pcmf32.data(), pcmf32.size(), params.n_processors) != 0) {
                 fprintf(stderr, "%s: failed to process audio\n", argv[0]);
                 return 10;
             }
@@ -1271,7 +1309,7 @@ int main(int argc, char ** argv) {
             // output to WTS file
             if (params.output_wts) {
                 const auto fname_wts = fname_out + ".wts";
-                output_wts(ctx, fname_wts.c_str(), fname_inp.c_str(), params, float(pcmf32.size() + 1000)/WHISPER_SAMPLE_RATE, pcmf32s);
+                output_wts(ctx, fname_wts.c_str(), fname_inp.c_str(), params, float(n_samples + 1000)/WHISPER_SAMPLE_RATE, pcmf32s);
             }
 
             // output to CSV file
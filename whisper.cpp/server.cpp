@@ -18,6 +18,9 @@
 #include <cstring>
 #include <sstream>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <shared_mutex>
 
 #if defined(_MSC_VER)
 #pragma warning(disable: 4244 4267) // possible loss of data
@@ -45,6 +48,9 @@ struct server_params
     int32_t port          = 8080;
     int32_t read_timeout  = 600;
     int32_t write_timeout = 600;
+    int32_t n_parallel    = 1;
+    int32_t max_queue     = 32;
+    int32_t cache_size    = 512; // MiB, which is dozens of windows with tiny but only two with large-v3, see doc/server.md
 };
 
 struct whisper_params {
@@ -59,20 +65,26 @@ struct whisper_params {
     int32_t best_of       = 2;
     int32_t beam_size     = -1;
     int32_t audio_ctx     = 0;
+    int32_t step_ms       = 500;
+    int32_t length_ms     = 5000;
+    int32_t keep_ms       = 200;
 
     float word_thold      =  0.01f;
     float entropy_thold   =  2.40f;
     float logprob_thold   = -1.00f;
     float temperature     =  0.00f;
     float temperature_inc =  0.20f;
+    float vad_thold       = 10.00f;
 
     bool debug_mode      = false;
     bool translate       = false;
     bool detect_language = false;
     bool diarize         = false;
     bool tinydiarize     = false;
+    bool vad             = false;
     bool split_on_word   = false;
     bool no_fallback     = false;
+    bool no_context      = false;
     bool print_special   = false;
     bool print_colors    = false;
     bool print_realtime  = false;
@@ -102,7 +114,7 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "options:\n");
     fprintf(stderr, "  -h,        --help              [default] show this help message and exit\n");
     fprintf(stderr, "  -t N,      --threads N         [%-7d] number of threads to use during computation\n",    params.n_threads);
-    fprintf(stderr, "  -p N,      --processors N      [%-7d] number of processors to use during computation\n", params.n_processors);
+    fprintf(stderr, "  -p N,      --processors N      [%-7d] ignored by the server, see --parallel\n",          params.n_processors);
     fprintf(stderr, "  -ot N,     --offset-t N        [%-7d] time offset in milliseconds\n",                    params.offset_t_ms);
     fprintf(stderr, "  -on N,     --offset-n N        [%-7d] segment index offset\n",                           params.offset_n);
     fprintf(stderr, "  -d  N,     --duration N        [%-7d] duration of audio to process in milliseconds\n",   params.duration_ms);
@@ -112,6 +124,9 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "  -bo N,     --best-of N         [%-7d] number of best candidates to keep\n",              params.best_of);
     fprintf(stderr, "  -bs N,     --beam-size N       [%-7d] beam size for beam search\n",                      params.beam_size);
     fprintf(stderr, "  -ac N,     --audio-ctx N       [%-7d] audio context size (0 - all)\n",                   params.audio_ctx);
+    fprintf(stderr, "             --step N            [%-7d] /stream audio step size in milliseconds\n",       params.step_ms);
+    fprintf(stderr, "             --length N          [%-7d] /stream audio length in milliseconds\n",          params.length_ms);
+    fprintf(stderr, "             --keep N            [%-7d] /stream audio to keep from previous step in ms\n",params.keep_ms);
     fprintf(stderr, "  -wt N,     --word-thold N      [%-7.2f] word timestamp probability threshold\n",         params.word_thold);
     fprintf(stderr, "  -et N,     --entropy-thold N   [%-7.2f] entropy threshold for decoder fail\n",           params.entropy_thold);
     fprintf(stderr, "  -lpt N,    --logprob-thold N   [%-7.2f] log probability threshold for decoder fail\n",   params.logprob_thold);
@@ -119,6 +134,8 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "  -tr,       --translate         [%-7s] translate from source language to english\n",      params.translate ? "true" : "false");
     fprintf(stderr, "  -di,       --diarize           [%-7s] stereo audio diarization\n",                       params.diarize ? "true" : "false");
     fprintf(stderr, "  -tdrz,     --tinydiarize       [%-7s] enable tinydiarize (requires a tdrz model)\n",     params.tinydiarize ? "true" : "false");
+    fprintf(stderr, "             --vad               [%-7s] only transcribe audio detected as speech\n",       params.vad ? "true" : "false");
+    fprintf(stderr, "  -vth N,    --vad-thold N       [%-7.2f] decibels above the noise floor for speech\n",     params.vad_thold);
     fprintf(stderr, "  -nf,       --no-fallback       [%-7s] do not use temperature fallback while decoding\n", params.no_fallback ? "true" : "false");
     fprintf(stderr, "  -ps,       --print-special     [%-7s] print special tokens\n",                           params.print_special ? "true" : "false");
     fprintf(stderr, "  -pc,       --print-colors      [%-7s] print colors\n",                                   params.print_colors ? "true" : "false");
@@ -137,6 +154,9 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "  --public PATH,                 [%-7s] Path to the public folder\n", sparams.public_path.c_str());
     fprintf(stderr, "  --request-path PATH,           [%-7s] Request path for all requests\n", sparams.request_path.c_str());
     fprintf(stderr, "  --inference-path PATH,         [%-7s] Inference path for all requests\n", sparams.inference_path.c_str());
+    fprintf(stderr, "  -np N,     --parallel N        [%-7d] number of requests to transcribe at the same time\n", sparams.n_parallel);
+    fprintf(stderr, "  --max-queue N,                 [%-7d] number of requests that may wait for a free slot\n", sparams.max_queue);
+    fprintf(stderr, "  --cache-size N,                [%-7d] MiB of encoded audio to keep for repeat requests\n", sparams.cache_size);
     fprintf(stderr, "  --recompile                    [%-7s] Force GPU support to be recompiled at runtime if possible.\n", FLAG_recompile ? "true" : "false");
     fprintf(stderr, "  --nocompile                    [%-7s] Never compile GPU support at runtime.", FLAG_nocompile ? "true" : "false");
     fprintf(stderr, "\n");
@@ -194,6 +214,9 @@ bool whisper_params_parse(int argc, char ** argv, whisper_params & params, serve
         else if (arg == "-bo"   || arg == "--best-of")         { params.best_of         = std::stoi(argv[++i]); }
         else if (arg == "-bs"   || arg == "--beam-size")       { params.beam_size       = std::stoi(argv[++i]); }
         else if (arg == "-ac"   || arg == "--audio-ctx")       { params.audio_ctx       = std::stoi(argv[++i]); }
+        else if (                  arg == "--step")            { params.step_ms         = std::stoi(argv[++i]); }
+        else if (                  arg == "--length")          { params.length_ms       = std::stoi(argv[++i]); }
+        else if (                  arg == "--keep")            { params.keep_ms         = std::stoi(argv[++i]); }
         else if (arg == "-wt"   || arg == "--word-thold")      { params.word_thold      = std::stof(argv[++i]); }
         else if (arg == "-et"   || arg == "--entropy-thold")   { params.entropy_thold   = std::stof(argv[++i]); }
         else if (arg == "-lpt"  || arg == "--logprob-thold")   { params.logprob_thold   = std::stof(argv[++i]); }
@@ -201,6 +224,8 @@ bool whisper_params_parse(int argc, char ** argv, whisper_params & params, serve
         else if (arg == "-tr"   || arg == "--translate")       { params.translate       = true; }
         else if (arg == "-di"   || arg == "--diarize")         { params.diarize         = true; }
         else if (arg == "-tdrz" || arg == "--tinydiarize")     { params.tinydiarize     = true; }
+        else if (                  arg == "--vad")             { params.vad             = true; }
+        else if (arg == "-vth"  || arg == "--vad-thold")       { params.vad_thold       = std::stof(argv[++i]); }
         else if (arg == "-sow"  || arg == "--split-on-word")   { params.split_on_word   = true; }
         else if (arg == "-nf"   || arg == "--no-fallback")     { params.no_fallback     = true; }
         else if (arg == "-fp"   || arg == "--font-path")       { params.font_path       = argv[++i]; }
@@ -222,6 +247,9 @@ bool whisper_params_parse(int argc, char ** argv, whisper_params & params, serve
         else if (                  arg == "--host")            { sparams.hostname    = argv[++i]; }
         else if (                  arg == "--public")          { sparams.public_path = argv[++i]; }
         else if (                  arg == "--request-path")    { sparams.request_path = argv[++i]; }
+        else if (arg == "-np"   || arg == "--parallel")        { sparams.n_parallel  = std::stoi(argv[++i]); }
+        else if (                  arg == "--max-queue")       { sparams.max_queue   = std::stoi(argv[++i]); }
+        else if (                  arg == "--cache-size")      { sparams.cache_size  = std::stoi(argv[++i]); }
         else if (                  arg == "--recompile")       { FLAG_recompile = true; }
         else if (                  arg == "--nocompile")       { FLAG_nocompile = true; }
         else if (                  arg == "--tinyblas")        { FLAG_tinyblas = true; }
@@ -301,11 +329,11 @@ void whisper_print_progress_callback(struct whisper_context * /*ctx*/, struct wh
     }
 }
 
-void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper_state * /*state*/, int n_new, void * user_data) {
+void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper_state * state, int n_new, void * user_data) {
     const auto & params  = *((whisper_print_user_data *) user_data)->params;
     const auto & pcmf32s = *((whisper_print_user_data *) user_data)->pcmf32s;
 
-    const int n_segments = whisper_full_n_segments(ctx);
+    const int n_segments = whisper_full_n_segments_from_state(state);
 
     std::string speaker = "";
 
@@ -321,8 +349,8 @@ void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper
 
     for (int i = s0; i < n_segments; i++) {
         if (!params.no_timestamps || params.diarize) {
-            t0 = whisper_full_get_segment_t0(ctx, i);
-            t1 = whisper_full_get_segment_t1(ctx, i);
+            t0 = whisper_full_get_segment_t0_from_state(state, i);
+            t1 = whisper_full_get_segment_t1_from_state(state, i);
         }
 
         if (!params.no_timestamps) {
@@ -334,29 +362,29 @@ void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper
         }
 
         if (params.print_colors) {
-            for (int j = 0; j < whisper_full_n_tokens(ctx, i); ++j) {
+            for (int j = 0; j < whisper_full_n_tokens_from_state(state, i); ++j) {
                 if (params.print_special == false) {
-                    const whisper_token id = whisper_full_get_token_id(ctx, i, j);
+                    const whisper_token id = whisper_full_get_token_id_from_state(state, i, j);
                     if (id >= whisper_token_eot(ctx)) {
                         continue;
                     }
                 }
 
-                const char * text = whisper_full_get_token_text(ctx, i, j);
-                const float  p    = whisper_full_get_token_p   (ctx, i, j);
+                const char * text = whisper_full_get_token_text_from_state(ctx, state, i, j);
+                const float  p    = whisper_full_get_token_p_from_state(state, i, j);
 
                 const int col = std::max(0, std::min((int) k_colors.size() - 1, (int) (std::pow(p, 3)*float(k_colors.size()))));
 
                 printf("%s%s%s%s", speaker.c_str(), k_colors[col].c_str(), text, "\033[0m");
             }
         } else {
-            const char * text = whisper_full_get_segment_text(ctx, i);
+            const char * text = whisper_full_get_segment_text_from_state(state, i);
 
             printf("%s%s", speaker.c_str(), text);
         }
 
         if (params.tinydiarize) {
-            if (whisper_full_get_segment_speaker_turn_next(ctx, i)) {
+            if (whisper_full_get_segment_speaker_turn_next_from_state(state, i)) {
                 printf("%s", params.tdrz_speaker_turn.c_str());
             }
         }
@@ -369,17 +397,17 @@ void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper
     }
 }
 
-std::string output_str(struct whisper_context * ctx, const whisper_params & params, std::vector<std::vector<float>> pcmf32s) {
+std::string output_str(struct whisper_context * /*ctx*/, struct whisper_state * state, const whisper_params & params, std::vector<std::vector<float>> pcmf32s) {
     std::stringstream result;
-    const int n_segments = whisper_full_n_segments(ctx);
+    const int n_segments = whisper_full_n_segments_from_state(state);
     for (int i = 0; i < n_segments; ++i) {
-        const char * text = whisper_full_get_segment_text(ctx, i);
+        const char * text = whisper_full_get_segment_text_from_state(state, i);
         std::string speaker = "";
 
         if (params.diarize && pcmf32s.size() == 2)
         {
-            const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-            const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
+            const int64_t t0 = whisper_full_get_segment_t0_from_state(state, i);
+            const int64_t t1 = whisper_full_get_segment_t1_from_state(state, i);
             speaker = estimate_diarization_speaker(pcmf32s, t0, t1);
         }
 
@@ -441,6 +469,14 @@ void get_req_parameters(const Request & req, whisper_params & params)
     {
         params.logprob_thold = std::stof(req.get_file_value("logprob_thold").content);
     }
+    if (req.has_file("vad"))
+    {
+        params.vad = parse_str_to_bool(req.get_file_value("vad").content);
+    }
+    if (req.has_file("vad_thold"))
+    {
+        params.vad_thold = std::stof(req.get_file_value("vad_thold").content);
+    }
     if (req.has_file("debug_mode"))
     {
         params.debug_mode = parse_str_to_bool(req.get_file_value("debug_mode").content);
@@ -491,13 +527,269 @@ void get_req_parameters(const Request & req, whisper_params & params)
     }
 }
 
+// /stream takes its parameters from the url, since the body is the audio
+void get_stream_parameters(const Request & req, whisper_params & params)
+{
+    if (req.has_param("language"))
+    {
+        params.language = req.get_param_value("language");
+    }
+    if (req.has_param("translate"))
+    {
+        params.translate = parse_str_to_bool(req.get_param_value("translate"));
+    }
+    if (req.has_param("prompt"))
+    {
+        params.prompt = req.get_param_value("prompt");
+    }
+    if (req.has_param("step_ms"))
+    {
+        params.step_ms = std::stoi(req.get_param_value("step_ms"));
+    }
+    if (req.has_param("length_ms"))
+    {
+        params.length_ms = std::stoi(req.get_param_value("length_ms"));
+    }
+    if (req.has_param("keep_ms"))
+    {
+        params.keep_ms = std::stoi(req.get_param_value("keep_ms"));
+    }
+    if (req.has_param("no_context"))
+    {
+        params.no_context = parse_str_to_bool(req.get_param_value("no_context"));
+    }
+}
+
+// states sharing one whisper_context, so requests may transcribe in parallel
+//
+// each state has its own kv caches and compute buffers, so a request that
+// holds one can run whisper_full_with_state() without any global lock. a
+// request that finds no free state waits in line, unless more than
+// max_queue requests are already waiting, in which case it's turned away
+struct whisper_state_pool {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<whisper_state *> free;
+    int waiting = 0;
+    int max_queue = 0;
+
+    bool init(whisper_context * ctx, int n_states, int max_queue_) {
+        std::lock_guard<std::mutex> lock(mutex);
+        max_queue = max_queue_;
+        for (int i = 0; i < n_states; ++i) {
+            whisper_state * state = whisper_init_state(ctx);
+            if (!state) {
+                return false;
+            }
+            free.push_back(state);
+        }
+        return true;
+    }
+
+    // callers must have returned all states beforehand
+    void destroy() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (whisper_state * state : free) {
+            whisper_free_state(state);
+        }
+        free.clear();
+    }
+
+    whisper_state * acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (free.empty()) {
+            if (waiting >= max_queue) {
+                return nullptr;
+            }
+            ++waiting;
+            cond.wait(lock, [this] { return !free.empty(); });
+            --waiting;
+        }
+        whisper_state * state = free.back();
+        free.pop_back();
+        return state;
+    }
+
+    void release(whisper_state * state) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            free.push_back(state);
+        }
+        cond.notify_one();
+    }
+};
+
+// returns state to its pool when the request is done with it
+struct whisper_state_lease {
+    whisper_state_pool & pool;
+    whisper_state * state;
+
+    explicit whisper_state_lease(whisper_state_pool & pool) : pool(pool), state(pool.acquire()) {}
+    ~whisper_state_lease() {
+        if (state) {
+            pool.release(state);
+        }
+    }
+};
+
+// sliding window transcriber for audio that arrives a little at a time
+//
+// this works like the stream example, except the pcm comes from a request
+// body rather than a microphone. every step_ms of new audio, the window
+// made of it and of the audio before it is transcribed, and the text is
+// sent as a partial result. once the window spans length_ms, its text is
+// final, its tokens become the prompt of the next window, and only the
+// last keep_ms of audio is carried over into that window.
+struct whisper_stream {
+    whisper_context * ctx;
+    whisper_state * state;
+    whisper_params params;
+
+    int n_samples_step;
+    int n_samples_len;
+    int n_samples_keep;
+
+    int64_t t_window = 0; // samples of the stream before the window
+    std::vector<float> pcmf32_old;
+    std::vector<float> pcmf32_new;
+    std::vector<float> pcmf32;
+    std::vector<whisper_token> prompt_tokens;
+
+    std::string odd; // incomplete sample at the end of the last read
+
+    // called with each result, returning false if the client went away
+    using emit_t = std::function<bool(const json &)>;
+
+    whisper_stream(whisper_context * ctx, whisper_state * state, const whisper_params & params_)
+        : ctx(ctx), state(state), params(params_) {
+        params.step_ms   = std::max(params.step_ms,   100);
+        params.length_ms = std::min(std::max(params.length_ms, params.step_ms), WHISPER_CHUNK_SIZE*1000);
+        params.keep_ms   = std::min(std::max(params.keep_ms, 0), params.step_ms);
+
+        n_samples_step = (1e-3*params.step_ms  )*WHISPER_SAMPLE_RATE;
+        n_samples_len  = (1e-3*params.length_ms)*WHISPER_SAMPLE_RATE;
+        n_samples_keep = (1e-3*params.keep_ms  )*WHISPER_SAMPLE_RATE;
+
+        if (params.language != "auto" && whisper_lang_id(params.language.c_str()) == -1) {
+            params.language = "auto";
+        }
+        if (!whisper_is_multilingual(ctx)) {
+            params.language = "en";
+            params.translate = false;
+        }
+    }
+
+    // adds 16-bit little endian mono pcm, which may be split anywhere
+    bool feed(const char * data, size_t size, const emit_t & emit) {
+        if (!odd.empty() && size) {
+            odd += *data++;
+            --size;
+            pcmf32_new.push_back(int16_t(uint8_t(odd[0]) | uint8_t(odd[1]) << 8) / 32768.0f);
+            odd.clear();
+        }
+        for (; size >= 2; data += 2, size -= 2) {
+            pcmf32_new.push_back(int16_t(uint8_t(data[0]) | uint8_t(data[1]) << 8) / 32768.0f);
+        }
+        if (size) {
+            odd.assign(data, size);
+        }
+        if ((int) pcmf32_new.size() < n_samples_step) {
+            return true;
+        }
+        return step(false, emit);
+    }
+
+    // transcribes whatever audio is left once the upload is done
+    bool finish(const emit_t & emit) {
+        if (!pcmf32_new.empty() || !pcmf32_old.empty()) {
+            if (!step(true, emit)) {
+                return false;
+            }
+        }
+        return emit(json{
+            {"type", "done"},
+            {"duration", float(t_window + pcmf32_old.size())/WHISPER_SAMPLE_RATE},
+        });
+    }
+
+    bool step(bool flush, const emit_t & emit) {
+        pcmf32 = pcmf32_old;
+        pcmf32.insert(pcmf32.end(), pcmf32_new.begin(), pcmf32_new.end());
+        pcmf32_new.clear();
+
+        whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+
+        wparams.print_progress   = false;
+        wparams.print_special    = params.print_special;
+        wparams.print_realtime   = false;
+        wparams.print_timestamps = false;
+        wparams.translate        = params.translate;
+        wparams.single_segment   = true;
+        wparams.no_timestamps    = true;
+        wparams.max_tokens       = 0;
+        wparams.language         = params.language.c_str();
+        wparams.n_threads        = params.n_threads;
+        wparams.audio_ctx        = params.audio_ctx;
+        wparams.temperature_inc  = params.no_fallback ? 0.0f : params.temperature_inc;
+        wparams.entropy_thold    = params.entropy_thold;
+        wparams.logprob_thold    = params.logprob_thold;
+        wparams.initial_prompt   = prompt_tokens.empty() ? params.prompt.c_str() : nullptr;
+        wparams.prompt_tokens    = params.no_context ? nullptr : prompt_tokens.data();
+        wparams.prompt_n_tokens  = params.no_context ? 0       : prompt_tokens.size();
+
+        if (whisper_full_with_state(ctx, state, wparams, pcmf32.data(), pcmf32.size()) != 0) {
+            emit(json{{"type", "error"}, {"error", "failed to process audio"}});
+            return false;
+        }
+
+        std::string text;
+        const int n_segments = whisper_full_n_segments_from_state(state);
+        for (int i = 0; i < n_segments; ++i) {
+            text += whisper_full_get_segment_text_from_state(state, i);
+        }
+
+        // the window is final once it's long enough, and carries part of
+        // its audio, and all of its tokens, over into the next window
+        const bool is_final = flush || (int) pcmf32.size() >= n_samples_len;
+
+        json result = json{
+            {"type", is_final ? "final" : "partial"},
+            {"start", float(t_window)/WHISPER_SAMPLE_RATE},
+            {"end", float(t_window + pcmf32.size())/WHISPER_SAMPLE_RATE},
+            {"text", text},
+        };
+
+        if (is_final) {
+            if (!params.no_context) {
+                prompt_tokens.clear();
+                for (int i = 0; i < n_segments; ++i) {
+                    const int n_tokens = whisper_full_n_tokens_from_state(state, i);
+                    for (int j = 0; j < n_tokens; ++j) {
+                        prompt_tokens.push_back(whisper_full_get_token_id_from_state(state, i, j));
+                    }
+                }
+            }
+            const int n_keep = flush ? 0 : std::min(n_samples_keep, (int) pcmf32.size());
+            t_window += pcmf32.size() - n_keep;
+            pcmf32_old.assign(pcmf32.end() - n_keep, pcmf32.end());
+        } else {
+            pcmf32_old.swap(pcmf32);
+        }
+
+        return emit(result);
+    }
+};
+
 }  // namespace
 
 int whisper_server_main(int argc, char ** argv) {
     whisper_params params;
     server_params sparams;
 
-    std::mutex whisper_mutex;
+    // held exclusively by /load while it swaps the model, and shared by
+    // inference requests, which synchronize with each other via the pool
+    std::shared_mutex model_mutex;
+    whisper_state_pool pool;
 
     if (whisper_params_parse(argc, argv, params, sparams) == false) {
         whisper_print_usage(argc, argv, params, sparams);
@@ -520,6 +812,7 @@ int whisper_server_main(int argc, char ** argv) {
     struct whisper_context_params cparams = whisper_context_default_params();
 
     cparams.flash_attn = params.flash_attn;
+    cparams.cache_size = (size_t) std::max(0, sparams.cache_size)*1024*1024;
 
     if (!params.dtw.empty()) {
         cparams.dtw_token_timestamps = true;
@@ -565,16 +858,21 @@ int whisper_server_main(int argc, char ** argv) {
         }
     }
 
-    struct whisper_context * ctx = whisper_init_from_file_with_params(params.model.c_str(), cparams);
+    if (sparams.n_parallel < 1) {
+        sparams.n_parallel = 1;
+    }
+    if (params.n_processors > 1) {
+        fprintf(stderr, "warning: --processors is ignored by the server, use --parallel to transcribe requests concurrently\n");
+    }
+
+    // the context only holds the weights, and every request gets a state from the pool
+    struct whisper_context * ctx = whisper_init_from_file_with_params_no_state(params.model.c_str(), cparams);
 
-    if (ctx == nullptr) {
+    if (ctx == nullptr || !pool.init(ctx, sparams.n_parallel, sparams.max_queue)) {
         fprintf(stderr, "error: failed to initialize whisper context\n");
         return 3;
     }
 
-    // initialize openvino encoder. this has no effect on whisper.cpp builds that don't have OpenVINO configured
-    whisper_ctx_init_openvino_encoder(ctx, nullptr, params.openvino_encode_device.c_str(), nullptr);
-
     Server svr;
     svr.set_default_headers({{"Server", "whisper.cpp"},
                              {"Access-Control-Allow-Origin", "*"},
@@ -664,8 +962,8 @@ int whisper_server_main(int argc, char ** argv) {
     });
 
     svr.Post(sparams.request_path + sparams.inference_path, [&](const Request &req, Response &res){
-        // acquire whisper model mutex lock
-        std::lock_guard<std::mutex> lock(whisper_mutex);
+        // keep /load from swapping the model out from under us
+        std::shared_lock<std::shared_mutex> model_lock(model_mutex);
 
         // first check user requested fields of the request
         if (!req.has_file("file"))
@@ -678,6 +976,7 @@ int whisper_server_main(int argc, char ** argv) {
         auto audio_file = req.get_file_value("file");
 
         // check non-required fields
+        whisper_params params = default_params;
         get_req_parameters(req, params);
 
         std::string filename{audio_file.filename};
@@ -696,7 +995,18 @@ int whisper_server_main(int argc, char ** argv) {
         temp_file << audio_file.content;
         temp_file.close();
 
-        bool ok = slurp_audio_file(temp_filename.c_str(), pcmf32, pcmf32s, params.diarize);
+        // the file is decoded on another thread while it's transcribed,
+        // unless diarization needs all of it at once
+        const bool streaming = !params.diarize && params.offset_t_ms == 0 && params.duration_ms == 0;
+
+        slurp_stream * stream = nullptr;
+
+        bool ok;
+        if (streaming) {
+            ok = (stream = slurp_stream_open(temp_filename.c_str(), WHISPER_STREAM_CHUNK_SIZE*WHISPER_SAMPLE_RATE)) != nullptr;
+        } else {
+            ok = slurp_audio_file(temp_filename.c_str(), pcmf32, pcmf32s, params.diarize);
+        }
         unlink(temp_filename.c_str());
         if (!ok) {
             fprintf(stderr, "error: failed to read audio file\n");
@@ -707,11 +1017,25 @@ int whisper_server_main(int argc, char ** argv) {
 
         printf("Successfully loaded %s\n", filename.c_str());
 
+        // wait for a free whisper state
+        whisper_state_lease lease(pool);
+        whisper_state * state = lease.state;
+        if (!state) {
+            if (stream) {
+                slurp_stream_close(stream);
+            }
+            fprintf(stderr, "error: too many requests are waiting\n");
+            const std::string error_resp = "{\"error\":\"too many requests are waiting\"}";
+            res.status = 503;
+            res.set_content(error_resp, "application/json");
+            return;
+        }
+
         // print system information
         {
             fprintf(stderr, "\n");
             fprintf(stderr, "system_info: n_threads = %d / %d | %s\n",
-                    params.n_threads*params.n_processors, std::thread::hardware_concurrency(), whisper_print_system_info());
+                    params.n_threads*sparams.n_parallel, std::thread::hardware_concurrency(), whisper_print_system_info());
         }
 
         // print some info about the processing
@@ -727,9 +1051,13 @@ int whisper_server_main(int argc, char ** argv) {
             if (params.detect_language) {
                 params.language = "auto";
             }
-            fprintf(stderr, "%s: processing '%s' (%d samples, %.1f sec), %d threads, %d processors, lang = %s, task = %s, %stimestamps = %d ...\n",
-                    __func__, filename.c_str(), int(pcmf32.size()), float(pcmf32.size())/WHISPER_SAMPLE_RATE,
-                    params.n_threads, params.n_processors,
+            if (streaming) {
+                fprintf(stderr, "%s: streaming '%s' in chunks of %d sec, ", __func__, filename.c_str(), WHISPER_STREAM_CHUNK_SIZE);
+            } else {
+                fprintf(stderr, "%s: processing '%s' (%d samples, %.1f sec), ", __func__, filename.c_str(), int(pcmf32.size()), float(pcmf32.size())/WHISPER_SAMPLE_RATE);
+            }
+            fprintf(stderr, "%d threads, lang = %s, task = %s, %stimestamps = %d ...\n",
+                    params.n_threads,
                     params.language.c_str(),
                     params.translate ? "translate" : "transcribe",
                     params.tinydiarize ? "tdrz = 1, " : "",
@@ -738,6 +1066,8 @@ int whisper_server_main(int argc, char ** argv) {
             fprintf(stderr, "\n");
         }
 
+        long n_samples = pcmf32.size();
+
         // run the inference
         float t_total;
         {
@@ -767,6 +1097,9 @@ int whisper_server_main(int argc, char ** argv) {
 
             wparams.tdrz_enable      = params.tinydiarize; // [TDRZ]
 
+            wparams.vad              = params.vad;
+            wparams.vad_thold        = params.vad_thold;
+
             wparams.initial_prompt   = params.prompt.c_str();
 
             wparams.greedy.best_of        = params.best_of;
@@ -820,7 +1153,18 @@ int whisper_server_main(int argc, char ** argv) {
 
             // time the processing
             auto t_start = std::chrono::high_resolution_clock::now();
-            if (whisper_full_parallel(ctx, wparams, pcmf32.data(), pcmf32.size(), params.n_processors) != 0) {
+            int ret;
+            if (streaming) {
+                const auto read = [](float * samples, int n_samples, void * stream) {
+                    return slurp_stream_read((slurp_stream *) stream, samples, n_samples);
+                };
+                ret = whisper_full_stream_with_state(ctx, state, wparams, read, stream);
+                n_samples = slurp_stream_samples(stream);
+                slurp_stream_close(stream);
+            } else {
+                ret = whisper_full_with_state(ctx, state, wparams, pcmf32.data(), pcmf32.size());
+            }
+            if (ret != 0) {
                 fprintf(stderr, "%s: failed to process audio\n", argv[0]);
                 const std::string error_resp = "{\"error\":\"failed to process audio\"}";
                 res.set_content(error_resp, "application/json");
@@ -832,17 +1176,17 @@ int whisper_server_main(int argc, char ** argv) {
         // return results to user
         if (params.response_format == text_format)
         {
-            std::string results = output_str(ctx, params, pcmf32s);
+            std::string results = output_str(ctx, state, params, pcmf32s);
             res.set_content(results.c_str(), "text/html; charset=utf-8");
         }
         else if (params.response_format == srt_format)
         {
             std::stringstream ss;
-            const int n_segments = whisper_full_n_segments(ctx);
+            const int n_segments = whisper_full_n_segments_from_state(state);
             for (int i = 0; i < n_segments; ++i) {
-                const char * text = whisper_full_get_segment_text(ctx, i);
-                const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-                const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
+                const char * text = whisper_full_get_segment_text_from_state(state, i);
+                const int64_t t0 = whisper_full_get_segment_t0_from_state(state, i);
+                const int64_t t1 = whisper_full_get_segment_t1_from_state(state, i);
                 std::string speaker = "";
 
                 if (params.diarize && pcmf32s.size() == 2)
@@ -860,11 +1204,11 @@ int whisper_server_main(int argc, char ** argv) {
 
             ss << "WEBVTT\n\n";
 
-            const int n_segments = whisper_full_n_segments(ctx);
+            const int n_segments = whisper_full_n_segments_from_state(state);
             for (int i = 0; i < n_segments; ++i) {
-                const char * text = whisper_full_get_segment_text(ctx, i);
-                const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-                const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
+                const char * text = whisper_full_get_segment_text_from_state(state, i);
+                const int64_t t0 = whisper_full_get_segment_t0_from_state(state, i);
+                const int64_t t1 = whisper_full_get_segment_t1_from_state(state, i);
                 std::string speaker = "";
 
                 if (params.diarize && pcmf32s.size() == 2)
@@ -880,38 +1224,38 @@ int whisper_server_main(int argc, char ** argv) {
             res.set_content(ss.str(), "text/vtt");
         } else if (params.response_format == vjson_format) {
             /* try to match openai/whisper's Python format */
-            std::string results = output_str(ctx, params, pcmf32s);
+            std::string results = output_str(ctx, state, params, pcmf32s);
             json jres = json{
                 {"task", params.translate ? "translate" : "transcribe"},
-                {"language", whisper_lang_str_full(whisper_full_lang_id(ctx))},
-                {"duration", float(pcmf32.size())/WHISPER_SAMPLE_RATE},
+                {"language", whisper_lang_str_full(whisper_full_lang_id_from_state(state))},
+                {"duration", float(n_samples)/WHISPER_SAMPLE_RATE},
                 {"text", results},
                 {"transcribe_time", t_total},
                 {"segments", json::array()}
             };
-            const int n_segments = whisper_full_n_segments(ctx);
+            const int n_segments = whisper_full_n_segments_from_state(state);
             for (int i = 0; i < n_segments; ++i)
             {
                 json segment = json{
                     {"id", i},
-                    {"text", whisper_full_get_segment_text(ctx, i)},
+                    {"text", whisper_full_get_segment_text_from_state(state, i)},
                 };
 
                 if (!params.no_timestamps) {
-                    segment["start"] = whisper_full_get_segment_t0(ctx, i) * 0.01;
-                    segment["end"] = whisper_full_get_segment_t1(ctx, i) * 0.01;
+                    segment["start"] = whisper_full_get_segment_t0_from_state(state, i) * 0.01;
+                    segment["end"] = whisper_full_get_segment_t1_from_state(state, i) * 0.01;
                 }
 
                 float total_logprob = 0;
-                const int n_tokens = whisper_full_n_tokens(ctx, i);
+                const int n_tokens = whisper_full_n_tokens_from_state(state, i);
                 for (int j = 0; j < n_tokens; ++j) {
-                    whisper_token_data token = whisper_full_get_token_data(ctx, i, j);
+                    whisper_token_data token = whisper_full_get_token_data_from_state(state, i, j);
                     if (token.id >= whisper_token_eot(ctx)) {
                         continue;
                     }
 
                     segment["tokens"].push_back(token.id);
-                    json word = json{{"word", whisper_full_get_token_text(ctx, i, j)}};
+                    json word = json{{"word", whisper_full_get_token_text_from_state(ctx, state, i, j)}};
                     if (!params.no_timestamps) {
                         word["start"] = token.t0 * 0.01;
                         word["end"] = token.t1 * 0.01;
@@ -937,19 +1281,60 @@ int whisper_server_main(int argc, char ** argv) {
         // TODO add more output formats
         else
         {
-            std::string results = output_str(ctx, params, pcmf32s);
+            std::string results = output_str(ctx, state, params, pcmf32s);
             json jres = json{
                 {"text", results}
             };
             res.set_content(jres.dump(-1, ' ', false, json::error_handler_t::replace),
                             "application/json");
         }
+    });
+    // audio is uploaded as a chunked request body of 16 kHz mono s16le pcm,
+    // and results are sent back as newline delimited json while it's still
+    // arriving. the body is read from within the content provider, so the
+    // response headers go out first, and each window's result is written as
+    // soon as it's decoded. the state is held until the upload ends.
+    svr.Options(sparams.request_path + "/stream", [&](const Request &, Response &){
+    });
+
+    svr.Post(sparams.request_path + "/stream", [&](const Request &req, Response &res, const ContentReader &content_reader){
+        // keep /load from swapping the model out from under us
+        auto model_lock = std::make_shared<std::shared_lock<std::shared_mutex>>(model_mutex);
+
+        whisper_params params = default_params;
+        get_stream_parameters(req, params);
 
-        // reset params to thier defaults
-        params = default_params;
+        auto lease = std::make_shared<whisper_state_lease>(pool);
+        if (!lease->state) {
+            fprintf(stderr, "error: too many requests are waiting\n");
+            const std::string error_resp = "{\"error\":\"too many requests are waiting\"}";
+            res.status = 503;
+            res.set_content(error_resp, "application/json");
+            return;
+        }
+
+        auto stream = std::make_shared<whisper_stream>(ctx, lease->state, params);
+
+        res.set_chunked_content_provider("application/x-ndjson",
+            [model_lock, lease, stream, content_reader](size_t /*offset*/, DataSink &sink) {
+                auto emit = [&sink](const json & result) {
+                    std::string line = result.dump(-1, ' ', false, json::error_handler_t::replace) + "\n";
+                    return sink.write(line.data(), line.size());
+                };
+                bool ok = content_reader([&](const char * data, size_t size) {
+                    return stream->feed(data, size, emit);
+                });
+                if (!ok || !stream->finish(emit)) {
+                    return false;
+                }
+                sink.done();
+                return true;
+            });
     });
+
     svr.Post(sparams.request_path + "/load", [&](const Request &req, Response &res){
-        std::lock_guard<std::mutex> lock(whisper_mutex);
+        // wait for requests using the current model to finish
+        std::unique_lock<std::shared_mutex> model_lock(model_mutex);
         if (!req.has_file("model"))
         {
             fprintf(stderr, "error: no 'model' field in the request\n");
@@ -967,20 +1352,18 @@ int whisper_server_main(int argc, char ** argv) {
         }
 
         // clean up
+        pool.destroy();
         whisper_free(ctx);
 
         // whisper init
-        ctx = whisper_init_from_file_with_params(model.c_str(), cparams);
+        ctx = whisper_init_from_file_with_params_no_state(model.c_str(), cparams);
 
         // TODO perhaps load prior model here instead of exit
-        if (ctx == nullptr) {
+        if (ctx == nullptr || !pool.init(ctx, sparams.n_parallel, sparams.max_queue)) {
             fprintf(stderr, "error: model init  failed, no model loaded must exit\n");
             exit(1);
         }
 
-        // initialize openvino encoder. this has no effect on whisper.cpp builds that don't have OpenVINO configured
-        whisper_ctx_init_openvino_encoder(ctx, nullptr, params.openvino_encode_device.c_str(), nullptr);
-
         const std::string success = "Load was successful!";
         res.set_content(success, "application/text");
 
@@ -1033,6 +1416,7 @@ int whisper_server_main(int argc, char ** argv) {
     }
 
     whisper_print_timings(ctx);
+    pool.destroy();
     whisper_free(ctx);
 
     return 0;
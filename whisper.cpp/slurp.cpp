@@ -4,7 +4,10 @@
 #include "slurp.h"
 #include "miniaudio.h"
 #include "llamafile/log.h"
+#include <condition_variable>
 #include <math.h>
+#include <mutex>
+#include <thread>
 
 static int get_audio_file_channels(const char *fname) {
     ma_decoder decoder;
@@ -108,3 +111,123 @@ bool slurp_audio_file(const char *fname,
     ma_decoder_uninit(&decoder);
     return true;
 }
+
+struct slurp_stream {
+    ma_decoder decoder;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<float> ring;
+    size_t head = 0; // index of oldest sample in ring
+    size_t size = 0; // number of samples in ring
+    long consumed = 0;
+    bool eof = false;
+    bool failed = false;
+    bool closing = false;
+    const char *fname;
+};
+
+static void slurp_stream_produce(slurp_stream *s) {
+    float frames[4096];
+    for (;;) {
+        ma_uint64 got;
+        ma_result rc = ma_decoder_read_pcm_frames(&s->decoder, frames,
+                                                  sizeof(frames) / sizeof(*frames), &got);
+        if (rc != MA_SUCCESS && rc != MA_AT_END)
+            tinylogf("%s: failed to read pcm frames from audio file: %s\n",
+                     s->fname, ma_result_description(rc));
+        std::unique_lock<std::mutex> lock(s->mutex);
+        for (ma_uint64 i = 0; i < got;) {
+            s->cond.wait(lock, [s] { return s->closing || s->size < s->ring.size(); });
+            if (s->closing)
+                return;
+            for (; i < got && s->size < s->ring.size(); ++i)
+                s->ring[(s->head + s->size++) % s->ring.size()] = frames[i];
+            s->cond.notify_all();
+        }
+        if (rc != MA_SUCCESS || !got) {
+            s->failed = rc != MA_SUCCESS && rc != MA_AT_END;
+            s->eof = true;
+            s->cond.notify_all();
+            return;
+        }
+    }
+}
+
+/**
+ * Starts decoding mono audio file on a background thread.
+ *
+ * Samples are decoded, mixed down and resampled to `COMMON_SAMPLE_RATE`
+ * into a ring buffer holding at most `capacity` samples, from which they
+ * are taken by `slurp_stream_read()`. The decoder waits whenever the ring
+ * is full, so memory stays the same regardless of how long the file is,
+ * and the next part of the file gets decoded while inference is running
+ * on the previous one.
+ *
+ * Returns nullptr if the file couldn't be opened.
+ */
+slurp_stream *slurp_stream_open(const char *fname, int capacity) {
+    ma_decoder_config decoderConfig =
+            ma_decoder_config_init(ma_format_f32, 1, 16000);
+    decoderConfig.resampling.algorithm = ma_resample_algorithm_linear;
+    decoderConfig.resampling.linear.lpfOrder = 8;
+
+    slurp_stream *s = new slurp_stream;
+    ma_result rc = ma_decoder_init_file(fname, &decoderConfig, &s->decoder);
+    if (rc != MA_SUCCESS) {
+        tinylogf("%s: failed to open audio file: %s (we support .wav, .mp3, .flac, and .ogg)\n",
+                 fname, ma_result_description(rc));
+        delete s;
+        return nullptr;
+    }
+    s->fname = fname;
+    s->ring.resize(capacity);
+    s->thread = std::thread(slurp_stream_produce, s);
+    return s;
+}
+
+/**
+ * Blocks until `n` samples are read into `pcm`, or the file ends.
+ *
+ * Returns the number of samples read, which is less than `n` only once
+ * the end of the file is reached, or -1 if decoding failed.
+ */
+int slurp_stream_read(slurp_stream *s, float *pcm, int n) {
+    int got = 0;
+    std::unique_lock<std::mutex> lock(s->mutex);
+    while (got < n) {
+        s->cond.wait(lock, [s] { return s->size || s->eof; });
+        if (!s->size)
+            break;
+        for (; got < n && s->size; --s->size, ++got) {
+            pcm[got] = s->ring[s->head];
+            s->head = (s->head + 1) % s->ring.size();
+        }
+        s->cond.notify_all();
+    }
+    s->consumed += got;
+    if (!got && s->failed)
+        return -1;
+    return got;
+}
+
+/**
+ * Returns number of samples read from stream so far.
+ */
+long slurp_stream_samples(const slurp_stream *s) {
+    return s->consumed;
+}
+
+/**
+ * Stops decoding and frees stream.
+ */
+void slurp_stream_close(slurp_stream *s) {
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        s->closing = true;
+    }
+    s->cond.notify_all();
+    s->thread.join();
+    ma_decoder_uninit(&s->decoder);
+    delete s;
+}
@@ -6,3 +6,11 @@ bool slurp_audio_file(const char *fname,
                       std::vector<float> &pcmf32,
                       std::vector<std::vector<float>> &pcmf32s,
                       bool stereo);
+
+// decodes an audio file on a background thread
+struct slurp_stream;
+
+slurp_stream *slurp_stream_open(const char *fname, int capacity);
+int slurp_stream_read(slurp_stream *stream, float *pcm, int n);
+long slurp_stream_samples(const slurp_stream *stream);
+void slurp_stream_close(slurp_stream *stream);
@@ -0,0 +1,136 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+
+//
+// voice activity detection unit test
+//
+// packs synthetic audio with bursts of sound between silences, checks
+// that the bursts are what's kept, and that timestamps on the packed
+// timeline map back to where they came from in the original audio.
+//
+//     make -j o//whisper.cpp/vad_test
+//     o//whisper.cpp/vad_test
+//
+
+#include "whisper-vad.hpp"
+#include "whisper.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#define CHECK(x)                                                                                  \
+    do {                                                                                          \
+        if (!(x)) {                                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x);                 \
+            return 1;                                                                             \
+        }                                                                                         \
+    } while (0)
+
+#define CS (WHISPER_SAMPLE_RATE / 100)
+
+static const whisper_vad_params kParams = {
+    /*.thold          =*/ 20.0f,
+    /*.min_speech_ms  =*/ 250,
+    /*.min_silence_ms =*/ 500,
+    /*.pad_ms         =*/ 100,
+};
+
+// adds a vowel-like buzz with harmonics inside the speech band
+static void burst(std::vector<float> &pcm, double t0, double t1) {
+    for (int i = t0 * WHISPER_SAMPLE_RATE; i < t1 * WHISPER_SAMPLE_RATE; ++i) {
+        double t = (double)i / WHISPER_SAMPLE_RATE;
+        double x = 0;
+        for (int h = 1; h <= 8; ++h)
+            x += sin(2 * M_PI * 150 * h * t) / h;
+        pcm[i] += .2 * x;
+    }
+}
+
+static int test_map() {
+    // one second of speech at 2s, then half a second at 5s
+    const std::vector<whisper_vad_span> spans = {
+        {0, 2 * WHISPER_SAMPLE_RATE, WHISPER_SAMPLE_RATE},
+        {WHISPER_SAMPLE_RATE, 5 * WHISPER_SAMPLE_RATE, WHISPER_SAMPLE_RATE / 2},
+    };
+    CHECK(whisper_vad_map(spans, 0, false) == 200);
+    CHECK(whisper_vad_map(spans, 50, false) == 250);
+    CHECK(whisper_vad_map(spans, 50, true) == 250);
+
+    // the seam between the spans is the end of one and the start of the other
+    CHECK(whisper_vad_map(spans, 100, true) == 300);
+    CHECK(whisper_vad_map(spans, 100, false) == 500);
+    CHECK(whisper_vad_map(spans, 120, false) == 520);
+
+    // times past the speech are clamped to its end
+    CHECK(whisper_vad_map(spans, 150, true) == 550);
+    CHECK(whisper_vad_map(spans, 1000, true) == 550);
+
+    // missing timestamps are left alone, as is everything without spans
+    CHECK(whisper_vad_map(spans, -1, false) == -1);
+    CHECK(whisper_vad_map({}, 123, false) == 123);
+    return 0;
+}
+
+static int test_pack() {
+    std::vector<float> pcm(10 * WHISPER_SAMPLE_RATE);
+    for (float &x : pcm)
+        x = 1e-4f * (rand() / (float)RAND_MAX - .5f);
+    burst(pcm, 1, 2.5);
+    burst(pcm, 6, 7);
+
+    std::vector<float> speech;
+    std::vector<whisper_vad_span> spans = whisper_vad_pack(kParams, pcm.data(), pcm.size(), speech);
+    CHECK(spans.size() == 2);
+
+    // each burst is kept along with no more than its padding and a frame
+    const int slack = 100 * WHISPER_SAMPLE_RATE / 1000 + 400;
+    CHECK(spans[0].orig <= 1 * WHISPER_SAMPLE_RATE);
+    CHECK(spans[0].orig >= 1 * WHISPER_SAMPLE_RATE - slack);
+    CHECK(spans[0].orig + spans[0].len >= 2.5 * WHISPER_SAMPLE_RATE);
+    CHECK(spans[0].orig + spans[0].len <= 2.5 * WHISPER_SAMPLE_RATE + slack);
+    CHECK(spans[1].orig <= 6 * WHISPER_SAMPLE_RATE);
+    CHECK(spans[1].orig >= 6 * WHISPER_SAMPLE_RATE - slack);
+    CHECK(spans[1].orig + spans[1].len >= 7 * WHISPER_SAMPLE_RATE);
+    CHECK(spans[1].orig + spans[1].len <= 7 * WHISPER_SAMPLE_RATE + slack);
+
+    // the spans are packed back to back
+    CHECK(spans[0].packed == 0);
+    CHECK(spans[1].packed == spans[0].len);
+    CHECK((int)speech.size() == spans[0].len + spans[1].len);
+
+    // a packed time maps to the original audio that's at that time
+    for (int64_t t = 0; t < (int64_t)speech.size() / CS; ++t) {
+        const whisper_vad_span &span = t * CS < spans[1].packed ? spans[0] : spans[1];
+        int64_t orig = span.orig + t * CS - span.packed;
+        CHECK(speech[t * CS] == pcm[orig]);
+        CHECK(whisper_vad_map(spans, t, false) == orig / CS);
+    }
+    return 0;
+}
+
+static int test_silence() {
+    std::vector<float> pcm(3 * WHISPER_SAMPLE_RATE);
+    std::vector<float> speech;
+    CHECK(whisper_vad_pack(kParams, pcm.data(), pcm.size(), speech).empty());
+    CHECK(speech.empty());
+    CHECK(whisper_vad_pack(kParams, pcm.data(), 0, speech).empty());
+
+    // a recording that's loud all the way through is kept whole
+    burst(pcm, 0, 3);
+    std::vector<whisper_vad_span> spans = whisper_vad_pack(kParams, pcm.data(), pcm.size(), speech);
+    CHECK(spans.size() == 1);
+    CHECK(spans[0].orig == 0);
+    CHECK(spans[0].len == (int)pcm.size());
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rc;
+    if ((rc = test_map()))
+        return rc;
+    if ((rc = test_pack()))
+        return rc;
+    if ((rc = test_silence()))
+        return rc;
+}
@@ -0,0 +1,80 @@
+#include "whisper-cache.hpp"
+#include <cstring>
+#include <random>
+
+static uint64_t whisper_cache_mix(uint64_t a, uint64_t b) {
+    const __uint128_t r = (__uint128_t) a*b;
+    return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+static uint64_t whisper_cache_seed() {
+    std::random_device rd;
+    return (uint64_t) rd() << 32 | rd();
+}
+
+whisper_cache::whisper_cache(size_t budget) : m_budget(budget), m_seed(whisper_cache_seed()) {}
+
+uint64_t whisper_cache::hash(const float * samples, int n_samples) const {
+    const uint64_t k0 = 0xa0761d6478bd642full;
+    const uint64_t k1 = 0xe7037ed1a0b428dbull;
+
+    const char * p = (const char *) samples;
+    size_t n = (size_t) n_samples*sizeof(float);
+
+    uint64_t h = m_seed ^ whisper_cache_mix(n ^ k0, m_seed ^ k1);
+    for (; n >= 16; n -= 16, p += 16) {
+        uint64_t a, b;
+        memcpy(&a, p, 8);
+        memcpy(&b, p + 8, 8);
+        h = whisper_cache_mix(a ^ k0 ^ h, b ^ k1 ^ m_seed);
+    }
+    uint64_t a = 0, b = 0;
+    memcpy(&a, p, n < 8 ? n : 8);
+    if (n > 8) {
+        memcpy(&b, p + 8, n - 8);
+    }
+    h = whisper_cache_mix(a ^ k0 ^ h, b ^ k1 ^ m_seed);
+
+    return whisper_cache_mix(h ^ k0, h ^ k1);
+}
+
+std::shared_ptr<const whisper_cache_value> whisper_cache::get(const whisper_cache_key & key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        return nullptr;
+    }
+
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+
+    return it->second->second;
+}
+
+void whisper_cache::put(const whisper_cache_key & key, whisper_cache_value && value) {
+    const size_t size = value.data.size();
+    if (size > m_budget) {
+        return;
+    }
+
+    auto shared = std::make_shared<const whisper_cache_value>(std::move(value));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        m_size -= it->second->second->data.size();
+        m_lru.erase(it->second);
+        m_entries.erase(it);
+    }
+
+    while (!m_lru.empty() && m_size + size > m_budget) {
+        m_size -= m_lru.back().second->data.size();
+        m_entries.erase(m_lru.back().first);
+        m_lru.pop_back();
+    }
+
+    m_lru.emplace_front(key, std::move(shared));
+    m_entries[key] = m_lru.begin();
+    m_size += size;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+// encoder cache
+//
+// remembers the mel spectrograms and cross-attention memory computed for
+// recent audio, so that transcribing the same recording again, e.g. to
+// detect its language, then transcribe it, then translate it, only runs
+// the encoder the first time. audio is identified by a hash of its samples
+// that's seeded at random when the process starts, so an upload can't be
+// crafted to collide with somebody else's. the least recently used entries
+// are dropped once their size goes over budget.
+
+enum whisper_cache_kind {
+    WHISPER_CACHE_MEL,
+    WHISPER_CACHE_CROSS,
+};
+
+struct whisper_cache_key {
+    uint64_t audio;  // whisper_cache::hash() of the samples
+    int      n_samples;
+    int      kind;   // whisper_cache_kind
+    int      offset; // first mel frame of the encoded window
+    int      n_ctx;  // audio context the window was encoded with
+
+    bool operator<(const whisper_cache_key & other) const {
+        return std::tie(audio, n_samples, kind, offset, n_ctx) <
+               std::tie(other.audio, other.n_samples, other.kind, other.offset, other.n_ctx);
+    }
+};
+
+struct whisper_cache_value {
+    std::vector<uint8_t> data;
+    int n_len     = 0; // mel frames, including padding
+    int n_len_org = 0; // mel frames of the audio itself
+};
+
+struct whisper_cache {
+    explicit whisper_cache(size_t budget);
+
+    uint64_t hash(const float * samples, int n_samples) const;
+
+    size_t budget() const { return m_budget; }
+
+    // entries are immutable once stored, so they're safe to read after the
+    // cache lets go of them
+    std::shared_ptr<const whisper_cache_value> get(const whisper_cache_key & key);
+    void put(const whisper_cache_key & key, whisper_cache_value && value);
+
+  private:
+    using entry = std::pair<whisper_cache_key, std::shared_ptr<const whisper_cache_value>>;
+
+    const size_t   m_budget;
+    const uint64_t m_seed;
+
+    std::mutex m_mutex;
+    size_t     m_size = 0;
+
+    std::list<entry> m_lru; // most recently used first
+    std::map<whisper_cache_key, std::list<entry>::iterator> m_entries;
+};
@@ -0,0 +1,291 @@
+#include "whisper-fft.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// radix-p butterflies of one stage
+//
+// the data is split into blocks of p*m complex numbers, each holding p
+// transforms of size m, which are combined into one transform of size
+// p*m. the inputs of butterfly k are k, m+k, 2m+k, ... and get rotated
+// by the twiddles of k first. real and imaginary parts are kept in two
+// arrays, so the loops over k run on contiguous floats and vectorize.
+
+static void whisper_fft_radix2(float * re, float * im, const float * wr, const float * wi, int m, int blocks) {
+    for (int b = 0; b < blocks; ++b) {
+        float * r0 = re + b*2*m, * i0 = im + b*2*m;
+        float * r1 = r0 + m,     * i1 = i0 + m;
+        for (int k = 0; k < m; ++k) {
+            const float ar = r1[k]*wr[k] - i1[k]*wi[k];
+            const float ai = r1[k]*wi[k] + i1[k]*wr[k];
+            r1[k] = r0[k] - ar;
+            i1[k] = i0[k] - ai;
+            r0[k] = r0[k] + ar;
+            i0[k] = i0[k] + ai;
+        }
+    }
+}
+
+static void whisper_fft_radix3(float * re, float * im, const float * wr, const float * wi, int m, int blocks) {
+    const float s = -0.86602540378443864676f; // -sin(2pi/3)
+    for (int b = 0; b < blocks; ++b) {
+        float * r0 = re + b*3*m, * i0 = im + b*3*m;
+        float * r1 = r0 + m,     * i1 = i0 + m;
+        float * r2 = r1 + m,     * i2 = i1 + m;
+        const float * wr1 = wr, * wi1 = wi;
+        const float * wr2 = wr + m, * wi2 = wi + m;
+        for (int k = 0; k < m; ++k) {
+            const float a1r = r1[k]*wr1[k] - i1[k]*wi1[k];
+            const float a1i = r1[k]*wi1[k] + i1[k]*wr1[k];
+            const float a2r = r2[k]*wr2[k] - i2[k]*wi2[k];
+            const float a2i = r2[k]*wi2[k] + i2[k]*wr2[k];
+            const float tr = a1r + a2r, ti = a1i + a2i;
+            const float mr = r0[k] - 0.5f*tr, mi = i0[k] - 0.5f*ti;
+            const float nr = s*(a1i - a2i), ni = s*(a1r - a2r);
+            r0[k] = r0[k] + tr;
+            i0[k] = i0[k] + ti;
+            r1[k] = mr - nr;
+            i1[k] = mi + ni;
+            r2[k] = mr + nr;
+            i2[k] = mi - ni;
+        }
+    }
+}
+
+static void whisper_fft_radix4(float * re, float * im, const float * wr, const float * wi, int m, int blocks) {
+    for (int b = 0; b < blocks; ++b) {
+        float * r0 = re + b*4*m, * i0 = im + b*4*m;
+        float * r1 = r0 + m,     * i1 = i0 + m;
+        float * r2 = r1 + m,     * i2 = i1 + m;
+        float * r3 = r2 + m,     * i3 = i2 + m;
+        const float * wr1 = wr,       * wi1 = wi;
+        const float * wr2 = wr + m,   * wi2 = wi + m;
+        const float * wr3 = wr + 2*m, * wi3 = wi + 2*m;
+        for (int k = 0; k < m; ++k) {
+            const float a1r = r1[k]*wr1[k] - i1[k]*wi1[k];
+            const float a1i = r1[k]*wi1[k] + i1[k]*wr1[k];
+            const float a2r = r2[k]*wr2[k] - i2[k]*wi2[k];
+            const float a2i = r2[k]*wi2[k] + i2[k]*wr2[k];
+            const float a3r = r3[k]*wr3[k] - i3[k]*wi3[k];
+            const float a3i = r3[k]*wi3[k] + i3[k]*wr3[k];
+            const float b0r = r0[k] + a2r, b0i = i0[k] + a2i;
+            const float b1r = r0[k] - a2r, b1i = i0[k] - a2i;
+            const float b2r = a1r + a3r,   b2i = a1i + a3i;
+            const float b3r = a1r - a3r,   b3i = a1i - a3i;
+            r0[k] = b0r + b2r;
+            i0[k] = b0i + b2i;
+            r1[k] = b1r + b3i; // b1 - i*b3
+            i1[k] = b1i - b3r;
+            r2[k] = b0r - b2r;
+            i2[k] = b0i - b2i;
+            r3[k] = b1r - b3i; // b1 + i*b3
+            i3[k] = b1i + b3r;
+        }
+    }
+}
+
+static void whisper_fft_radix5(float * re, float * im, const float * wr, const float * wi, int m, int blocks) {
+    const float c1 =  0.30901699437494742410f; // cos(2pi/5)
+    const float c2 = -0.80901699437494742410f; // cos(4pi/5)
+    const float s1 =  0.95105651629515357212f; // sin(2pi/5)
+    const float s2 =  0.58778525229247312917f; // sin(4pi/5)
+    for (int b = 0; b < blocks; ++b) {
+        float * r0 = re + b*5*m, * i0 = im + b*5*m;
+        float * r1 = r0 + m,     * i1 = i0 + m;
+        float * r2 = r1 + m,     * i2 = i1 + m;
+        float * r3 = r2 + m,     * i3 = i2 + m;
+        float * r4 = r3 + m,     * i4 = i3 + m;
+        const float * wr1 = wr,       * wi1 = wi;
+        const float * wr2 = wr + m,   * wi2 = wi + m;
+        const float * wr3 = wr + 2*m, * wi3 = wi + 2*m;
+        const float * wr4 = wr + 3*m, * wi4 = wi + 3*m;
+        for (int k = 0; k < m; ++k) {
+            const float a1r = r1[k]*wr1[k] - i1[k]*wi1[k];
+            const float a1i = r1[k]*wi1[k] + i1[k]*wr1[k];
+            const float a2r = r2[k]*wr2[k] - i2[k]*wi2[k];
+            const float a2i = r2[k]*wi2[k] + i2[k]*wr2[k];
+            const float a3r = r3[k]*wr3[k] - i3[k]*wi3[k];
+            const float a3i = r3[k]*wi3[k] + i3[k]*wr3[k];
+            const float a4r = r4[k]*wr4[k] - i4[k]*wi4[k];
+            const float a4i = r4[k]*wi4[k] + i4[k]*wr4[k];
+            const float t1r = a1r + a4r, t1i = a1i + a4i;
+            const float t2r = a2r + a3r, t2i = a2i + a3i;
+            const float t3r = a1r - a4r, t3i = a1i - a4i;
+            const float t4r = a2r - a3r, t4i = a2i - a3i;
+            const float m1r = r0[k] + c1*t1r + c2*t2r, m1i = i0[k] + c1*t1i + c2*t2i;
+            const float m2r = r0[k] + c2*t1r + c1*t2r, m2i = i0[k] + c2*t1i + c1*t2i;
+            const float n1r = s1*t3r + s2*t4r, n1i = s1*t3i + s2*t4i;
+            const float n2r = s2*t3r - s1*t4r, n2i = s2*t3i - s1*t4i;
+            r0[k] = r0[k] + t1r + t2r;
+            i0[k] = i0[k] + t1i + t2i;
+            r1[k] = m1r + n1i; // m1 - i*n1
+            i1[k] = m1i - n1r;
+            r4[k] = m1r - n1i; // m1 + i*n1
+            i4[k] = m1i + n1r;
+            r2[k] = m2r + n2i; // m2 - i*n2
+            i2[k] = m2i - n2r;
+            r3[k] = m2r - n2i; // m2 + i*n2
+            i3[k] = m2i + n2r;
+        }
+    }
+}
+
+// naive DFT butterfly for any other prime, which needs 2*p floats of tmp
+static void whisper_fft_radixp(float * re, float * im, const float * wr, const float * wi, int m, int blocks, int p, float * tmp) {
+    float * tr = tmp;
+    float * ti = tmp + p;
+    for (int b = 0; b < blocks; ++b) {
+        float * r = re + b*p*m;
+        float * i = im + b*p*m;
+        for (int k = 0; k < m; ++k) {
+            tr[0] = r[k];
+            ti[0] = i[k];
+            for (int q = 1; q < p; ++q) {
+                const float xr = r[q*m + k], xi = i[q*m + k];
+                const float w_r = wr[(q - 1)*m + k], w_i = wi[(q - 1)*m + k];
+                tr[q] = xr*w_r - xi*w_i;
+                ti[q] = xr*w_i + xi*w_r;
+            }
+            for (int t = 0; t < p; ++t) {
+                float sr = 0, si = 0;
+                for (int q = 0; q < p; ++q) {
+                    const double theta = -2*M_PI*((q*t) % p)/p;
+                    const float cr = cos(theta), ci = sin(theta);
+                    sr += tr[q]*cr - ti[q]*ci;
+                    si += tr[q]*ci + ti[q]*cr;
+                }
+                r[t*m + k] = sr;
+                i[t*m + k] = si;
+            }
+        }
+    }
+}
+
+// places input index of every position of the digit reversed input
+static void whisper_fft_permute(std::vector<int> & perm, const std::vector<int> & radices,
+                                int level, int pos, int start, int stride, int n) {
+    if (n == 1) {
+        perm[pos] = start;
+        return;
+    }
+    const int p = radices[level];
+    const int m = n / p;
+    for (int q = 0; q < p; ++q) {
+        whisper_fft_permute(perm, radices, level + 1, pos + q*m, start + q*stride, stride*p, m);
+    }
+}
+
+whisper_rfft::whisper_rfft(int n) : n(n) {
+    assert(n > 0 && n % 2 == 0);
+    const int h = n / 2;
+
+    // radices from outermost to innermost
+    std::vector<int> radices;
+    int r = h;
+    while (r % 4 == 0) { radices.push_back(4); r /= 4; }
+    while (r % 2 == 0) { radices.push_back(2); r /= 2; }
+    for (int p = 3; r > 1; p += 2) {
+        while (r % p == 0) { radices.push_back(p); r /= p; }
+    }
+    max_radix = 1;
+    for (int p : radices) {
+        max_radix = std::max(max_radix, p);
+    }
+
+    perm.resize(h);
+    whisper_fft_permute(perm, radices, 0, 0, 0, 1, h);
+
+    // the innermost stage runs first, combining transforms of size 1
+    int m = 1;
+    for (int level = (int) radices.size() - 1; level >= 0; --level) {
+        const int p = radices[level];
+        stage s = {p, m, (int) tw_re.size()};
+        for (int q = 1; q < p; ++q) {
+            for (int k = 0; k < m; ++k) {
+                const double theta = -2*M_PI*q*k/(p*m);
+                tw_re.push_back(cos(theta));
+                tw_im.push_back(sin(theta));
+            }
+        }
+        stages.push_back(s);
+        m *= p;
+    }
+
+    for (int k = 0; k <= h; ++k) {
+        const double theta = -2*M_PI*k/n;
+        split_re.push_back(cos(theta));
+        split_im.push_back(sin(theta));
+    }
+}
+
+void whisper_rfft::forward(const float * in, float * out, float * work) const {
+    const int h = n / 2;
+    float * re = work;
+    float * im = work + h;
+
+    // even samples are the real parts and odd samples the imaginary ones
+    for (int i = 0; i < h; ++i) {
+        re[i] = in[2*perm[i] + 0];
+        im[i] = in[2*perm[i] + 1];
+    }
+
+    for (const stage & s : stages) {
+        const float * wr = tw_re.data() + s.twiddles;
+        const float * wi = tw_im.data() + s.twiddles;
+        const int blocks = h / (s.radix * s.m);
+        switch (s.radix) {
+            case 2: whisper_fft_radix2(re, im, wr, wi, s.m, blocks); break;
+            case 3: whisper_fft_radix3(re, im, wr, wi, s.m, blocks); break;
+            case 4: whisper_fft_radix4(re, im, wr, wi, s.m, blocks); break;
+            case 5: whisper_fft_radix5(re, im, wr, wi, s.m, blocks); break;
+            default: whisper_fft_radixp(re, im, wr, wi, s.m, blocks, s.radix, work + n); break;
+        }
+    }
+
+    // split the spectrum of the packed signal into the even and odd
+    // spectra, E[k] = (Z[k] + conj(Z[h-k]))/2 and O[k] = (Z[k] - conj(Z[h-k]))/2i,
+    // which give the real spectrum as X[k] = E[k] + e^(-2 pi i k/n) O[k]
+    for (int k = 0; k <= h; ++k) {
+        const int a = k % h;
+        const int b = (h - k) % h;
+        const float er = 0.5f*(re[a] + re[b]);
+        const float ei = 0.5f*(im[a] - im[b]);
+        const float orr = 0.5f*(im[a] + im[b]);
+        const float oi = -0.5f*(re[a] - re[b]);
+        out[2*k + 0] = er + split_re[k]*orr - split_im[k]*oi;
+        out[2*k + 1] = ei + split_re[k]*oi + split_im[k]*orr;
+    }
+}
+
+whisper_mel_filterbank::whisper_mel_filterbank(const whisper_filters & filters)
+    : n_mel(filters.n_mel), n_fft(filters.n_fft), data(filters.data.data()) {
+    for (int j = 0; j < n_mel; ++j) {
+        const float * f = data + j*n_fft;
+        int b = 0;
+        int e = n_fft;
+        while (b < e && f[b] == 0) {
+            ++b;
+        }
+        while (e > b && f[e - 1] == 0) {
+            --e;
+        }
+        begin.push_back(b);
+        end.push_back(e);
+    }
+}
+
+void whisper_mel_filterbank::apply(const float * power, int n_block, int n_frames, float * out) const {
+    for (int j = 0; j < n_mel; ++j) {
+        const float * f = data + j*n_fft;
+        float * acc = out + j*n_block;
+        for (int b = 0; b < n_frames; ++b) {
+            acc[b] = 0;
+        }
+        for (int k = begin[j]; k < end[j]; ++k) {
+            const float * p = power + k*n_block;
+            for (int b = 0; b < n_frames; ++b) {
+                acc[b] += f[k]*p[b];
+            }
+        }
+    }
+}
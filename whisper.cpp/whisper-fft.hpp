@@ -0,0 +1,59 @@
+#pragma once
+#include "whisper-mel.hpp"
+#include <vector>
+
+// FFT of real-valued input
+//
+// n must be even. the input is packed into n/2 complex numbers, which
+// are transformed with a mixed radix (4, 2, 3, 5, and naive for other
+// primes) Cooley-Tukey FFT whose twiddles are precomputed, and then split
+// into the n/2 + 1 bins of the real spectrum. whisper uses n = 400, for
+// which the complex transform is 4 * 2 * 5 * 5 points.
+struct whisper_rfft {
+    explicit whisper_rfft(int n);
+
+    // writes n/2 + 1 complex bins to out as interleaved real and
+    // imaginary parts. work must have room for work_size() floats
+    void forward(const float * in, float * out, float * work) const;
+
+    int size() const { return n; }
+    int work_size() const { return n + 2*max_radix; }
+
+private:
+    struct stage {
+        int radix;
+        int m;        // size of the transforms being combined
+        int twiddles; // offset of (radix - 1) * m twiddles in tw_re/tw_im
+    };
+
+    int n;
+    int max_radix;
+    std::vector<int> perm;      // digit reversal of the n/2 complex inputs
+    std::vector<stage> stages;
+    std::vector<float> tw_re;
+    std::vector<float> tw_im;
+    std::vector<float> split_re; // e^(-2 pi i k/n) for k in [0, n/2]
+    std::vector<float> split_im;
+};
+
+// mel filterbank which only multiplies the nonzero span of each filter
+//
+// whisper's triangular filters each cover a handful of the 201 bins, so
+// most of the dense matrix is zeros. spectra are multiplied a block of
+// frames at a time, so the innermost loop runs across frames and can be
+// vectorized by the compiler.
+struct whisper_mel_filterbank {
+    explicit whisper_mel_filterbank(const whisper_filters & filters);
+
+    // power holds n_fft rows of n_block frames, of which the first
+    // n_frames are used. out receives n_mel rows of n_block sums.
+    void apply(const float * power, int n_block, int n_frames, float * out) const;
+
+    int n_mel;
+    int n_fft;
+
+private:
+    const float * data;
+    std::vector<int> begin;
+    std::vector<int> end;
+};
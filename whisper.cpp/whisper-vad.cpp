@@ -0,0 +1,169 @@
+#include "whisper-vad.hpp"
+#include "whisper-fft.hpp"
+#include "whisper.h"
+#include <algorithm>
+#include <cmath>
+
+#define WHISPER_VAD_FRAME 400 // 25 ms
+#define WHISPER_VAD_HOP   160 // 10 ms
+
+#define WHISPER_VAD_SILENCE -60.0f // dB of band energy
+
+// value at the given fraction of the sorted values
+static float whisper_vad_percentile(std::vector<float> values, float p) {
+    const size_t i = std::min(values.size() - 1, (size_t) (p*values.size()));
+    std::nth_element(values.begin(), values.begin() + i, values.end());
+    return values[i];
+}
+
+std::vector<whisper_vad_span> whisper_vad_pack(
+        const whisper_vad_params & params,
+                     const float * samples,
+                               int n_samples,
+              std::vector<float> & speech) {
+    const int ms = WHISPER_SAMPLE_RATE/1000;
+
+    std::vector<whisper_vad_span> spans;
+    speech.clear();
+
+    if (n_samples <= 0) {
+        return spans;
+    }
+
+    const int n_frames = std::max(1, (n_samples - WHISPER_VAD_FRAME)/WHISPER_VAD_HOP + 1);
+
+    // bins of the speech band, which are 40 Hz apart
+    const int k0 = 100*WHISPER_VAD_FRAME/WHISPER_SAMPLE_RATE;
+    const int k1 = 4000*WHISPER_VAD_FRAME/WHISPER_SAMPLE_RATE;
+
+    whisper_rfft rfft(WHISPER_VAD_FRAME);
+    std::vector<float> hann(WHISPER_VAD_FRAME);
+    std::vector<float> frame(WHISPER_VAD_FRAME);
+    std::vector<float> spectrum(WHISPER_VAD_FRAME + 2);
+    std::vector<float> work(rfft.work_size());
+    std::vector<float> logp(k1 - k0, 0.0f);
+    std::vector<float> prev(k1 - k0, 0.0f);
+
+    for (int i = 0; i < WHISPER_VAD_FRAME; ++i) {
+        hann[i] = 0.5*(1.0 - cos((2.0*M_PI*i)/WHISPER_VAD_FRAME));
+    }
+
+    std::vector<float> energy(n_frames);
+    std::vector<float> flux(n_frames);
+
+    for (int i = 0; i < n_frames; ++i) {
+        const int offset = i*WHISPER_VAD_HOP;
+        const int n = std::min(WHISPER_VAD_FRAME, n_samples - offset);
+        for (int j = 0; j < n; ++j) {
+            frame[j] = hann[j]*samples[offset + j];
+        }
+        std::fill(frame.begin() + n, frame.end(), 0.0f);
+
+        rfft.forward(frame.data(), spectrum.data(), work.data());
+
+        double sum = 0.0;
+        for (int k = k0; k < k1; ++k) {
+            const float p = spectrum[2*k + 0]*spectrum[2*k + 0] + spectrum[2*k + 1]*spectrum[2*k + 1];
+            logp[k - k0] = log10f(p + 1e-10f);
+            sum += p;
+        }
+        energy[i] = 10.0*log10(sum + 1e-10);
+
+        // positive changes of the log spectrum, in dB per bin
+        float rise = 0.0f;
+        if (i > 0) {
+            for (int k = 0; k < k1 - k0; ++k) {
+                rise += std::max(0.0f, logp[k] - prev[k]);
+            }
+        }
+        flux[i] = 10.0f*rise/(k1 - k0);
+        std::swap(logp, prev);
+    }
+
+    const float floor = whisper_vad_percentile(energy, 0.10f);
+    const float peak  = whisper_vad_percentile(energy, 0.99f);
+
+    // about -100 dBFS, which only digital silence and dither stay under
+    if (peak < WHISPER_VAD_SILENCE) {
+        return spans;
+    }
+
+    std::vector<bool> voiced(n_frames);
+
+    if (peak - floor < params.thold) {
+        // without a quiet part to learn the noise floor from, keep it all
+        std::fill(voiced.begin(), voiced.end(), true);
+    } else {
+        const float flux_thold = 2.0f*whisper_vad_percentile(flux, 0.50f);
+        for (int i = 0; i < n_frames; ++i) {
+            voiced[i] = energy[i] > floor + params.thold ||
+                       (energy[i] > floor + 0.5f*params.thold && flux[i] > flux_thold);
+        }
+    }
+
+    // regions of speech in frames, with short pauses bridged
+    std::vector<std::pair<int, int>> regions;
+    const int min_silence = params.min_silence_ms*ms/WHISPER_VAD_HOP;
+    for (int i = 0; i < n_frames;) {
+        if (!voiced[i]) {
+            ++i;
+            continue;
+        }
+        int j = i;
+        while (j < n_frames && voiced[j]) {
+            ++j;
+        }
+        if (!regions.empty() && i - regions.back().second <= min_silence) {
+            regions.back().second = j;
+        } else {
+            regions.push_back({i, j});
+        }
+        i = j;
+    }
+
+    // convert to samples, padded, without the short bursts
+    const int min_speech = params.min_speech_ms*ms;
+    const int pad = params.pad_ms*ms;
+    for (const auto & r : regions) {
+        int s0 = r.first*WHISPER_VAD_HOP;
+        int s1 = std::min(n_samples, (r.second - 1)*WHISPER_VAD_HOP + WHISPER_VAD_FRAME);
+        if (s1 - s0 < min_speech) {
+            continue;
+        }
+        s0 = std::max(0, s0 - pad);
+        s1 = std::min(n_samples, s1 + pad);
+        if (!spans.empty() && s0 <= spans.back().orig + spans.back().len) {
+            spans.back().len = s1 - spans.back().orig;
+        } else {
+            spans.push_back({0, s0, s1 - s0});
+        }
+    }
+
+    for (auto & span : spans) {
+        span.packed = speech.size();
+        speech.insert(speech.end(), samples + span.orig, samples + span.orig + span.len);
+    }
+
+    return spans;
+}
+
+int64_t whisper_vad_map(const std::vector<whisper_vad_span> & spans, int64_t t, bool is_end) {
+    if (spans.empty() || t < 0) {
+        return t;
+    }
+
+    const int64_t cs = WHISPER_SAMPLE_RATE/100;
+    const int64_t s = t*cs;
+
+    // last span starting before s, or at s unless it's the end of something
+    auto it = is_end
+        ? std::lower_bound(spans.begin(), spans.end(), s, [](const whisper_vad_span & a, int64_t s) { return a.packed < s; })
+        : std::upper_bound(spans.begin(), spans.end(), s, [](int64_t s, const whisper_vad_span & a) { return s < a.packed; });
+    if (it != spans.begin()) {
+        --it;
+    }
+
+    const int64_t offset = std::max<int64_t>(0, std::min<int64_t>(s - it->packed, it->len));
+
+    return (it->orig + offset)/cs;
+}
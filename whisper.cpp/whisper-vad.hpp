@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// voice activity detection
+//
+// audio is split into 25 ms frames every 10 ms, and a frame is speech when
+// the energy of its 100-4000 Hz band rises far enough above the noise floor
+// of the recording, or rises half as far with a spectral flux that shows
+// the onsets speech has but steady hum and hiss lack. the speech is then
+// packed back to back, so whisper only encodes windows that have speech.
+
+struct whisper_vad_params {
+    float thold;          // dB above the noise floor for a frame to be speech
+    int   min_speech_ms;  // shorter bursts of sound are dropped
+    int   min_silence_ms; // shorter pauses are kept inside the speech
+    int   pad_ms;         // audio kept on either side of the speech
+};
+
+// region of the original audio kept in the packed audio
+struct whisper_vad_span {
+    int packed; // first sample in the packed audio
+    int orig;   // first sample in the original audio
+    int len;
+};
+
+// copies the speech in 16 kHz mono samples to speech, returning where
+// each part came from. nothing is returned if there's no speech
+std::vector<whisper_vad_span> whisper_vad_pack(
+        const whisper_vad_params & params,
+                     const float * samples,
+                               int n_samples,
+              std::vector<float> & speech);
+
+// maps a timestamp in centiseconds from the packed audio to the original
+// audio. a time between two parts maps to the end of the first part, if
+// it's the end of something, or to the start of the second part otherwise.
+// negative times, which mean there is no timestamp, are left as they are
+int64_t whisper_vad_map(const std::vector<whisper_vad_span> & spans, int64_t t, bool is_end);
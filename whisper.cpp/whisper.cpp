@@ -23,6 +23,9 @@
 #include "llamafile/llamafile.h"
 
 #include "whisper-mel.hpp"
+#include "whisper-fft.hpp"
+#include "whisper-vad.hpp"
+#include "whisper-cache.hpp"
 
 #include <atomic>
 #include <algorithm>
@@ -37,6 +40,8 @@
 #include <set>
 #include <string>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <vector>
 #include <regex>
 #include <random>
@@ -151,6 +156,7 @@ static void whisper_log_callback_default(ggml_log_level level, const char * text
 //#define WHISPER_USE_FLASH_FF
 #define WHISPER_MAX_DECODERS 8
 #define WHISPER_MAX_NODES 4096
+#define WHISPER_MAX_BATCH_NODES (2*WHISPER_MAX_NODES)
 
 //
 // ggml helpers
@@ -820,6 +826,11 @@ struct whisper_state {
 
     whisper_mel mel;
     whisper_mel_calc * mel_calc = nullptr;
+
+    // whisper_cache::hash() of the audio the mel was computed from. the
+    // encoder cache isn't used when n_samples is 0, e.g. after whisper_set_mel()
+    uint64_t mel_hash = 0;
+    int32_t  mel_hash_n_samples = 0;
     whisper_mel_calc * mel_calc_fallback = nullptr;
 
     whisper_batch batch;
@@ -834,6 +845,12 @@ struct whisper_state {
     whisper_sched sched_cross;
     whisper_sched sched_decode;
 
+    // batched encoder, allocated once this state leads a batch
+    whisper_sched sched_batch;
+
+    // gathers encoder calls with other states, see whisper_full_parallel()
+    struct whisper_encode_batcher * batcher = nullptr;
+
     // result of the encoder
     struct ggml_tensor * embd_conv = nullptr;
     struct ggml_tensor * embd_enc  = nullptr;
@@ -874,6 +891,10 @@ struct whisper_state {
 
     // [EXPERIMENTAL] speed-up techniques
     int32_t exp_n_audio_ctx = 0; // 0 - use default
+
+    // [EXPERIMENTAL] voice activity detection
+    // parts of the original audio that were transcribed, used to remap timestamps
+    std::vector<whisper_vad_span> vad_spans;
 };
 
 struct whisper_context {
@@ -890,6 +911,9 @@ struct whisper_context {
 
     whisper_state * state = nullptr;
 
+    // mel spectrograms and encoder outputs shared by all states
+    whisper_cache * cache = nullptr;
+
     std::string path_model; // populated by whisper_init_from_file_with_params()
 };
 
@@ -1074,6 +1098,51 @@ static void whisper_kv_cache_seq_cp(
     }
 }
 
+// reorders sequences for beam search in a single pass over the cache
+//
+// sequence j becomes what sequence src[j] was, for each j where src[j] is
+// not negative. cells aren't copied, but shared by every sequence whose
+// prefix they hold, and cells that no sequence holds anymore are freed
+static void whisper_kv_cache_seq_remap(
+        struct whisper_kv_cache & cache,
+           const whisper_seq_id * src,
+                            int   n_seq) {
+    GGML_ASSERT(n_seq <= WHISPER_MAX_DECODERS);
+
+    uint32_t new_head = cache.size;
+
+    for (uint32_t i = 0; i < cache.size; ++i) {
+        auto & cell = cache.cells[i];
+
+        if (cell.pos < 0) {
+            continue;
+        }
+
+        bool had[WHISPER_MAX_DECODERS];
+        for (int j = 0; j < n_seq; ++j) {
+            had[j] = cell.has_seq_id(j);
+        }
+
+        for (int j = 0; j < n_seq; ++j) {
+            if (src[j] < 0) {
+                continue;
+            }
+            if (had[src[j]]) {
+                cell.seq_id.insert(j);
+            } else {
+                cell.seq_id.erase(j);
+            }
+        }
+
+        if (cell.seq_id.empty()) {
+            cell.pos = -1;
+            if (new_head == cache.size) new_head = i;
+        }
+    }
+
+    if (new_head != cache.size) cache.head = new_head;
+}
+
 static uint32_t whisper_kv_cache_get_padding(const struct whisper_context & wctx) {
     if (!wctx.params.flash_attn) {
         return 1u;
@@ -2339,42 +2408,596 @@ static bool whisper_encode_internal(
         }
     }
 
-    // encoder
-    if (!whisper_encode_external(wstate)) {
-        auto & sched = wstate.sched_encode.sched;
+    // encoder
+    if (!whisper_encode_external(wstate)) {
+        auto & sched = wstate.sched_encode.sched;
+
+        ggml_cgraph * gf = whisper_build_graph_encoder(wctx, wstate);
+
+        if (!ggml_backend_sched_alloc_graph(sched, gf)) {
+            // should never happen as we pre-allocate the memory
+            return false;
+        }
+
+        if (!ggml_graph_compute_helper(sched, gf, n_threads)) {
+            return false;
+        }
+    }
+
+    // cross
+    {
+        auto & sched = wstate.sched_cross.sched;
+
+        ggml_cgraph * gf = whisper_build_graph_cross(wctx, wstate);
+
+        if (!ggml_backend_sched_alloc_graph(sched, gf)) {
+            // should never happen as we pre-allocate the memory
+            return false;
+        }
+
+        if (!ggml_graph_compute_helper(sched, gf, n_threads)) {
+            return false;
+        }
+    }
+
+    wstate.t_encode_us += ggml_time_us() - t_start_us;
+    wstate.n_encode++;
+
+    return !(abort_callback && abort_callback(abort_callback_data));
+}
+
+// encoder cache
+//
+// the encoder's only output that's used later is the cross-attention memory
+// in kv_cross, so that's what gets stored for each window of audio that was
+// hashed by whisper_pcm_to_mel_with_state(). only the n_ctx rows per layer
+// that the encoder wrote are stored, so a smaller audio_ctx makes entries
+// proportionally smaller
+
+static bool whisper_encode_cache_key(
+    const whisper_context & wctx,
+      const whisper_state & wstate,
+                const int   mel_offset,
+        whisper_cache_key & key) {
+    if (!wctx.cache || wstate.mel_hash_n_samples <= 0) {
+        return false;
+    }
+
+    const int n_ctx = wstate.exp_n_audio_ctx > 0 ? wstate.exp_n_audio_ctx : wctx.model.hparams.n_audio_ctx;
+
+    key = {wstate.mel_hash, wstate.mel_hash_n_samples, WHISPER_CACHE_CROSS, mel_offset, n_ctx};
+
+    return true;
+}
+
+// calls f(tensor, offset, size) for each range of kv_cross that encoding a
+// window with n_ctx positions writes, which is n_ctx rows for every layer at
+// the same layer stride whisper_build_graph_cross() uses, and returns the
+// total size of those ranges
+template <typename F>
+static size_t whisper_encode_cache_ranges(
+    const whisper_context & wctx,
+      const whisper_state & wstate,
+                const int   n_ctx,
+                      F &&  f) {
+    const auto & hparams = wctx.model.hparams;
+
+    const int n_state = hparams.n_audio_state;
+    const int n_layer = hparams.n_text_layer;
+    const int stride  = wctx.params.flash_attn ? GGML_PAD(n_ctx, 256) : n_ctx;
+
+    size_t total = 0;
+    for (ggml_tensor * t : {wstate.kv_cross.k, wstate.kv_cross.v}) {
+        const size_t row = ggml_element_size(t)*n_state;
+        for (int il = 0; il < n_layer; ++il) {
+            f(t, row*stride*il, row*n_ctx);
+            total += row*n_ctx;
+        }
+    }
+
+    return total;
+}
+
+// restores kv_cross if this window was encoded before
+static bool whisper_encode_cache_get(
+    const whisper_context & wctx,
+          whisper_state & wstate,
+              const int   mel_offset) {
+    whisper_cache_key key;
+    if (!whisper_encode_cache_key(wctx, wstate, mel_offset, key)) {
+        return false;
+    }
+
+    auto cached = wctx.cache->get(key);
+    if (!cached) {
+        return false;
+    }
+
+    const size_t size = whisper_encode_cache_ranges(wctx, wstate, key.n_ctx,
+            [](ggml_tensor *, size_t, size_t) {});
+    GGML_ASSERT(cached->data.size() == size);
+
+    size_t pos = 0;
+    whisper_encode_cache_ranges(wctx, wstate, key.n_ctx,
+            [&](ggml_tensor * t, size_t offset, size_t n) {
+                ggml_backend_tensor_set(t, cached->data.data() + pos, offset, n);
+                pos += n;
+            });
+
+    return true;
+}
+
+static void whisper_encode_cache_put(
+    const whisper_context & wctx,
+      const whisper_state & wstate,
+                const int   mel_offset) {
+    whisper_cache_key key;
+    if (!whisper_encode_cache_key(wctx, wstate, mel_offset, key)) {
+        return;
+    }
+
+    const size_t size = whisper_encode_cache_ranges(wctx, wstate, key.n_ctx,
+            [](ggml_tensor *, size_t, size_t) {});
+
+    // a recording with more windows than fit in the cache would push out
+    // its own first windows before they're needed again, along with those
+    // of every other recording, so it isn't cached at all. a window spans
+    // up to 2*n_ctx mel frames, but decoding usually seeks ahead by a bit
+    // less than that, hence the extra window
+    const int64_t n_frames  = (int64_t) key.n_samples/WHISPER_HOP_LENGTH;
+    const int64_t n_windows = n_frames/(2*key.n_ctx) + 1;
+    if ((size_t) n_windows*size > wctx.cache->budget()) {
+        return;
+    }
+
+    whisper_cache_value value;
+    value.data.resize(size);
+
+    size_t pos = 0;
+    whisper_encode_cache_ranges(wctx, wstate, key.n_ctx,
+            [&](ggml_tensor * t, size_t offset, size_t n) {
+                ggml_backend_tensor_get(t, value.data.data() + pos, offset, n);
+                pos += n;
+            });
+
+    wctx.cache->put(key, std::move(value));
+}
+
+// batched encoder
+//
+// stacks one mel window of each state into a single graph, so that the
+// weights of every layer are read once for the whole batch instead of
+// once per window. attention is still computed within each window, and
+// the cross-attention memory of each window is written into the kv_cross
+// of the state it came from. flash-attention isn't used here, since the
+// padded kv_pad buffer of a state only has room for a single window
+static struct ggml_cgraph * whisper_build_graph_encoder_batch(
+        whisper_context & wctx,
+          whisper_state ** states,
+              const int * offsets,
+              const int   n_batch) {
+    const auto & model   = wctx.model;
+    const auto & hparams = model.hparams;
+
+    whisper_state & wstate = *states[0];
+
+    const int n_ctx   = wstate.exp_n_audio_ctx > 0 ? wstate.exp_n_audio_ctx : hparams.n_audio_ctx;
+    const int n_state = hparams.n_audio_state;
+    const int n_head  = hparams.n_audio_head;
+    const int n_layer = hparams.n_audio_layer;
+    const int n_mels  = hparams.n_mels;
+
+    const int n_state_head = n_state/n_head;
+    const int n_tokens     = n_ctx*n_batch;
+
+    const int n_ctx_pad = GGML_PAD(n_ctx, 256);
+
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ wstate.sched_batch.meta.size(),
+        /*.mem_buffer =*/ wstate.sched_batch.meta.data(),
+        /*.no_alloc   =*/ true,
+    };
+
+    struct ggml_context * ctx0 = ggml_init(params);
+
+    ggml_cgraph * gf = ggml_new_graph_custom(ctx0, WHISPER_MAX_BATCH_NODES, false);
+
+    struct ggml_tensor * e_pe = ggml_view_2d(ctx0, model.e_pe, model.e_pe->ne[0], n_ctx, model.e_pe->nb[1], 0);
+
+    // the convolutions run on each window, since ggml_conv_1d() mixes up
+    // the channels and batches of a 3d input. the embeddings of all windows
+    // are then stacked as [n_state, n_ctx*n_batch] for the layers
+    struct ggml_tensor * cur = nullptr;
+
+    for (int b = 0; b < n_batch; ++b) {
+        GGML_ASSERT(states[b]->mel.tensor);
+
+        ggml_tensor * mel_inp = states[b]->mel.tensor;
+        ggml_set_input(mel_inp);
+
+        ggml_tensor * mel;
+        if (ggml_nelements(mel_inp) > 0) {
+            const int n_len = int(mel_inp->ne[0]);
+            const int out_s = 2 * n_ctx;
+            const int i0 = std::min(offsets[b], n_len);
+            const int i1 = std::min(offsets[b] + out_s, n_len);
+            const int mel_s = i1 - i0;
+
+            assert(mel_inp->type == GGML_TYPE_F32);
+            assert(mel_inp->ne[1] == n_mels);
+
+            mel = ggml_view_2d(ctx0, mel_inp, out_s, n_mels, mel_inp->nb[1], ggml_row_size(mel_inp->type, i0));
+
+            if (mel_s < out_s) {
+                mel = ggml_pad(ctx0, mel, out_s - mel_s, 0, 0, 0);
+            } else {
+                mel = ggml_cont(ctx0, mel);
+            }
+        } else {
+            // empty mel - just create a dummy tensor with the correct size
+            mel = ggml_new_tensor_2d(ctx0, GGML_TYPE_F32, 2*n_ctx, n_mels);
+        }
+
+        struct ggml_tensor * embd;
+
+        // convolution + gelu
+        {
+            embd = ggml_conv_1d_ph(ctx0, model.e_conv_1_w, mel, 1, 1);
+            embd = ggml_add(ctx0, embd, model.e_conv_1_b);
+
+            embd = ggml_gelu(ctx0, embd);
+
+            embd = ggml_conv_1d_ph(ctx0, model.e_conv_2_w, embd, 2, 1);
+            embd = ggml_add(ctx0, embd, model.e_conv_2_b);
+
+            embd = ggml_gelu(ctx0, embd);
+        }
+
+        embd = ggml_add(ctx0, e_pe, ggml_cont(ctx0, ggml_transpose(ctx0, embd)));
+
+        cur = cur ? ggml_concat(ctx0, cur, embd, 1) : embd;
+    }
+
+    const float KQscale = 1.0f/sqrtf(float(n_state_head));
+
+    struct ggml_tensor * inpL = cur;
+
+    for (int il = 0; il < n_layer; ++il) {
+        const auto & layer = model.layers_encoder[il];
+
+        // norm
+        {
+            cur = ggml_norm(ctx0, inpL, hparams.eps);
+
+            // cur = ln_0_w*cur + ln_0_b
+            cur = ggml_add(ctx0,
+                    ggml_mul(ctx0, cur, layer.attn_ln_0_w),
+                    layer.attn_ln_0_b);
+        }
+
+        // self-attention within each window
+        {
+            struct ggml_tensor * Qcur = ggml_mul_mat(ctx0,
+                    layer.attn_q_w,
+                    cur);
+
+            Qcur = ggml_add(ctx0, Qcur, layer.attn_q_b);
+
+            // note: no bias for Key
+            struct ggml_tensor * Kcur = ggml_mul_mat(ctx0,
+                    layer.attn_k_w,
+                    cur);
+
+            struct ggml_tensor * Vcur = ggml_mul_mat(ctx0,
+                    layer.attn_v_w,
+                    cur);
+
+            Vcur = ggml_add(ctx0, Vcur, layer.attn_v_b);
+
+            // ------
+
+            struct ggml_tensor * Q =
+                ggml_permute(ctx0,
+                        ggml_cpy(ctx0,
+                            Qcur,
+                            ggml_new_tensor_4d(ctx0, GGML_TYPE_F32, n_state_head, n_head, n_ctx, n_batch)),
+                        0, 2, 1, 3);
+
+            struct ggml_tensor * K =
+                ggml_permute(ctx0,
+                        ggml_cpy(ctx0,
+                            Kcur,
+                            ggml_new_tensor_4d(ctx0, wctx.itype, n_state_head, n_head, n_ctx, n_batch)),
+                        0, 2, 1, 3);
+
+            // K * Q
+            struct ggml_tensor * KQ = ggml_mul_mat(ctx0, K, Q);
+
+            struct ggml_tensor * KQ_soft_max = ggml_soft_max_ext(ctx0, KQ, nullptr, KQscale, 0.0f);
+
+            struct ggml_tensor * V =
+                ggml_cpy(ctx0,
+                        ggml_permute(ctx0,
+                            ggml_reshape_4d(ctx0,
+                                Vcur,
+                                n_state_head, n_head, n_ctx, n_batch),
+                            1, 2, 0, 3),
+                        ggml_new_tensor_4d(ctx0, wctx.itype, n_ctx, n_state_head, n_head, n_batch)
+                        );
+
+            struct ggml_tensor * KQV = ggml_mul_mat(ctx0, V, KQ_soft_max);
+
+            struct ggml_tensor * KQV_merged = ggml_permute(ctx0, KQV, 0, 2, 1, 3);
+
+            cur = ggml_cpy(ctx0,
+                    KQV_merged,
+                    ggml_new_tensor_2d(ctx0, GGML_TYPE_F32, n_state, n_tokens));
+        }
+
+        // projection
+        {
+            cur = ggml_mul_mat(ctx0,
+                    layer.attn_ln_1_w,
+                    cur);
+
+            cur = ggml_add(ctx0, cur, layer.attn_ln_1_b);
+        }
+
+        // add the input
+        cur = ggml_add(ctx0, cur, inpL);
+
+        struct ggml_tensor * inpFF = cur;
+
+        // feed-forward network
+        {
+            // norm
+            {
+                cur = ggml_norm(ctx0, inpFF, hparams.eps);
+
+                // cur = mlp_ln_w*cur + mlp_ln_b
+                cur = ggml_add(ctx0,
+                        ggml_mul(ctx0, cur, layer.mlp_ln_w),
+                        layer.mlp_ln_b);
+            }
+
+            // fully connected
+            cur = ggml_mul_mat(ctx0,
+                    layer.mlp_0_w,
+                    cur);
+
+            cur = ggml_add(ctx0, cur, layer.mlp_0_b);
+
+            // GELU activation
+            cur = ggml_gelu(ctx0, cur);
+
+            // projection
+            cur = ggml_mul_mat(ctx0,
+                    layer.mlp_1_w,
+                    cur);
+
+            cur = ggml_add(ctx0, cur, layer.mlp_1_b);
+        }
+
+        inpL = ggml_add(ctx0, cur, inpFF);
+    }
+
+    cur = inpL;
+
+    // norm
+    {
+        cur = ggml_norm(ctx0, cur, hparams.eps);
+
+        // cur = ln_f_g*cur + ln_f_b
+        cur = ggml_add(ctx0,
+                ggml_mul(ctx0, cur, model.e_ln_w),
+                model.e_ln_b);
+    }
+
+    // cross-attention memory of every window
+    const float Kscale = pow(float(n_state_head), -0.25);
+
+    for (int il = 0; il < model.hparams.n_text_layer; ++il) {
+        auto & layer = model.layers_decoder[il];
+
+        struct ggml_tensor * Kcross = ggml_mul_mat(ctx0,
+                layer.cross_attn_k_w,
+                cur);
+
+        Kcross = ggml_scale(ctx0, Kcross, Kscale);
+
+        struct ggml_tensor * Vcross = ggml_mul_mat(ctx0,
+                layer.cross_attn_v_w,
+                cur);
+
+        Vcross = ggml_add(ctx0,
+                    Vcross,
+                    layer.cross_attn_v_b);
+
+        for (int b = 0; b < n_batch; ++b) {
+            auto & kv_cross = states[b]->kv_cross;
+
+            struct ggml_tensor * Kb = ggml_view_2d(ctx0, Kcross, n_state, n_ctx, Kcross->nb[1], b*n_ctx*Kcross->nb[1]);
+            struct ggml_tensor * Vb = ggml_view_2d(ctx0, Vcross, n_state, n_ctx, Vcross->nb[1], b*n_ctx*Vcross->nb[1]);
+
+            struct ggml_tensor * k;
+            struct ggml_tensor * v;
+
+            if (wctx.params.flash_attn) {
+                k = ggml_view_1d(ctx0, kv_cross.k, n_state*n_ctx,
+                        (ggml_element_size(kv_cross.k)*n_state)*(il*n_ctx_pad));
+
+                v = ggml_view_1d(ctx0, kv_cross.v, n_state*n_ctx,
+                        (ggml_element_size(kv_cross.v)*n_state)*(il*n_ctx_pad));
+            } else {
+                Vb = ggml_transpose(ctx0, Vb);
+
+                k = ggml_view_1d(ctx0, kv_cross.k, n_state*n_ctx,
+                        (ggml_element_size(kv_cross.k)*n_state)*(il*n_ctx));
+
+                v = ggml_view_2d(ctx0, kv_cross.v, n_ctx, n_state,
+                        (   n_ctx)*ggml_element_size(kv_cross.v),
+                        (il*n_ctx)*ggml_element_size(kv_cross.v)*n_state);
+            }
+
+            ggml_build_forward_expand(gf, ggml_cpy(ctx0, Kb, k));
+            ggml_build_forward_expand(gf, ggml_cpy(ctx0, Vb, v));
+        }
+    }
+
+    ggml_free(ctx0);
+
+    return gf;
+}
+
+// evaluate the encoder on one window of each of the given states
+//
+// the compute buffer is allocated the first time states[0] leads a batch,
+// and is then reused by every batch it leads
+//
+//   - states:     the states whose cross-attention memory is computed
+//   - offsets:    offset in the mel spectrogram of each state
+//   - n_batch:    number of states, up to WHISPER_MAX_ENCODE_BATCH
+//
+static bool whisper_encode_batch_internal(
+        whisper_context & wctx,
+          whisper_state ** states,
+              const int * offsets,
+              const int   n_batch,
+              const int   n_threads) {
+    const int64_t t_start_us = ggml_time_us();
+
+    auto & allocr = states[0]->sched_batch;
+
+    if (!allocr.sched) {
+        auto & backends = states[0]->backends;
+
+        allocr.sched = ggml_backend_sched_new(backends.data(), nullptr, backends.size(), WHISPER_MAX_BATCH_NODES, false);
+        allocr.meta.resize(ggml_tensor_overhead()*WHISPER_MAX_BATCH_NODES + ggml_graph_overhead_custom(WHISPER_MAX_BATCH_NODES, false));
+    }
+
+    ggml_cgraph * gf = whisper_build_graph_encoder_batch(wctx, states, offsets, n_batch);
+
+    if (!ggml_backend_sched_alloc_graph(allocr.sched, gf)) {
+        WHISPER_LOG_ERROR("%s: failed to allocate the compute buffer\n", __func__);
+        return false;
+    }
+
+    if (!ggml_graph_compute_helper(allocr.sched, gf, n_threads)) {
+        return false;
+    }
+
+    // each window is charged an equal share of the batch
+    const int64_t t_encode_us = (ggml_time_us() - t_start_us)/n_batch;
+
+    for (int b = 0; b < n_batch; ++b) {
+        states[b]->t_encode_us += t_encode_us;
+        states[b]->n_encode++;
+    }
+
+    return true;
+}
+
+// returns true if the states can go through the encoder as one batch
+static bool whisper_encode_batch_supported(whisper_state ** states, int n_batch) {
+    for (int b = 0; b < n_batch; ++b) {
+        if (whisper_encode_external(*states[b]) || states[b]->exp_n_audio_ctx != states[0]->exp_n_audio_ctx) {
+            return false;
+        }
+    }
+
+    return true;
+}
 
-        ggml_cgraph * gf = whisper_build_graph_encoder(wctx, wstate);
+// gathers the encoder calls of states that are transcribing concurrently
+//
+// a state asking for a window waits until every other state that is still
+// transcribing has asked for one too. the last one to arrive encodes all
+// of them as batches, so the states never need to know how far along the
+// others are. a state leaves when it's done, and no longer holds back the
+// rest. the batches are led by the owner, which keeps the compute buffer
+struct whisper_encode_batcher {
+    whisper_context * ctx = nullptr;
+    whisper_state   * owner = nullptr;
 
-        if (!ggml_backend_sched_alloc_graph(sched, gf)) {
-            // should never happen as we pre-allocate the memory
-            return false;
+    int n_threads = 1;
+    int n_active  = 0;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    std::vector<whisper_state *> states;
+    std::vector<int> offsets;
+
+    std::map<whisper_state *, bool> results;
+};
+
+// must be called with the mutex held
+static void whisper_encode_batcher_run(whisper_encode_batcher & batcher) {
+    auto & states  = batcher.states;
+    auto & offsets = batcher.offsets;
+
+    for (size_t i = 1; i < states.size(); ++i) {
+        if (states[i] == batcher.owner) {
+            std::swap(states[0], states[i]);
+            std::swap(offsets[0], offsets[i]);
         }
+    }
 
-        if (!ggml_graph_compute_helper(sched, gf, n_threads)) {
-            return false;
+    for (size_t i = 0; i < states.size(); i += WHISPER_MAX_ENCODE_BATCH) {
+        const int n_batch = std::min<int>(WHISPER_MAX_ENCODE_BATCH, states.size() - i);
+
+        if (n_batch > 1 && whisper_encode_batch_supported(&states[i], n_batch)) {
+            const bool ok = whisper_encode_batch_internal(*batcher.ctx, &states[i], &offsets[i], n_batch, batcher.n_threads);
+            for (int b = 0; b < n_batch; ++b) {
+                batcher.results[states[i + b]] = ok;
+            }
+        } else {
+            for (int b = 0; b < n_batch; ++b) {
+                batcher.results[states[i + b]] = whisper_encode_internal(*batcher.ctx, *states[i + b], offsets[i + b], batcher.n_threads, nullptr, nullptr);
+            }
         }
     }
 
-    // cross
+    states.clear();
+    offsets.clear();
+
+    batcher.cond.notify_all();
+}
+
+static bool whisper_encode_batcher_encode(
+        whisper_encode_batcher & batcher,
+                 whisper_state & wstate,
+                     const int   mel_offset,
+           ggml_abort_callback   abort_callback,
+                        void *   abort_callback_data) {
+    bool ok;
     {
-        auto & sched = wstate.sched_cross.sched;
+        std::unique_lock<std::mutex> lock(batcher.mutex);
 
-        ggml_cgraph * gf = whisper_build_graph_cross(wctx, wstate);
+        batcher.states.push_back(&wstate);
+        batcher.offsets.push_back(mel_offset);
 
-        if (!ggml_backend_sched_alloc_graph(sched, gf)) {
-            // should never happen as we pre-allocate the memory
-            return false;
+        if ((int) batcher.states.size() == batcher.n_active) {
+            whisper_encode_batcher_run(batcher);
+        } else {
+            batcher.cond.wait(lock, [&] { return batcher.results.count(&wstate) > 0; });
         }
 
-        if (!ggml_graph_compute_helper(sched, gf, n_threads)) {
-            return false;
-        }
+        ok = batcher.results[&wstate];
+        batcher.results.erase(&wstate);
     }
 
-    wstate.t_encode_us += ggml_time_us() - t_start_us;
-    wstate.n_encode++;
+    return ok && !(abort_callback && abort_callback(abort_callback_data));
+}
 
-    return !(abort_callback && abort_callback(abort_callback_data));
+static void whisper_encode_batcher_leave(whisper_encode_batcher & batcher) {
+    std::unique_lock<std::mutex> lock(batcher.mutex);
+
+    batcher.n_active--;
+
+    if (!batcher.states.empty() && (int) batcher.states.size() == batcher.n_active) {
+        whisper_encode_batcher_run(batcher);
+    }
 }
 
 static struct ggml_cgraph * whisper_build_graph_decoder(
@@ -2925,30 +3548,18 @@ static std::string to_timestamp(int64_t t, bool comma = false) {
     return std::string(buf);
 }
 
-#define SIN_COS_N_COUNT WHISPER_N_FFT
 namespace {
 struct whisper_global_cache {
-    // In FFT, we frequently use sine and cosine operations with the same values.
-    // We can use precalculated values to speed up the process.
-    float sin_vals[SIN_COS_N_COUNT];
-    float cos_vals[SIN_COS_N_COUNT];
-
     // Hann window (Use cosf to eliminate difference)
     // ref: https://pytorch.org/docs/stable/generated/torch.hann_window.html
     // ref: https://github.com/openai/whisper/blob/main/whisper/audio.py#L147
     float hann_window[WHISPER_N_FFT];
 
-    whisper_global_cache() {
-        fill_sin_cos_table();
-        fill_hann_window(sizeof(hann_window)/sizeof(hann_window[0]), true, hann_window);
-    }
+    // FFT plan of a frame, with its twiddles computed once
+    whisper_rfft rfft;
 
-    void fill_sin_cos_table() {
-        for (int i = 0; i < SIN_COS_N_COUNT; i++) {
-            double theta = (2 * M_PI * i) / SIN_COS_N_COUNT;
-            sin_vals[i] = sinf(theta);
-            cos_vals[i] = cosf(theta);
-        }
+    whisper_global_cache() : rfft(WHISPER_N_FFT) {
+        fill_hann_window(sizeof(hann_window)/sizeof(hann_window[0]), true, hann_window);
     }
 
     void fill_hann_window(int length, bool periodic, float * output) {
@@ -2992,75 +3603,6 @@ whisper_span<const float> whisper_mel_calc::hann_window() {
     return {global_cache.hann_window, WHISPER_N_FFT};
 }
 
-// naive Discrete Fourier Transform
-// input is real-valued
-// output is complex-valued
-static void dft(const float* in, int N, float* out) {
-    const int sin_cos_step = SIN_COS_N_COUNT / N;
-
-    for (int k = 0; k < N; k++) {
-        float re = 0;
-        float im = 0;
-
-        for (int n = 0; n < N; n++) {
-            int idx = (k * n * sin_cos_step) % (SIN_COS_N_COUNT); // t = 2*M_PI*k*n/N
-            re += in[n]*global_cache.cos_vals[idx]; // cos(t)
-            im -= in[n]*global_cache.sin_vals[idx]; // sin(t)
-        }
-
-        out[k*2 + 0] = re;
-        out[k*2 + 1] = im;
-    }
-}
-
-// Cooley-Tukey FFT
-// poor man's implementation - use something better
-// input is real-valued
-// output is complex-valued
-static void fft(float* in, int N, float* out) {
-    if (N == 1) {
-        out[0] = in[0];
-        out[1] = 0;
-        return;
-    }
-
-    const int half_N = N / 2;
-    if (N - half_N*2 == 1) {
-        dft(in, N, out);
-        return;
-    }
-
-    float* even = in + N;
-    for (int i = 0; i < half_N; ++i) {
-        even[i]= in[2*i];
-    }
-    float* even_fft = out + 2 * N;
-    fft(even, half_N, even_fft);
-
-    float* odd = even;
-    for (int i = 0; i < half_N; ++i) {
-        odd[i] = in[2*i + 1];
-    }
-    float* odd_fft = even_fft + N;
-    fft(odd, half_N, odd_fft);
-
-    const int sin_cos_step = SIN_COS_N_COUNT / N;
-    for (int k = 0; k < half_N; k++) {
-        int idx = k * sin_cos_step; // t = 2*M_PI*k/N
-        float re = global_cache.cos_vals[idx]; // cos(t)
-        float im = -global_cache.sin_vals[idx]; // sin(t)
-
-        float re_odd = odd_fft[2*k + 0];
-        float im_odd = odd_fft[2*k + 1];
-
-        out[2*k + 0] = even_fft[2*k + 0] + re*re_odd - im*im_odd;
-        out[2*k + 1] = even_fft[2*k + 1] + re*im_odd + im*re_odd;
-
-        out[2*(k + half_N) + 0] = even_fft[2*k + 0] - re*re_odd + im*im_odd;
-        out[2*(k + half_N) + 1] = even_fft[2*k + 1] - re*im_odd - im*re_odd;
-    }
-}
-
 namespace {
 
 struct whisper_mel_data {
@@ -3070,69 +3612,67 @@ struct whisper_mel_data {
     float * data;
 };
 
+// frames whose spectra are multiplied by the filterbank at once
+#define WHISPER_MEL_BLOCK 16
+
 void log_mel_spectrogram_worker_thread(int ith, const float * hann, const std::vector<float> & samples,
                                               int n_samples, int n_threads,
-                                              const whisper_filters & filters, whisper_mel_data & mel) {
+                                              const whisper_mel_filterbank & filterbank, whisper_mel_data & mel) {
     const auto frame_size = WHISPER_N_FFT;
     const auto frame_step = WHISPER_HOP_LENGTH;
-    std::vector<float> fft_in(frame_size * 2, 0.0);
-    std::vector<float> fft_out(frame_size * 2 * 2 * 2);
-    int n_fft = filters.n_fft;
-    int i = ith;
+    const auto n_block = WHISPER_MEL_BLOCK;
+    const whisper_rfft & rfft = global_cache.rfft;
+    std::vector<float> fft_in(frame_size, 0.0);
+    std::vector<float> fft_out(frame_size + 2);
+    std::vector<float> fft_work(rfft.work_size());
+    int n_fft = filterbank.n_fft;
 
     // make sure n_fft == 1 + (WHISPER_N_FFT / 2), bin_0 to bin_nyquist
     assert(n_fft == 1 + (frame_size / 2));
 
-    // calculate FFT only when fft_in are not all zero
-    for (; i < std::min(n_samples / frame_step + 1, mel.n_len); i += n_threads) {
-        const int offset = i * frame_step;
+    // power spectra of a block of frames, stored bin by bin
+    std::vector<float> power(n_fft * n_block);
+    std::vector<float> sums(mel.n_mel * n_block);
 
-        // apply Hann window (~10% faster)
-        for (int j = 0; j < std::min(frame_size, n_samples - offset); j++) {
-            fft_in[j] = hann[j] * samples[offset + j];
-        }
-        // fill the rest with zeros
-        if (n_samples - offset < frame_size) {
-            std::fill(fft_in.begin() + (n_samples - offset), fft_in.end(), 0.0);
-        }
+    // calculate FFT only when fft_in are not all zero
+    // threads take turns on blocks of consecutive frames
+    const int n_frames = std::min(n_samples / frame_step + 1, mel.n_len);
+    for (int i0 = ith * n_block; i0 < n_frames; i0 += n_threads * n_block) {
+        const int nb = std::min(n_block, n_frames - i0);
+        for (int b = 0; b < nb; b++) {
+            const int offset = (i0 + b) * frame_step;
+
+            // apply Hann window (~10% faster)
+            for (int j = 0; j < std::min(frame_size, n_samples - offset); j++) {
+                fft_in[j] = hann[j] * samples[offset + j];
+            }
+            // fill the rest with zeros
+            if (n_samples - offset < frame_size) {
+                std::fill(fft_in.begin() + (n_samples - offset), fft_in.end(), 0.0);
+            }
 
-        // FFT
-        fft(fft_in.data(), frame_size, fft_out.data());
+            // FFT
+            rfft.forward(fft_in.data(), fft_out.data(), fft_work.data());
 
-        // Calculate modulus^2 of complex numbers
-        // Use pow(fft_out[2 * j + 0], 2) + pow(fft_out[2 * j + 1], 2) causes inference quality problem? Interesting.
-        for (int j = 0; j < n_fft; j++) {
-            fft_out[j] = (fft_out[2 * j + 0] * fft_out[2 * j + 0] + fft_out[2 * j + 1] * fft_out[2 * j + 1]);
+            // Calculate modulus^2 of complex numbers
+            // Use pow(fft_out[2 * j + 0], 2) + pow(fft_out[2 * j + 1], 2) causes inference quality problem? Interesting.
+            for (int j = 0; j < n_fft; j++) {
+                power[j * n_block + b] = (fft_out[2 * j + 0] * fft_out[2 * j + 0] + fft_out[2 * j + 1] * fft_out[2 * j + 1]);
+            }
         }
 
         // mel spectrogram
+        filterbank.apply(power.data(), n_block, nb, sums.data());
         for (int j = 0; j < mel.n_mel; j++) {
-            double sum = 0.0;
-
-            // unroll loop (suggested by GH user @lunixbochs)
-            int k = 0;
-            for (k = 0; k < n_fft - 3; k += 4) {
-                sum +=
-                        fft_out[k + 0] * filters.data[j * n_fft + k + 0] +
-                        fft_out[k + 1] * filters.data[j * n_fft + k + 1] +
-                        fft_out[k + 2] * filters.data[j * n_fft + k + 2] +
-                        fft_out[k + 3] * filters.data[j * n_fft + k + 3];
-            }
-
-            // handle n_fft remainder
-            for (; k < n_fft; k++) {
-                sum += fft_out[k] * filters.data[j * n_fft + k];
+            for (int b = 0; b < nb; b++) {
+                mel.data[j * mel.n_len + i0 + b] = log10(std::max(sums[j * n_block + b], 1e-10f));
             }
-
-            sum = log10(std::max(sum, 1e-10));
-
-            mel.data[j * mel.n_len + i] = sum;
         }
     }
 
     // Otherwise fft_out are all zero
     double sum = log10(1e-10);
-    for (; i < mel.n_len; i += n_threads) {
+    for (int i = n_frames + ith; i < mel.n_len; i += n_threads) {
         for (int j = 0; j < mel.n_mel; j++) {
             mel.data[j * mel.n_len + i] = sum;
         }
@@ -3142,7 +3682,8 @@ void log_mel_spectrogram_worker_thread(int ith, const float * hann, const std::v
 struct mel_calc_cpu : public whisper_mel_calc {
     ggml_backend_t m_backend;
     const whisper_filters & m_filters;
-    mel_calc_cpu(ggml_backend_t backend, const whisper_filters & filters) : m_backend(backend), m_filters(filters) {}
+    whisper_mel_filterbank m_filterbank;
+    mel_calc_cpu(ggml_backend_t backend, const whisper_filters & filters) : m_backend(backend), m_filters(filters), m_filterbank(filters) {}
 
     // ref: https://github.com/openai/whisper/blob/main/whisper/audio.py#L110-L157
     whisper_mel calculate(whisper_span<const float> ssamples, int n_threads) override {
@@ -3190,13 +3731,13 @@ struct mel_calc_cpu : public whisper_mel_calc {
             std::vector<std::thread> workers(n_threads - 1);
             for (int iw = 0; iw < n_threads - 1; ++iw) {
                 workers[iw] = std::thread(
-                        log_mel_spectrogram_worker_thread, iw + 1, hann, samples_padded,
+                        log_mel_spectrogram_worker_thread, iw + 1, hann, std::cref(samples_padded),
                         n_samples + stage_2_pad, n_threads,
-                        std::cref(m_filters), std::ref(mel));
+                        std::cref(m_filterbank), std::ref(mel));
             }
 
             // main thread
-            log_mel_spectrogram_worker_thread(0, hann, samples_padded, n_samples + stage_2_pad, n_threads, m_filters, mel);
+            log_mel_spectrogram_worker_thread(0, hann, samples_padded, n_samples + stage_2_pad, n_threads, m_filterbank, mel);
 
             for (int iw = 0; iw < n_threads - 1; ++iw) {
                 workers[iw].join();
@@ -3610,6 +4151,7 @@ struct whisper_context_params whisper_context_default_params() {
             /*.heads            =*/ NULL,
         },
         /*.dtw_mem_size         =*/ 1024*1024*128,
+        /*.cache_size           =*/ 0,
     };
     return result;
 }
@@ -3712,6 +4254,10 @@ struct whisper_context * whisper_init_with_params_no_state(struct whisper_model_
     whisper_context * ctx = new whisper_context;
     ctx->params = params;
 
+    if (params.cache_size > 0) {
+        ctx->cache = new whisper_cache(params.cache_size);
+    }
+
     if (!whisper_model_load(loader, *ctx)) {
         loader->close(loader->context);
         WHISPER_LOG_ERROR("%s: failed to load model\n", __func__);
@@ -3826,6 +4372,9 @@ void whisper_free_state(struct whisper_state * state) {
         ggml_backend_sched_free(state->sched_encode.sched);
         ggml_backend_sched_free(state->sched_cross.sched);
         ggml_backend_sched_free(state->sched_decode.sched);
+        if (state->sched_batch.sched) {
+            ggml_backend_sched_free(state->sched_batch.sched);
+        }
 
         for (auto & backend : state->backends) {
             ggml_backend_free(backend);
@@ -3846,6 +4395,7 @@ void whisper_free(struct whisper_context * ctx) {
 
         whisper_free_state(ctx->state);
 
+        delete ctx->cache;
         delete ctx;
     }
 }
@@ -3865,6 +4415,23 @@ void whisper_free_params(struct whisper_full_params * params) {
 int whisper_pcm_to_mel_with_state(struct whisper_context * ctx, struct whisper_state * state, const float * samples, int n_samples, int n_threads) {
     const int64_t t_start_us = ggml_time_us();
 
+    state->mel_hash = 0;
+    state->mel_hash_n_samples = 0;
+
+    if (ctx->cache) {
+        state->mel_hash = ctx->cache->hash(samples, n_samples);
+        state->mel_hash_n_samples = n_samples;
+
+        if (auto cached = ctx->cache->get({state->mel_hash, n_samples, WHISPER_CACHE_MEL, 0, 0})) {
+            whisper_mel_free(state->mel);
+            whisper_mel_init(state->mel, state->backends[0], cached->n_len, cached->n_len_org, ctx->model.filters.n_mel);
+            ggml_backend_tensor_set(state->mel.tensor, cached->data.data(), 0, cached->data.size());
+
+            state->t_mel_us += ggml_time_us() - t_start_us;
+            return 0;
+        }
+    }
+
     whisper_mel_free(state->mel);
     if (n_samples <= 5 * 60 * WHISPER_SAMPLE_RATE) {
         // calculate mel spectrogram for lengths up to 5 minutes on the most optimal mel calculator
@@ -3881,6 +4448,16 @@ int whisper_pcm_to_mel_with_state(struct whisper_context * ctx, struct whisper_s
         state->mel = state->mel_calc_fallback->calculate({samples, n_samples}, n_threads);
     }
 
+    if (ctx->cache) {
+        whisper_cache_value value;
+        value.data.resize(ggml_nbytes(state->mel.tensor));
+        value.n_len     = state->mel.tensor->ne[0];
+        value.n_len_org = state->mel.n_len_org;
+        ggml_backend_tensor_get(state->mel.tensor, value.data.data(), 0, value.data.size());
+
+        ctx->cache->put({state->mel_hash, n_samples, WHISPER_CACHE_MEL, 0, 0}, std::move(value));
+    }
+
     state->t_mel_us += ggml_time_us() - t_start_us;
 
     // Dump log_mel_spectrogram
@@ -3917,6 +4494,9 @@ int whisper_set_mel_with_state(
 
     ggml_backend_tensor_set(state->mel.tensor, data, 0, ggml_nbytes(state->mel.tensor));
 
+    state->mel_hash = 0;
+    state->mel_hash_n_samples = 0;
+
     return 0;
 }
 
@@ -3929,11 +4509,36 @@ int whisper_set_mel(
 }
 
 int whisper_encode_with_state(struct whisper_context * ctx, struct whisper_state * state, int offset, int n_threads) {
+    if (whisper_encode_cache_get(*ctx, *state, offset)) {
+        return 0;
+    }
+
     if (!whisper_encode_internal(*ctx, *state, offset, n_threads, nullptr, nullptr)) {
         WHISPER_LOG_ERROR("%s: failed to eval\n", __func__);
         return -1;
     }
 
+    whisper_encode_cache_put(*ctx, *state, offset);
+
+    return 0;
+}
+
+int whisper_encode_batch_with_state(struct whisper_context * ctx, struct whisper_state ** states, const int * offsets, int n_batch, int n_threads) {
+    if (n_batch < 1 || n_batch > WHISPER_MAX_ENCODE_BATCH) {
+        WHISPER_LOG_ERROR("%s: n_batch must be between 1 and %d\n", __func__, WHISPER_MAX_ENCODE_BATCH);
+        return -1;
+    }
+
+    if (!whisper_encode_batch_supported(states, n_batch)) {
+        WHISPER_LOG_ERROR("%s: states must have the same audio_ctx and no external encoder\n", __func__);
+        return -2;
+    }
+
+    if (!whisper_encode_batch_internal(*ctx, states, offsets, n_batch, n_threads)) {
+        WHISPER_LOG_ERROR("%s: failed to eval\n", __func__);
+        return -3;
+    }
+
     return 0;
 }
 
@@ -4804,6 +5409,12 @@ struct whisper_full_params whisper_full_default_params(enum whisper_sampling_str
 
         /*.tdrz_enable       =*/ false,
 
+        /*.vad                =*/ false,
+        /*.vad_thold          =*/ 10.0f,
+        /*.vad_min_speech_ms  =*/ 250,
+        /*.vad_min_silence_ms =*/ 500,
+        /*.vad_pad_ms         =*/ 200,
+
         /* suppress_regex    =*/ nullptr,
 
         /*.initial_prompt    =*/ nullptr,
@@ -5441,7 +6052,7 @@ static void whisper_sequence_score(
     }
 }
 
-int whisper_full_with_state(
+static int whisper_full_internal(
         struct whisper_context * ctx,
           struct whisper_state * state,
     struct whisper_full_params   params,
@@ -5616,19 +6227,49 @@ int whisper_full_with_state(
     std::vector<whisper_token> prompt;
     prompt.reserve(whisper_n_text_ctx(ctx));
 
+    // a candidate is its parent decoder plus one token, so the sequence
+    // and grammar are only copied for the candidates that are chosen
     struct beam_candidate {
         int decoder_idx;
-        int seek_delta;
 
-        bool has_ts;
-
-        whisper_sequence sequence;
-        whisper_grammar grammar;
+        whisper_token_data token;
+        double sum_logprobs_all;
     };
 
     std::vector<std::vector<beam_candidate>> bc_per_dec(n_decoders);
     std::vector<beam_candidate> beam_candidates;
 
+    // decoders that are running the same sequence as a lower numbered one
+    // point to it, so the common work is done once per distinct sequence
+    std::vector<int> same_as(n_decoders);
+
+    auto find_same = [&](int n_decoders_cur) {
+        for (int j = 0; j < n_decoders_cur; ++j) {
+            auto & decoder = state->decoders[j];
+
+            same_as[j] = j;
+
+            if (decoder.completed || decoder.failed) {
+                continue;
+            }
+
+            for (int k = 0; k < j; ++k) {
+                const auto & other = state->decoders[k];
+
+                if (same_as[k] == k && !other.completed && !other.failed &&
+                    whisper_sequence_tokens_equal(other.sequence, decoder.sequence)) {
+                    same_as[j] = k;
+                    break;
+                }
+            }
+        }
+    };
+
+    std::vector<whisper_sequence> beam_sequences(n_decoders);
+    std::vector<whisper_grammar>  beam_grammars(n_decoders);
+    std::vector<int>              beam_seek_delta(n_decoders);
+    std::vector<bool>             beam_has_ts(n_decoders);
+
     // main loop
     while (true) {
         if (params.progress_callback) {
@@ -5650,8 +6291,20 @@ int whisper_full_with_state(
             }
         }
 
-        // encode audio features starting at offset seek
-        if (!whisper_encode_internal(*ctx, *state, seek, params.n_threads, params.abort_callback, params.abort_callback_user_data)) {
+        // encode audio features starting at offset seek, unless this window
+        // was encoded before
+        bool encoded;
+        if (whisper_encode_cache_get(*ctx, *state, seek)) {
+            encoded = !(params.abort_callback && params.abort_callback(params.abort_callback_user_data));
+        } else {
+            encoded = state->batcher
+                ? whisper_encode_batcher_encode(*state->batcher, *state, seek, params.abort_callback, params.abort_callback_user_data)
+                : whisper_encode_internal(*ctx, *state, seek, params.n_threads, params.abort_callback, params.abort_callback_user_data);
+            if (encoded) {
+                whisper_encode_cache_put(*ctx, *state, seek);
+            }
+        }
+        if (!encoded) {
             WHISPER_LOG_ERROR("%s: failed to encode\n", __func__);
             return -6;
         }
@@ -5812,9 +6465,7 @@ int whisper_full_with_state(
                                         const auto tokens_new = whisper_sample_token_topk(*ctx, decoder, params.beam_search.beam_size);
 
                                         for (const auto & token : tokens_new) {
-                                            bc_per_dec[j].push_back({ j, decoder.seek_delta, decoder.has_ts, decoder.sequence, decoder.grammar, });
-                                            bc_per_dec[j].back().sequence.tokens.push_back(token);
-                                            bc_per_dec[j].back().sequence.sum_logprobs_all += token.plog;
+                                            bc_per_dec[j].push_back({ j, token, decoder.sequence.sum_logprobs_all + token.plog, });
                                         }
                                     } break;
                             };
@@ -5855,17 +6506,28 @@ int whisper_full_with_state(
                             beam_candidates.begin(),
                             beam_candidates.end(),
                             [](const beam_candidate & a, const beam_candidate & b) {
-                        if (a.sequence.sum_logprobs_all != b.sequence.sum_logprobs_all) {
-                            return a.sequence.sum_logprobs_all > b.sequence.sum_logprobs_all;
+                        if (a.sum_logprobs_all != b.sum_logprobs_all) {
+                            return a.sum_logprobs_all > b.sum_logprobs_all;
                         }
                         return a.decoder_idx < b.decoder_idx;
                     });
 
+                    // candidates are equal if their parents ran the same sequence
+                    find_same(n_decoders_cur);
+
+                    auto candidates_equal = [&](const beam_candidate & a, const beam_candidate & b) {
+                        return a.token.id == b.token.id && same_as[a.decoder_idx] == same_as[b.decoder_idx];
+                    };
+
+                    whisper_seq_id src[WHISPER_MAX_DECODERS];
+
                     uint32_t cur_c = 0;
 
                     for (int j = 0; j < n_decoders_cur; ++j) {
                         auto & decoder = state->decoders[j];
 
+                        src[j] = -1;
+
                         if (decoder.completed || decoder.failed) {
                             continue;
                         }
@@ -5876,32 +6538,41 @@ int whisper_full_with_state(
 
                         auto & cur = beam_candidates[cur_c++];
 
-                        while (beam_candidates.size() > cur_c && whisper_sequence_tokens_equal(beam_candidates[cur_c].sequence, cur.sequence) && i > 0) {
+                        while (beam_candidates.size() > cur_c && candidates_equal(beam_candidates[cur_c], cur) && i > 0) {
                             ++cur_c;
                         }
 
-                        decoder.seek_delta = cur.seek_delta;
-                        decoder.has_ts     = cur.has_ts;
-                        decoder.sequence   = cur.sequence;
-                        decoder.grammar    = cur.grammar;
+                        // parents may be chosen by several decoders, so none
+                        // is overwritten until every choice has been made
+                        const auto & parent = state->decoders[cur.decoder_idx];
+
+                        beam_sequences[j] = parent.sequence;
+                        beam_sequences[j].tokens.push_back(cur.token);
+                        beam_sequences[j].sum_logprobs_all = cur.sum_logprobs_all;
+                        beam_grammars[j]   = parent.grammar;
+                        beam_seek_delta[j] = parent.seek_delta;
+                        beam_has_ts[j]     = parent.has_ts;
 
-                        whisper_kv_cache_seq_cp(state->kv_self, cur.decoder_idx, WHISPER_MAX_DECODERS + j, -1, -1);
+                        src[j] = cur.decoder_idx;
 
                         WHISPER_LOG_DEBUG("%s: beam search: decoder %d: from decoder %d: token = %10s, plog = %8.5f, sum_logprobs = %8.5f\n",
-                                __func__, j, cur.decoder_idx, ctx->vocab.id_to_token.at(decoder.sequence.tokens.back().id).c_str(), decoder.sequence.tokens.back().plog, decoder.sequence.sum_logprobs_all);
+                                __func__, j, cur.decoder_idx, ctx->vocab.id_to_token.at(cur.token.id).c_str(), cur.token.plog, cur.sum_logprobs_all);
                     }
 
                     for (int j = 0; j < n_decoders_cur; ++j) {
                         auto & decoder = state->decoders[j];
 
-                        if (decoder.completed || decoder.failed) {
+                        if (src[j] < 0) {
                             continue;
                         }
 
-                        whisper_kv_cache_seq_rm(state->kv_self, j,                           -1, -1);
-                        whisper_kv_cache_seq_cp(state->kv_self, WHISPER_MAX_DECODERS + j, j, -1, -1);
-                        whisper_kv_cache_seq_rm(state->kv_self, WHISPER_MAX_DECODERS + j,    -1, -1);
+                        decoder.sequence   = std::move(beam_sequences[j]);
+                        decoder.grammar    = std::move(beam_grammars[j]);
+                        decoder.seek_delta = beam_seek_delta[j];
+                        decoder.has_ts     = beam_has_ts[j];
                     }
+
+                    whisper_kv_cache_seq_remap(state->kv_self, src, n_decoders_cur);
                 }
 
                 // update the decoder state
@@ -6021,6 +6692,11 @@ int whisper_full_with_state(
 
                     const int n_past = prompt.size() + i;
 
+                    // decoders running the same sequence, e.g. every beam on
+                    // the first step, share one token of the batch, so its
+                    // kv cell belongs to each of their sequences
+                    find_same(n_decoders_cur);
+
                     for (int j = 0; j < n_decoders_cur; ++j) {
                         auto & decoder = state->decoders[j];
 
@@ -6030,6 +6706,15 @@ int whisper_full_with_state(
 
                         //WHISPER_LOG_DEBUG("%s: decoder %d: token %d, seek_delta %d\n", __func__, j, decoder.sequence.tokens.back().id, decoder.seek_delta);
 
+                        if (same_as[j] != j) {
+                            auto & first = state->decoders[same_as[j]];
+
+                            decoder.i_batch = first.i_batch;
+
+                            batch.seq_id[decoder.i_batch][batch.n_seq_id[decoder.i_batch]++] = j;
+                            continue;
+                        }
+
                         decoder.i_batch = batch.n_tokens;
 
                         batch.token   [batch.n_tokens]    = decoder.sequence.tokens.back().id;
@@ -6063,7 +6748,7 @@ int whisper_full_with_state(
 
                                 auto & decoder = state->decoders[j];
 
-                                if (decoder.failed || decoder.completed) {
+                                if (decoder.failed || decoder.completed || same_as[j] != j) {
                                     continue;
                                 }
 
@@ -6088,6 +6773,21 @@ int whisper_full_with_state(
                                 threads[t].join();
                             }
                         }
+
+                        // the same sequence has the same distribution
+                        for (int j = 0; j < n_decoders_cur; ++j) {
+                            auto & decoder = state->decoders[j];
+
+                            if (decoder.failed || decoder.completed || same_as[j] == j) {
+                                continue;
+                            }
+
+                            const auto & first = state->decoders[same_as[j]];
+
+                            memcpy(decoder.probs.data(),    first.probs.data(),    decoder.probs.size()*sizeof(decoder.probs[0]));
+                            memcpy(decoder.logits.data(),   first.logits.data(),   decoder.logits.size()*sizeof(decoder.logits[0]));
+                            memcpy(decoder.logprobs.data(), first.logprobs.data(), decoder.logprobs.size()*sizeof(decoder.logprobs[0]));
+                        }
                     }
 
                     state->t_sample_us += ggml_time_us() - t_start_sample_us;
@@ -6210,7 +6910,7 @@ int whisper_full_with_state(
 
                             if (params.print_realtime) {
                                 if (params.print_timestamps) {
-                                    printf("[%s --> %s]  %s\n", to_timestamp(tt0).c_str(), to_timestamp(tt1).c_str(), text.c_str());
+                                    printf("[%s --> %s]  %s\n", to_timestamp(whisper_vad_map(state->vad_spans, tt0, false)).c_str(), to_timestamp(whisper_vad_map(state->vad_spans, tt1, true)).c_str(), text.c_str());
                                 } else {
                                     printf("%s", text.c_str());
                                     fflush(stdout);
@@ -6257,7 +6957,7 @@ int whisper_full_with_state(
 
                     if (params.print_realtime) {
                         if (params.print_timestamps) {
-                            printf("[%s --> %s]  %s\n", to_timestamp(tt0).c_str(), to_timestamp(tt1).c_str(), text.c_str());
+                            printf("[%s --> %s]  %s\n", to_timestamp(whisper_vad_map(state->vad_spans, tt0, false)).c_str(), to_timestamp(whisper_vad_map(state->vad_spans, tt1, true)).c_str(), text.c_str());
                         } else {
                             printf("%s", text.c_str());
                             fflush(stdout);
@@ -6306,6 +7006,64 @@ int whisper_full_with_state(
     return 0;
 }
 
+// packs the speech of the part of the audio selected by offset_ms and
+// duration_ms into speech, and records where it came from in the state
+static void whisper_full_vad(
+        struct whisper_state * state,
+   struct whisper_full_params & params,
+                 const float *& samples,
+                         int & n_samples,
+          std::vector<float> & speech) {
+    const int64_t t_start_us = ggml_time_us();
+
+    const int s0 = std::min(n_samples, std::max(0, (int) ((int64_t) params.offset_ms*WHISPER_SAMPLE_RATE/1000)));
+    const int s1 = params.duration_ms > 0 ? std::min(n_samples, s0 + (int) ((int64_t) params.duration_ms*WHISPER_SAMPLE_RATE/1000)) : n_samples;
+
+    whisper_vad_params vparams = {
+        /*.thold          =*/ params.vad_thold,
+        /*.min_speech_ms  =*/ params.vad_min_speech_ms,
+        /*.min_silence_ms =*/ params.vad_min_silence_ms,
+        /*.pad_ms         =*/ params.vad_pad_ms,
+    };
+
+    state->vad_spans = whisper_vad_pack(vparams, samples + s0, s1 - s0, speech);
+    for (auto & span : state->vad_spans) {
+        span.orig += s0;
+    }
+
+    WHISPER_LOG_INFO("%s: %d of %d ms is speech in %d parts, which took %.2f ms\n", __func__,
+            (int) (speech.size()*1000/WHISPER_SAMPLE_RATE), (s1 - s0)*1000/WHISPER_SAMPLE_RATE,
+            (int) state->vad_spans.size(), (ggml_time_us() - t_start_us)/1000.0);
+
+    params.offset_ms   = 0;
+    params.duration_ms = 0;
+
+    samples   = speech.data();
+    n_samples = speech.size();
+}
+
+int whisper_full_with_state(
+        struct whisper_context * ctx,
+          struct whisper_state * state,
+    struct whisper_full_params   params,
+                   const float * samples,
+                           int   n_samples) {
+    std::vector<float> speech;
+
+    state->vad_spans.clear();
+
+    if (params.vad) {
+        whisper_full_vad(state, params, samples, n_samples, speech);
+        if (state->vad_spans.empty()) {
+            // nothing to transcribe
+            state->result_all.clear();
+            return 0;
+        }
+    }
+
+    return whisper_full_internal(ctx, state, params, samples, n_samples);
+}
+
 int whisper_full(
         struct whisper_context * ctx,
     struct whisper_full_params   params,
@@ -6314,6 +7072,157 @@ int whisper_full(
     return whisper_full_with_state(ctx, ctx->state, params, samples, n_samples);
 }
 
+int whisper_full_stream_with_state(
+        struct whisper_context * ctx,
+          struct whisper_state * state,
+    struct whisper_full_params   params,
+     whisper_pcm_read_callback   read_callback,
+                          void * user_data) {
+    const int n_chunk  = WHISPER_STREAM_CHUNK_SIZE*WHISPER_SAMPLE_RATE;
+    const int n_margin = 5*100; // centiseconds near the end of a chunk that get transcribed again
+
+    // segments ending in the margin may have been cut off by the end of the
+    // chunk, so the next chunk starts where the last segment before it ends
+    std::vector<float> pcm;
+    std::vector<whisper_segment> result;
+    std::vector<whisper_token> prompt;
+    std::string language;
+
+    int64_t t_offset = 0; // centiseconds of audio before the chunk
+    bool eof = false;
+
+    // progress is reported through each chunk in turn, since the length of the audio isn't known
+    params.offset_ms   = 0;
+    params.duration_ms = 0;
+
+    whisper_new_segment_callback new_segment_callback = params.new_segment_callback;
+    params.new_segment_callback = nullptr;
+
+    pcm.reserve(n_chunk);
+
+    while (!eof) {
+        const int n_have = pcm.size();
+        pcm.resize(n_chunk);
+        const int n_read = read_callback(pcm.data() + n_have, n_chunk - n_have, user_data);
+        if (n_read < 0) {
+            WHISPER_LOG_ERROR("%s: failed to read audio\n", __func__);
+            return -1;
+        }
+        pcm.resize(n_have + n_read);
+        eof = n_read < n_chunk - n_have;
+
+        if (pcm.empty()) {
+            break;
+        }
+
+        whisper_full_params params_cur = params;
+
+        if (!prompt.empty()) {
+            // the text kept from the chunk before must be the only context, rather than be
+            // added to what the decoder saw last, which includes the segments being redone
+            if (!params.no_context) {
+                state->prompt_past.clear();
+            }
+            params_cur.initial_prompt  = nullptr;
+            params_cur.prompt_tokens   = params.no_context ? nullptr : prompt.data();
+            params_cur.prompt_n_tokens = params.no_context ? 0       : prompt.size();
+        }
+        if (!language.empty()) {
+            params_cur.language        = language.c_str();
+            params_cur.detect_language = false;
+        }
+
+        const int ret = whisper_full_with_state(ctx, state, params_cur, pcm.data(), pcm.size());
+        if (ret != 0 || params.detect_language) {
+            return ret;
+        }
+
+        // the language detected in the first chunk is kept
+        if (state->lang_id >= 0) {
+            language = whisper_lang_str(state->lang_id);
+        }
+
+        auto & segments = state->result_all;
+
+        // move timestamps from the speech found by vad back to the audio
+        if (!state->vad_spans.empty()) {
+            for (auto & segment : segments) {
+                segment.t0 = whisper_vad_map(state->vad_spans, segment.t0, false);
+                segment.t1 = whisper_vad_map(state->vad_spans, segment.t1, true);
+                for (auto & token : segment.tokens) {
+                    token.t0    = whisper_vad_map(state->vad_spans, token.t0,    false);
+                    token.t1    = whisper_vad_map(state->vad_spans, token.t1,    true);
+                    token.t_dtw = whisper_vad_map(state->vad_spans, token.t_dtw, false);
+                }
+            }
+            state->vad_spans.clear();
+        }
+
+        const int64_t n_len = pcm.size()/(WHISPER_SAMPLE_RATE/100);
+
+        // segments starting in the last window are short enough to be redone
+        int n_keep = segments.size();
+        if (!eof) {
+            while (n_keep > 0 && segments[n_keep - 1].t1 > n_len - n_margin &&
+                                 segments[n_keep - 1].t0 >= n_len - 100*WHISPER_CHUNK_SIZE) {
+                --n_keep;
+            }
+        }
+
+        int64_t t_cut = n_len;
+        if (!eof) {
+            if (n_keep < (int) segments.size()) {
+                t_cut = segments[n_keep].t0;
+            } else {
+                t_cut = std::max<int64_t>(n_keep > 0 ? segments[n_keep - 1].t1 : 0, n_len - n_margin);
+            }
+        }
+
+        prompt.clear();
+
+        for (int i = 0; i < n_keep; ++i) {
+            auto & segment = segments[i];
+
+            for (const auto & token : segment.tokens) {
+                if (token.id < whisper_token_eot(ctx)) {
+                    prompt.push_back(token.id);
+                }
+            }
+
+            segment.t0 += t_offset;
+            segment.t1 += t_offset;
+            for (auto & token : segment.tokens) {
+                if (token.t0    >= 0) token.t0    += t_offset;
+                if (token.t1    >= 0) token.t1    += t_offset;
+                if (token.t_dtw >= 0) token.t_dtw += t_offset;
+            }
+
+            result.push_back(std::move(segment));
+        }
+
+        if (new_segment_callback && n_keep > 0) {
+            state->result_all.swap(result);
+            new_segment_callback(ctx, state, n_keep, params.new_segment_callback_user_data);
+            state->result_all.swap(result);
+        }
+
+        pcm.erase(pcm.begin(), pcm.begin() + std::min<int64_t>(pcm.size(), t_cut*(WHISPER_SAMPLE_RATE/100)));
+        t_offset += t_cut;
+    }
+
+    state->result_all = std::move(result);
+
+    return 0;
+}
+
+int whisper_full_stream(
+        struct whisper_context * ctx,
+    struct whisper_full_params   params,
+     whisper_pcm_read_callback   read_callback,
+                          void * user_data) {
+    return whisper_full_stream_with_state(ctx, ctx->state, params, read_callback, user_data);
+}
+
 int whisper_full_parallel(
         struct whisper_context * ctx,
         struct whisper_full_params params,
@@ -6325,12 +7234,34 @@ int whisper_full_parallel(
     }
     int ret = 0;
 
+    // speech is found in all of the audio first, and then split into chunks
+    std::vector<float> speech;
+
+    ctx->state->vad_spans.clear();
+
+    if (params.vad) {
+        whisper_full_vad(ctx->state, params, samples, n_samples, speech);
+        if (ctx->state->vad_spans.empty()) {
+            ctx->state->result_all.clear();
+            return 0;
+        }
+    }
+
     // prepare separate states for each thread
     std::vector<whisper_state*> states;
 
     const int offset_samples = (WHISPER_SAMPLE_RATE*params.offset_ms)/1000;
     const int n_samples_per_processor = (n_samples - offset_samples)/n_processors;
 
+    // the chunks meet at the encoder, which runs their windows as a batch
+    whisper_encode_batcher batcher;
+    batcher.ctx       = ctx;
+    batcher.owner     = ctx->state;
+    batcher.n_threads = params.n_threads*n_processors;
+    batcher.n_active  = n_processors;
+
+    ctx->state->batcher = &batcher;
+
     // the calling thread will process the first chunk
     // while the other threads will process the remaining chunks
 
@@ -6338,6 +7269,7 @@ int whisper_full_parallel(
     for (int i = 0; i < n_processors - 1; ++i) {
         // create a new state for each thread
         states.push_back(whisper_init_state(ctx));
+        states[i]->batcher = &batcher;
 
         const int start_samples = offset_samples + (i + 1)*n_samples_per_processor;
         const int n_samples_cur = (i == n_processors - 2) ? n_samples - start_samples : n_samples_per_processor;
@@ -6354,7 +7286,10 @@ int whisper_full_parallel(
         params_cur.progress_callback = nullptr;
         params_cur.progress_callback_user_data = nullptr;
 
-        workers[i] = std::thread(whisper_full_with_state, ctx, states[i], std::move(params_cur), samples + start_samples, n_samples_cur);
+        workers[i] = std::thread([&batcher, ctx, state = states[i], params_cur = std::move(params_cur), samples_cur = samples + start_samples, n_samples_cur]() {
+            whisper_full_internal(ctx, state, params_cur, samples_cur, n_samples_cur);
+            whisper_encode_batcher_leave(batcher);
+        });
     }
 
     {
@@ -6364,13 +7299,16 @@ int whisper_full_parallel(
         params_cur.print_realtime = false;
 
         // Run the first transformation using default state but only for the first chunk.
-        ret = whisper_full_with_state(ctx, ctx->state, std::move(params_cur), samples, offset_samples + n_samples_per_processor);
+        ret = whisper_full_internal(ctx, ctx->state, std::move(params_cur), samples, offset_samples + n_samples_per_processor);
+        whisper_encode_batcher_leave(batcher);
     }
 
     for (int i = 0; i < n_processors - 1; ++i) {
         workers[i].join();
     }
 
+    ctx->state->batcher = nullptr;
+
     const int64_t offset_t = (int64_t) params.offset_ms/10.0;
 
     // combine results into result_state->result_all from all other states
@@ -6422,7 +7360,9 @@ int whisper_full_parallel(
     WHISPER_LOG_WARN("\n");
     WHISPER_LOG_WARN("%s: the audio has been split into %d chunks at the following times:\n", __func__, n_processors);
     for (int i = 0; i < n_processors - 1; ++i) {
-        WHISPER_LOG_WARN("%s: split %d - %s\n", __func__, (i + 1), to_timestamp(100*((i + 1)*n_samples_per_processor)/WHISPER_SAMPLE_RATE + offset_t).c_str());
+        // with vad the chunks were cut from the packed speech, so say where that is in the audio
+        const int64_t t_split = whisper_vad_map(ctx->state->vad_spans, 100*((i + 1)*n_samples_per_processor)/WHISPER_SAMPLE_RATE + offset_t, true);
+        WHISPER_LOG_WARN("%s: split %d - %s\n", __func__, (i + 1), to_timestamp(t_split).c_str());
     }
     WHISPER_LOG_WARN("%s: the transcription quality may be degraded near these boundaries\n", __func__);
 
@@ -6446,19 +7386,19 @@ int whisper_full_lang_id(struct whisper_context * ctx) {
 }
 
 int64_t whisper_full_get_segment_t0_from_state(struct whisper_state * state, int i_segment) {
-    return state->result_all[i_segment].t0;
+    return whisper_vad_map(state->vad_spans, state->result_all[i_segment].t0, false);
 }
 
 int64_t whisper_full_get_segment_t0(struct whisper_context * ctx, int i_segment) {
-    return ctx->state->result_all[i_segment].t0;
+    return whisper_full_get_segment_t0_from_state(ctx->state, i_segment);
 }
 
 int64_t whisper_full_get_segment_t1_from_state(struct whisper_state * state, int i_segment) {
-    return state->result_all[i_segment].t1;
+    return whisper_vad_map(state->vad_spans, state->result_all[i_segment].t1, true);
 }
 
 int64_t whisper_full_get_segment_t1(struct whisper_context * ctx, int i_segment) {
-    return ctx->state->result_all[i_segment].t1;
+    return whisper_full_get_segment_t1_from_state(ctx->state, i_segment);
 }
 
 bool whisper_full_get_segment_speaker_turn_next_from_state(struct whisper_state * state, int i_segment) {
@@ -6502,11 +7442,17 @@ whisper_token whisper_full_get_token_id(struct whisper_context * ctx, int i_segm
 }
 
 struct whisper_token_data whisper_full_get_token_data_from_state(struct whisper_state * state, int i_segment, int i_token) {
-    return state->result_all[i_segment].tokens[i_token];
+    whisper_token_data data = state->result_all[i_segment].tokens[i_token];
+    if (!state->vad_spans.empty()) {
+        data.t0    = whisper_vad_map(state->vad_spans, data.t0,    false);
+        data.t1    = whisper_vad_map(state->vad_spans, data.t1,    true);
+        data.t_dtw = whisper_vad_map(state->vad_spans, data.t_dtw, false);
+    }
+    return data;
 }
 
 struct whisper_token_data whisper_full_get_token_data(struct whisper_context * ctx, int i_segment, int i_token) {
-    return ctx->state->result_all[i_segment].tokens[i_token];
+    return whisper_full_get_token_data_from_state(ctx->state, i_segment, i_token);
 }
 
 float whisper_full_get_token_p_from_state(struct whisper_state * state, int i_segment, int i_token) {
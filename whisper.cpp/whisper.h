@@ -36,6 +36,9 @@
 #define WHISPER_CHUNK_SIZE  30
 #define WHISPER_N_SAMPLES   (WHISPER_SAMPLE_RATE * WHISPER_CHUNK_SIZE)
 
+#define WHISPER_MAX_ENCODE_BATCH 8
+#define WHISPER_STREAM_CHUNK_SIZE 300
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -125,6 +128,10 @@ extern "C" {
         struct whisper_aheads dtw_aheads;
 
         size_t dtw_mem_size; // TODO: remove
+
+        // bytes of mel spectrograms and encoder outputs to keep, so audio
+        // that's transcribed again doesn't need to be encoded again (0 = off)
+        size_t cache_size;
     };
 
     typedef struct whisper_token_data {
@@ -299,6 +306,19 @@ extern "C" {
                                int   offset,
                                int   n_threads);
 
+    // Run the Whisper encoder on one window of each state's spectrogram as a single batch.
+    // offsets[i] is the first frame of the window encoded for states[i], whose cross-attention
+    // memory is then ready for whisper_decode_with_state(), as if whisper_encode_with_state() ran.
+    // The compute buffer of the batch is kept by states[0], so pass the same state first each time.
+    // At most WHISPER_MAX_ENCODE_BATCH states can be encoded at once.
+    // Returns 0 on success
+    WHISPER_API int whisper_encode_batch_with_state(
+            struct whisper_context * ctx,
+              struct whisper_state ** states,
+                         const int * offsets,
+                               int   n_batch,
+                               int   n_threads);
+
     // Run the Whisper decoder to obtain the logits and probabilities for the next token.
     // Make sure to call whisper_encode() first.
     // tokens + n_tokens is the provided context for the decoder.
@@ -454,6 +474,11 @@ extern "C" {
                              float * logits,
                               void * user_data);
 
+    // PCM read callback
+    // Reads up to n_samples of 16 kHz mono PCM into samples, blocking until they're available
+    // Returns the number of samples read, which is less than n_samples only at the end of the audio, or -1 on error
+    typedef int (*whisper_pcm_read_callback)(float * samples, int n_samples, void * user_data);
+
     // Parameters for the whisper_full() function
     // If you change the order or add new parameters, make sure to update the default values in whisper.cpp:
     // whisper_full_default_params()
@@ -490,6 +515,16 @@ extern "C" {
         // [EXPERIMENTAL] [TDRZ] tinydiarize
         bool tdrz_enable;       // enable tinydiarize speaker turn detection
 
+        // [EXPERIMENTAL] voice activity detection
+        // only the audio detected as speech is encoded, and the timestamps
+        // returned by the whisper_full_get_...() functions are remapped to the
+        // original audio
+        bool  vad;
+        float vad_thold;          // dB above the noise floor for audio to be speech
+        int   vad_min_speech_ms;  // shorter bursts of sound are dropped
+        int   vad_min_silence_ms; // shorter pauses are kept inside the speech
+        int   vad_pad_ms;         // audio kept on either side of the speech
+
         // A regular expression that matches tokens to suppress
         const char * suppress_regex;
 
@@ -582,6 +617,7 @@ extern "C" {
     // Result is stored in the default state of the context
     // Not thread safe if executed in parallel on the same context.
     // It seems this approach can offer some speedup in some cases.
+    // The chunks are encoded together, in batches of up to WHISPER_MAX_ENCODE_BATCH windows.
     // However, the transcription accuracy can be worse at the beginning and end of each chunk.
     WHISPER_API int whisper_full_parallel(
                 struct whisper_context * ctx,
@@ -590,6 +626,25 @@ extern "C" {
                                    int   n_samples,
                                    int   n_processors);
 
+    // Transcribe audio of any length, WHISPER_STREAM_CHUNK_SIZE seconds at a time, reading it with the callback
+    // Memory use doesn't depend on the length of the audio, and the callback may decode the next chunk while
+    // the previous one is being transcribed. Segments ending near the end of a chunk are transcribed again
+    // from the start of the next chunk, and the text of the chunk before is its prompt
+    // offset_ms and duration_ms are not supported, and the progress callback starts over from 0 for every chunk
+    // Result is stored in the state, with timestamps relative to the start of the audio
+    WHISPER_API int whisper_full_stream(
+                struct whisper_context * ctx,
+            struct whisper_full_params   params,
+             whisper_pcm_read_callback   read_callback,
+                                  void * user_data);
+
+    WHISPER_API int whisper_full_stream_with_state(
+                struct whisper_context * ctx,
+                  struct whisper_state * state,
+            struct whisper_full_params   params,
+             whisper_pcm_read_callback   read_callback,
+                                  void * user_data);
+
     // Number of generated text segments
     // A segment can be a few words, a sentence, or even a paragraph.
     WHISPER_API int whisper_full_n_segments           (struct whisper_context * ctx);